@@ -0,0 +1,34 @@
+
+// Placed chip instances, see ChipInstance in renderer.hpp
+// every gate or wire of a chip mesh is drawn once per instance, with gl_InstanceID selecting the instance
+struct ChipInstance {
+	vec2  pos;
+	vec2  axis_x;
+	vec2  axis_y;
+	int   state_base; // < 0 for previews
+	int   wire_base;
+	vec4  col;
+};
+layout(std430, binding = 6) readonly buffer ChipInstances {
+	ChipInstance instances[];
+};
+
+// offsets of the current chip mesh and its instances in the buffers
+uniform int mesh_offset;
+uniform int instance_offset;
+
+vec2 instance_transform (ChipInstance inst, vec2 p) {
+	return inst.pos + inst.axis_x * p.x + inst.axis_y * p.y;
+}
+// convert chip relative state index to global one (special state indices are kept)
+int instance_state_idx (ChipInstance inst, int state_idx) {
+	if (state_idx < 0)       return state_idx;
+	if (inst.state_base < 0) return STATE_IDX_ON;
+	return inst.state_base + state_idx;
+}
+
+#ifdef _VERTEX
+ChipInstance get_instance () {
+	return instances[instance_offset + gl_InstanceID];
+}
+#endif
@@ -1,5 +1,7 @@
 #version 430
 #include "common.glsl"
+#include "sim_state.glsl"
+#include "chip_instances.glsl"
 
 struct Vertex {
 	vec2 uv;
@@ -8,7 +10,8 @@ struct Vertex {
 VS2FS Vertex v;
 
 flat VS2FS int v_gate_type;
-flat VS2FS int v_gate_state;
+flat VS2FS int v_gate_state; // 2 for X
+flat VS2FS float v_heat; // < 0 if the heatmap is off
 
 #define INP_PIN   0
 #define OUT_PIN   1
@@ -21,19 +24,45 @@ flat VS2FS int v_gate_state;
 #define XOR_GATE  8
 
 #ifdef _VERTEX
-	layout(location = 0) in vec2  pos;
-	layout(location = 1) in vec2  uv;
-	layout(location = 2) in int   gate_type;
-	layout(location = 3) in int   gate_state;
-	layout(location = 4) in vec4  col;
+	// see GateInstance in renderer.hpp
+	struct GateInstance {
+		vec2  pos;
+		vec2  axis_x;
+		vec2  axis_y;
+		vec2  size;
+		int   gate_type;
+		int   state_idx;
+		vec4  col;
+	};
+	layout(std430, binding = 4) readonly buffer Gates {
+		GateInstance gates[];
+	};
+	
+	vec2 corners[6] = {
+		vec2(-0.5, -0.5),
+		vec2(+0.5, -0.5),
+		vec2(+0.5, +0.5),
+		vec2(-0.5, -0.5),
+		vec2(+0.5, +0.5),
+		vec2(-0.5, +0.5),
+	};
 	
 	void main () {
-		gl_Position = view.world2clip * vec4(pos, 0.0, 1.0);
-		v.uv  = uv;
-		v.col = col;
+		ChipInstance inst = get_instance();
+		GateInstance gate = gates[mesh_offset + gl_VertexID / 6];
+		
+		// expand gate into quad, then transform from chip into world space
+		vec2 p = corners[gl_VertexID % 6] * gate.size;
+		vec2 chip_pos = gate.pos + gate.axis_x * p.x + gate.axis_y * p.y;
+		
+		gl_Position = view.world2clip * vec4(instance_transform(inst, chip_pos), 0.0, 1.0);
+		v.uv  = p + 0.5;
+		v.col = gate.col * inst.col;
 		
-		v_gate_type  = gate_type;
-		v_gate_state  = gate_state;
+		v_gate_type  = gate.gate_type;
+		int sid = instance_state_idx(inst, gate.state_idx);
+		v_gate_state = get_unknown(sid) ? 2 : get_state(sid);
+		v_heat       = get_heat(sid);
 	}
 #endif
 #ifdef _FRAGMENT
@@ -144,6 +173,7 @@ flat VS2FS int v_gate_state;
 		int ty  = v_gate_type/2;
 		bool inv = v_gate_type%2 != 0 && v_gate_type > OUT_PIN;
 		
+		bool unknown    = v_gate_state == 2;
 		bool base_state = v_gate_state != 0;
 		bool inv_state  = v_gate_state != 0;
 		if (inv) base_state = !base_state;
@@ -168,6 +198,8 @@ flat VS2FS int v_gate_state;
 			
 			vec4 c = v.col;
 			c.rgb *= base_state ? vec3(1) : vec3(0.1);
+			if (unknown) c.rgb = UNKNOWN_COL;
+			if (v_heat >= 0.0) c.rgb = heat_col(v_heat) * (base_state ? 1.0 : 0.5);
 			
 			c.rgb *= (1.0 - outl_alpha * 0.99);
 			c.a *= alpha;
@@ -182,6 +214,8 @@ flat VS2FS int v_gate_state;
 			
 			vec4 c = v.col;
 			c.rgb *= inv_state ? vec3(1) : vec3(0.1);
+			if (unknown) c.rgb = UNKNOWN_COL;
+			if (v_heat >= 0.0) c.rgb = heat_col(v_heat) * (inv_state ? 1.0 : 0.5);
 			
 			c.rgb *= outl_alpha * 0.99;
 			c.a *= alpha;
@@ -0,0 +1,62 @@
+
+// Simulation state uploaded by StateBuffer, one uint8 per state index packed into uints
+layout(std430, binding = 2) readonly buffer PrevStates {
+	uint prev_states[];
+};
+layout(std430, binding = 3) readonly buffer CurStates {
+	uint cur_states[];
+};
+// unknown (X) flags of the current state in ternary mode, empty otherwise
+layout(std430, binding = 7) readonly buffer CurUnknown {
+	uint cur_unknown[];
+};
+// toggle counts per state index while the activity heatmap is shown (see ToggleActivity)
+layout(std430, binding = 8) readonly buffer Activity {
+	uint activity[];
+};
+// 1 / log(1 + max toggles), 0 if the heatmap is off
+uniform float heat_scale = 0.0;
+
+// special state indices, see STATE_IDX_ON / STATE_IDX_OFF in renderer.hpp
+#define STATE_IDX_ON  -1
+#define STATE_IDX_OFF -2
+
+bool _unpack_state (uint packed, int sid) {
+	return ((packed >> ((sid & 3) * 8)) & 0xffu) != 0u;
+}
+
+// current state of a gate
+int get_state (int sid) {
+	if (sid == STATE_IDX_ON ) return 1;
+	if (sid <  0            ) return 0;
+	return _unpack_state(cur_states[sid >> 2], sid) ? 1 : 0;
+}
+// current state is X (ternary simulation)
+bool get_unknown (int sid) {
+	if (sid < 0 || (sid >> 2) >= cur_unknown.length()) return false;
+	return _unpack_state(cur_unknown[sid >> 2], sid);
+}
+#define UNKNOWN_COL vec3(1.0, 0.15, 0.55)
+
+// activity of a state in [0,1] on a log scale relative to the busiest state, -1 if the heatmap is off
+float get_heat (int sid) {
+	if (heat_scale <= 0.0) return -1.0;
+	if (sid < 0 || sid >= activity.length()) return 0.0;
+	return log(1.0 + float(activity[sid])) * heat_scale;
+}
+// dark blue (never toggled) over red to yellow (busiest)
+vec3 heat_col (float heat) {
+	vec3 cold = vec3(0.03, 0.05, 0.35);
+	vec3 warm = vec3(0.90, 0.10, 0.05);
+	vec3 hot  = vec3(1.00, 0.90, 0.20);
+	return heat < 0.5 ? mix(cold, warm, heat * 2.0) : mix(warm, hot, heat * 2.0 - 1.0);
+}
+
+// (prev_state << 1) | cur_state  for animating wires
+int get_wire_states (int sid) {
+	if (sid == STATE_IDX_ON ) return 3;
+	if (sid <  0            ) return 0;
+	int prev = _unpack_state(prev_states[sid >> 2], sid) ? 1 : 0;
+	int cur  = _unpack_state(cur_states [sid >> 2], sid) ? 1 : 0;
+	return (prev << 1) | cur;
+}
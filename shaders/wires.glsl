@@ -1,5 +1,7 @@
 #version 430
 #include "common.glsl"
+#include "sim_state.glsl"
+#include "chip_instances.glsl"
 
 struct Vertex {
 	float t;
@@ -15,13 +17,19 @@ flat VS2FS vec4 col_b;
 uniform float num_wires;
 
 #ifdef _VERTEX
-	layout(location = 0) in vec2  pos0;
-	layout(location = 1) in vec2  pos1;
-	layout(location = 2) in vec2  t;
-	layout(location = 3) in float radius;
-	layout(location = 4) in int   states;
-	layout(location = 5) in vec4  col;
-	layout(location = 6) in int   wire_id;
+	// see LineInstance in renderer.hpp
+	struct LineInstance {
+		vec2  pos0;
+		vec2  pos1;
+		vec2  t;
+		float radius;
+		int   state_idx;
+		vec4  col;
+		int   wire_id;
+	};
+	layout(std430, binding = 5) readonly buffer Lines {
+		LineInstance lines[];
+	};
 	
 	vec2 uvs[6] = {
 		vec2(+1.0, -1.0),
@@ -35,9 +43,19 @@ uniform float num_wires;
 	void main () {
 		float aa = view.frust_near_size.x * view.inv_viewport_size.x * 1.0; // pixel size in world units
 		
+		ChipInstance inst = get_instance();
+		LineInstance line = lines[mesh_offset + gl_VertexID / 12];
+		
+		// transform line from chip into world space
+		vec2  pos0    = instance_transform(inst, line.pos0);
+		vec2  pos1    = instance_transform(inst, line.pos1);
+		float radius  = line.radius * length(inst.axis_x);
+		vec2  t       = line.t;
+		vec4  col     = line.col;
+		int   wire_id = inst.wire_base + line.wire_id;
+		
 		// 0 = outline  1 = wire
 		float layer   = float((gl_VertexID / 6) % 2);
-		float line_id = float(gl_VertexID / 12);
 		vec2 uv = uvs[gl_VertexID % 6];
 		
 		// compute line coord space
@@ -56,8 +74,20 @@ uniform float num_wires;
 		
 		v.t = mix(t.x, t.y, v.coord.x / v.len);
 		
+		int sid = instance_state_idx(inst, line.state_idx);
+		int states = get_wire_states(sid);
+		
 		col_a = vec4(col.rgb * vec3((states & 1) != 0 ? 1.0 : 0.03), col.a);
 		col_b = vec4(col.rgb * vec3((states & 2) != 0 ? 1.0 : 0.03), col.a);
+		if (get_unknown(sid)) col_a.rgb = UNKNOWN_COL;
+		
+		// wires show the activity of the state driving them
+		float heat = get_heat(sid);
+		if (heat >= 0.0) {
+			col = vec4(heat_col(heat), col.a);
+			col_a.rgb = col.rgb * ((states & 1) != 0 ? 1.0 : 0.4);
+			col_b.rgb = col.rgb * ((states & 2) != 0 ? 1.0 : 0.4);
+		}
 		
 		col_a.rgb = mix(0.02 * col.rgb, col_a.rgb, layer);
 		col_b.rgb = mix(0.02 * col.rgb, col_b.rgb, layer);
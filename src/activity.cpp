@@ -0,0 +1,225 @@
+#include "common.hpp"
+#include "activity.hpp"
+
+namespace logic_sim {
+
+void ToggleActivity::reset () {
+	counts.clear();
+	pending.clear();
+	max_count = 0;
+	pending_ticks = 0;
+	ticks = 0;
+	total_toggles = 0;
+
+	chip = nullptr;
+	netlist_hash = 0;
+	instances.clear();
+	instances_ticks = (uint64_t)-1;
+}
+
+void ToggleActivity::count (LogicSim& sim) {
+	if (!enabled)
+		return;
+	ZoneScoped;
+
+	auto& cur  = sim.state[sim.cur_state];
+	auto& prev = sim.state[sim.cur_state^1];
+	size_t n = cur.size();
+
+	// state indices mean something else after a relayout
+	if (chip != sim.viewed_chip.get() || netlist_hash != sim.netlist.hash || counts.size() != n) {
+		reset();
+		chip = sim.viewed_chip.get();
+		netlist_hash = sim.netlist.hash;
+		counts.assign(n, 0);
+		pending.assign((n + 7) / 8, 0);
+	}
+
+	constexpr uint64_t LOW_BITS = 0x0101010101010101ull; // states are 0 or 1
+
+	size_t words = n / 8;
+	for (size_t w=0; w<words; ++w) {
+		uint64_t a, b;
+		memcpy(&a, cur .data() + w*8, 8);
+		memcpy(&b, prev.data() + w*8, 8);
+
+		pending[w] += (a ^ b) & LOW_BITS;
+	}
+	if (n % 8) {
+		uint64_t a = 0, b = 0;
+		memcpy(&a, cur .data() + words*8, n % 8);
+		memcpy(&b, prev.data() + words*8, n % 8);
+
+		pending[words] += (a ^ b) & LOW_BITS;
+	}
+
+	ticks++;
+
+	// one more tick could overflow an 8 bit counter into its neighbour
+	if (++pending_ticks == 255)
+		flush();
+}
+
+void ToggleActivity::flush () {
+	if (pending_ticks == 0)
+		return;
+	ZoneScoped;
+
+	// byte i of the packed counters is the count of state i, independent of byte order since they were loaded with memcpy
+	auto* bytes = (uint8_t const*)pending.data();
+	uint64_t toggled = 0;
+	for (size_t sid=0; sid<counts.size(); ++sid) {
+		counts[sid] += bytes[sid];
+		max_count = max(max_count, counts[sid]);
+		toggled += bytes[sid];
+	}
+	total_toggles += toggled;
+
+	std::fill(pending.begin(), pending.end(), 0);
+	pending_ticks = 0;
+}
+
+////
+void ToggleActivity::update_instances (LogicSim& sim) {
+	if (instances_ticks == ticks && instances_names_version == sim.names_version)
+		return;
+	ZoneScoped;
+
+	flush();
+
+	if (instances_ticks == (uint64_t)-1 || instances_names_version != sim.names_version) { // list is rebuilt after reset and when any paths changed
+		instances.clear();
+		instances_names_version = sim.names_version;
+
+		// the path of an instance at nesting depth d is made of the first d+1 components of the path of any of its states
+		auto scope_path = [&] (int32_t sid, int depth) {
+			std::string_view path = sim.signals.path(sim, sid);
+			size_t end = path.find('.');
+			for (int i=0; i<depth && end != std::string_view::npos; ++i)
+				end = path.find('.', end + 1);
+			return std::string(path.substr(0, end));
+		};
+
+		// mirrors the order of state indices (see LogicSim::update_state_indices)
+		auto collect = [&] (Chip& chip, int state_base, int depth, auto& collect) -> void {
+			for (auto& part : chip.parts) {
+				// subchips without states never toggle and have no path of their own
+				if (is_gate(part->chip) || part->chip->state_count <= 0)
+					continue;
+
+				int sid = state_base + part->sid;
+				instances.push_back({ scope_path(sid, depth), part->chip, sid });
+
+				collect(*part->chip, sid, depth + 1, collect);
+			}
+		};
+		collect(*chip, 0, 0, collect);
+	}
+
+	std::vector<uint64_t> prefix_sum(counts.size() + 1, 0);
+	for (size_t sid=0; sid<counts.size(); ++sid)
+		prefix_sum[sid+1] = prefix_sum[sid] + counts[sid];
+
+	for (auto& inst : instances)
+		inst.toggles = prefix_sum[inst.sid + inst.chip->state_count] - prefix_sum[inst.sid];
+
+	instances_ticks = ticks;
+	sort_instances();
+}
+
+void ToggleActivity::sort_instances () {
+	auto density = [&] (Instance const& i) {
+		return (double)i.toggles / (double)max(i.chip->state_count, 1);
+	};
+	auto less = [&] (Instance const& l, Instance const& r) {
+		switch (sort_column) {
+			case 0:  return l.name < r.name;
+			case 1:  return l.chip->name < r.chip->name;
+			case 3:  return density(l) < density(r);
+			default: return l.toggles < r.toggles;
+		}
+	};
+	std::stable_sort(instances.begin(), instances.end(), [&] (Instance const& l, Instance const& r) {
+		return sort_ascending ? less(l, r) : less(r, l);
+	});
+}
+
+void ToggleActivity::imgui (LogicSim& sim) {
+	if (ImGui::TreeNodeEx("Toggle Activity")) {
+		ImGui::Checkbox("Count Toggles", &enabled);
+		ImGui::SameLine();
+		if (ImGui::Button("Reset##activity"))
+			reset();
+		ImGui::SameLine();
+		ImGui::Checkbox("Heatmap", &show_heatmap);
+
+		if (ticks > 0 && !counts.empty()) {
+			flush();
+
+			double per_tick = (double)total_toggles / (double)ticks;
+			ImGui::Text("%llu ticks, %.1f toggles per tick (%.3f%% of states)",
+				(unsigned long long)ticks, per_tick, per_tick / (double)counts.size() * 100);
+			if (ImGui::IsItemHovered())
+				ImGui::SetTooltip("An event driven engine only evaluates the users of toggled states,\n"
+					"the unit delay sim evaluates every gate every tick.");
+
+			if (chip == sim.viewed_chip.get() && ImGui::TreeNodeEx("Hottest Instances")) {
+				// parts added or removed while paused change the state indices before the counts are reset on the next tick
+				bool stale = counts.size() != (size_t)chip->state_count;
+				if (!stale)
+					update_instances(sim);
+
+				auto flags = ImGuiTableFlags_Borders|ImGuiTableFlags_Sortable|ImGuiTableFlags_ScrollY|ImGuiTableFlags_Resizable;
+				if (stale) {
+					ImGui::TextDisabled("chip was edited, run the simulation to count toggles again");
+				}
+				else if (instances.empty()) {
+					ImGui::TextDisabled("no subchips");
+				}
+				else if (ImGui::BeginTable("HottestInstances", 4, flags, ImVec2(0, ImGui::GetTextLineHeightWithSpacing() * 12))) {
+					ImGui::TableSetupScrollFreeze(0, 1);
+					ImGui::TableSetupColumn("Instance");
+					ImGui::TableSetupColumn("Chip");
+					ImGui::TableSetupColumn("Toggles", ImGuiTableColumnFlags_DefaultSort|ImGuiTableColumnFlags_PreferSortDescending);
+					ImGui::TableSetupColumn("Per State", ImGuiTableColumnFlags_PreferSortDescending);
+					ImGui::TableHeadersRow();
+
+					if (ImGuiTableSortSpecs* specs = ImGui::TableGetSortSpecs()) {
+						if (specs->SpecsDirty && specs->SpecsCount > 0) {
+							sort_column    = specs->Specs[0].ColumnIndex;
+							sort_ascending = specs->Specs[0].SortDirection == ImGuiSortDirection_Ascending;
+							sort_instances();
+						}
+						specs->SpecsDirty = false;
+					}
+
+					ImGuiListClipper clip;
+					clip.Begin((int)instances.size());
+					while (clip.Step()) {
+						for (int i=clip.DisplayStart; i<clip.DisplayEnd; ++i) {
+							auto& inst = instances[i];
+
+							ImGui::TableNextColumn();
+							ImGui::TextUnformatted(inst.name.c_str());
+							ImGui::TableNextColumn();
+							ImGui::TextUnformatted(inst.chip->name.c_str());
+							ImGui::TableNextColumn();
+							ImGui::Text("%llu", (unsigned long long)inst.toggles);
+							ImGui::TableNextColumn();
+							ImGui::Text("%.3f / tick", (double)inst.toggles / (double)max(inst.chip->state_count, 1) / (double)ticks);
+						}
+					}
+					ImGui::EndTable();
+				}
+				ImGui::TreePop();
+			}
+		}
+		else if (enabled) {
+			ImGui::TextDisabled("run the simulation to count toggles");
+		}
+
+		ImGui::TreePop();
+	}
+}
+
+}
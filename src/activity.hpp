@@ -0,0 +1,57 @@
+#pragma once
+#include "common.hpp"
+#include "logic_sim.hpp"
+
+namespace logic_sim {
+
+// Toggle counters per state index of the viewed chip, to find the busy parts of a design
+// (and how much work an event driven engine would skip, since it only evaluates users of toggled states)
+// counting compares the last two state buffers 8 states at a time: the xor of two words has a 1 byte for every toggled state,
+// which is added into 8 bit counters packed in a word without carries between bytes,
+// the 8 bit counters are flushed into the 32 bit ones (and the total) every 255 ticks or when the counts are read
+struct ToggleActivity {
+	bool enabled = false;
+	bool show_heatmap = false; // colors gates and wires by activity instead of state, see StateBuffer
+
+	uint64_t ticks = 0;
+	uint64_t total_toggles = 0; // up to the last flush
+
+	// call after every sim tick (of either engine)
+	void count (LogicSim& sim);
+	void reset ();
+
+	// per state index, includes pending counts after flush()
+	std::vector<uint32_t> const& toggles () const { return counts; }
+	uint32_t max_toggles () const { return max_count; }
+	void flush ();
+
+	void imgui (LogicSim& sim);
+
+private:
+	std::vector<uint32_t> counts;
+	uint32_t max_count = 0;
+
+	std::vector<uint64_t> pending; // 8 bit counters packed into words
+	int pending_ticks = 0;
+
+	Chip*    chip = nullptr;
+	uint64_t netlist_hash = 0;
+
+	// hottest instances table, sums over the states of every subchip instance
+	struct Instance {
+		std::string name; // path of the subchip (see SignalIndex)
+		Chip*    chip;
+		int32_t  sid;
+		uint64_t toggles = 0;
+	};
+	std::vector<Instance> instances;
+	uint64_t instances_ticks = (uint64_t)-1; // ticks at which the sums were last updated, -1 if the list is stale
+	uint64_t instances_names_version = 0; // of sim when the list was built, parts might have been added, removed or renamed since
+	int  sort_column = 2;
+	bool sort_ascending = false;
+
+	void update_instances (LogicSim& sim);
+	void sort_instances ();
+};
+
+}
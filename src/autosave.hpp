@@ -0,0 +1,99 @@
+#pragma once
+#include "common.hpp"
+#include <future>
+#include <functional>
+#include <filesystem>
+
+// write data to a temporary file next to filepath, then rename it over filepath
+// so a crash or full disk during the write never leaves a half-written file behind
+inline bool write_file_atomic (std::string const& filepath, std::string_view data) {
+	std::string tmp = filepath + ".tmp";
+
+	FILE* f = fopen(tmp.c_str(), "wb");
+	if (!f)
+		return false;
+
+	bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+	ok = fflush(f) == 0 && ok;
+	ok = fclose(f) == 0 && ok;
+	if (!ok) {
+		std::remove(tmp.c_str());
+		return false;
+	}
+
+	std::error_code ec;
+	std::filesystem::rename(tmp, filepath, ec);
+	return !ec;
+}
+
+// Periodic and on-demand saving, where the actual serialization and file write run on a background thread
+// the caller takes a snapshot of the data and clears unsaved_changes when starting a save,
+// so edits made during the save simply set unsaved_changes again and are saved next time
+struct Autosave {
+	bool  enabled  = true;
+	float interval = 60; // seconds to wait after the first unsaved change
+
+	float timer = 0;
+	bool  requested = false; // save at next update, even if there are no unsaved changes
+	bool  last_failed = false;
+
+	std::future<bool> pending;
+
+	bool busy () const {
+		return pending.valid() && pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready;
+	}
+
+	// call every frame, returns true if a save should be started now
+	bool update (float dt, bool& unsaved_changes) {
+		if (pending.valid() && !busy())
+			finish(unsaved_changes);
+		if (busy())
+			return false;
+
+		timer = unsaved_changes ? timer + dt : 0;
+
+		bool due = enabled && unsaved_changes && timer >= interval;
+		if (!due && !requested)
+			return false;
+
+		requested = false;
+		timer = 0;
+		return true;
+	}
+
+	void start (std::function<bool()> job) {
+		assert(!pending.valid());
+		pending = std::async(std::launch::async, std::move(job));
+	}
+
+	// block until running save is done, needed before anything else touches the same file
+	void wait (bool& unsaved_changes) {
+		if (pending.valid())
+			finish(unsaved_changes);
+	}
+
+	void imgui () {
+		if (imgui_Header("Autosave", false)) {
+			ImGui::Checkbox("Enabled", &enabled);
+			ImGui::DragFloat("Interval", &interval, 1, 1, 3600, "%.0f s");
+
+			if (ImGui::Button("Save Now"))
+				requested = true;
+			ImGui::SameLine();
+
+			if (busy())
+				ImGui::Text("Saving...");
+			else if (last_failed)
+				ImGui::TextColored(ImVec4(1.00f, 0.20f, 0.20f, 1), "Last save failed!");
+
+			ImGui::PopID();
+		}
+	}
+
+private:
+	void finish (bool& unsaved_changes) {
+		last_failed = !pending.get();
+		if (last_failed)
+			unsaved_changes = true; // changes since the snapshot are not on disk
+	}
+};
@@ -0,0 +1,348 @@
+#include "common.hpp"
+#include "bdd.hpp"
+
+namespace logic_sim {
+
+static constexpr int32_t TERMINAL_VAR = INT_MAX;
+static constexpr size_t  CACHE_SIZE = 1 << 20;
+
+static inline uint64_t hash3 (uint64_t a, uint64_t b, uint64_t c) {
+	uint64_t h = a * 0x9E3779B97F4A7C15ull;
+	h ^= b + 0x632BE59BD9B4E019ull + (h << 6) + (h >> 2);
+	h ^= c + 0x85EBCA77C2B2AE63ull + (h << 6) + (h >> 2);
+	return h ^ (h >> 31);
+}
+
+Bdd::Bdd (size_t max_nodes): max_nodes{max_nodes} {
+	nodes.push_back({ TERMINAL_VAR, ZERO, ZERO });
+	nodes.push_back({ TERMINAL_VAR, ONE, ONE });
+
+	unique.assign(1 << 16, -1);
+	cache.resize(CACHE_SIZE);
+}
+
+void Bdd::grow_unique () {
+	unique.assign(unique.size() * 2, -1);
+	size_t mask = unique.size() - 1;
+
+	for (Ref r=2; r<(Ref)nodes.size(); ++r) {
+		auto& n = nodes[r];
+		size_t i = hash3(n.var, n.lo, n.hi) & mask;
+		while (unique[i] >= 0)
+			i = (i + 1) & mask;
+		unique[i] = r;
+	}
+}
+
+Bdd::Ref Bdd::make (int32_t var, Ref lo, Ref hi) {
+	if (lo == hi)
+		return lo;
+
+	size_t mask = unique.size() - 1;
+	size_t i = hash3(var, lo, hi) & mask;
+	for (; unique[i] >= 0; i = (i + 1) & mask) {
+		auto& n = nodes[unique[i]];
+		if (n.var == var && n.lo == lo && n.hi == hi)
+			return unique[i];
+	}
+
+	if (nodes.size() >= max_nodes)
+		throw Overflow{};
+
+	Ref r = (Ref)nodes.size();
+	nodes.push_back({ var, lo, hi });
+	unique[i] = r;
+
+	// keep load factor below 1/2
+	if (++unique_count * 2 > unique.size())
+		grow_unique();
+	return r;
+}
+
+Bdd::Ref Bdd::var (int v) {
+	return make(v, ZERO, ONE);
+}
+
+Bdd::Ref Bdd::apply (Op op, Ref a, Ref b) {
+	// terminal cases
+	switch (op) {
+		case AND:
+			if (a == ZERO || b == ZERO) return ZERO;
+			if (a == ONE) return b;
+			if (b == ONE || a == b) return a;
+			break;
+		case OR:
+			if (a == ONE || b == ONE) return ONE;
+			if (a == ZERO) return b;
+			if (b == ZERO || a == b) return a;
+			break;
+		case XOR:
+			if (a == b) return ZERO;
+			if (a == ZERO) return b;
+			if (b == ZERO) return a;
+			if (a == ONE && b == ONE) return ZERO;
+			break;
+	}
+	// all ops are commutative
+	if (a > b)
+		std::swap(a, b);
+
+	auto& entry = cache[hash3(op, a, b) & (CACHE_SIZE-1)];
+	if (entry.a == a && entry.b == b && entry.op == op)
+		return entry.res;
+
+	// copy, nodes may reallocate during recursion
+	Node na = nodes[a], nb = nodes[b];
+	int32_t v = min(na.var, nb.var);
+
+	Ref a0 = na.var == v ? na.lo : a, a1 = na.var == v ? na.hi : a;
+	Ref b0 = nb.var == v ? nb.lo : b, b1 = nb.var == v ? nb.hi : b;
+
+	Ref lo = apply(op, a0, b0);
+	Ref hi = apply(op, a1, b1);
+	Ref res = make(v, lo, hi);
+
+	// entry reference is stable, cache is never resized
+	entry = { a, b, op, res };
+	return res;
+}
+
+std::vector<bool> Bdd::sat_one (Ref f, int var_count) const {
+	assert(f != ZERO);
+
+	std::vector<bool> assign(var_count, false);
+	while (f != ONE) {
+		auto& n = nodes[f];
+		// reduced bdds only have ZERO as a dead end, so any child other than ZERO leads to ONE
+		if (n.lo != ZERO) {
+			f = n.lo;
+		}
+		else {
+			assign[n.var] = true;
+			f = n.hi;
+		}
+	}
+	return assign;
+}
+
+////
+namespace {
+	struct EquivError {
+		std::string msg;
+	};
+}
+
+// pins of b matched to pins of a, by name if every name is unique on both sides and has a match in b, otherwise by order
+// (like compare_truth_tables, a duplicate name in a would map two pins to the same pin of b)
+static std::vector<int> match_pins (std::vector<std::unique_ptr<Part>> const& a, std::vector<std::unique_ptr<Part>> const& b) {
+	std::vector<int> map(a.size());
+	for (size_t i=0; i<a.size(); ++i) {
+		int found = -1, count = 0;
+		for (size_t j=0; j<b.size(); ++j) {
+			if (!a[i]->name.empty() && b[j]->name == a[i]->name) {
+				found = (int)j;
+				count++;
+			}
+		}
+		int count_a = 0;
+		for (size_t j=0; j<a.size(); ++j)
+			count_a += a[j]->name == a[i]->name;
+
+		if (count != 1 || count_a != 1) {
+			for (size_t j=0; j<a.size(); ++j)
+				map[j] = (int)j;
+			return map;
+		}
+		map[i] = found;
+	}
+	return map;
+}
+
+bool prepare_equivalence (LogicSim& sim, Chip& a, Chip& b, EquivalenceJob& job, std::string* error) {
+	ZoneScoped;
+
+	if (a.inputs.size() != b.inputs.size() || a.outputs.size() != b.outputs.size()) {
+		if (error) *error = prints("pin counts differ: %d/%d inputs, %d/%d outputs",
+			(int)a.inputs.size(), (int)b.inputs.size(), (int)a.outputs.size(), (int)b.outputs.size());
+		return false;
+	}
+
+	job = {};
+	job.chip_a = a.name;
+	job.chip_b = b.name;
+	job.netlist_a = std::make_shared<Netlist const>(flatten_saved_chip(sim, a));
+	job.netlist_b = std::make_shared<Netlist const>(flatten_saved_chip(sim, b));
+
+	auto in_map  = match_pins(a.inputs, b.inputs);
+	auto out_map = match_pins(a.outputs, b.outputs);
+
+	for (int i=0; i<(int)a.inputs.size(); ++i) {
+		job.input_names.push_back(a.inputs[i]->name.empty() ? prints("in%d", i) : a.inputs[i]->name);
+		job.inputs_a.push_back(a.inputs[i]->sid);
+		job.inputs_b.push_back(b.inputs[in_map[i]]->sid);
+	}
+	for (int i=0; i<(int)a.outputs.size(); ++i) {
+		job.output_names.push_back(a.outputs[i]->name.empty() ? prints("out%d", i) : a.outputs[i]->name);
+		job.outputs_a.push_back(a.outputs[i]->sid);
+		job.outputs_b.push_back(b.outputs[out_map[i]]->sid);
+	}
+	return true;
+}
+
+// bdd of every state of a combinational netlist, evaluated in topological order
+// states that are never written (unconnected gates) stay 0 like in the simulation
+static std::vector<Bdd::Ref> build_bdds (Bdd& bdd, Netlist const& nl, std::vector<int32_t> const& input_sids, std::string_view chip) {
+	ZoneScoped;
+
+	auto order = order_netlist(nl);
+	if (order.cyclic)
+		throw EquivError{ prints("\"%.*s\" is not combinational (contains a loop)", (int)chip.size(), chip.data()) };
+
+	std::vector<Bdd::Ref> f(nl.state_count, Bdd::ZERO);
+	for (int i=0; i<(int)input_sids.size(); ++i)
+		f[input_sids[i]] = bdd.var(i);
+
+	auto src = [&] (int32_t sid) { return sid >= 0 ? f[sid] : Bdd::ZERO; };
+
+	for (auto& e : order.order) {
+		auto& n = nl.nodes[e.type][e.node];
+		Bdd::Ref a = src(n.src[0]), b = src(n.src[1]), c = src(n.src[2]);
+
+		Bdd::Ref r;
+		switch (e.type) {
+			case BUF_GATE  : r = a; break;
+			case NOT_GATE  : r = bdd.not_(a); break;
+			case AND_GATE  : r = bdd.and_(a, b); break;
+			case NAND_GATE : r = bdd.not_(bdd.and_(a, b)); break;
+			case OR_GATE   : r = bdd.or_(a, b); break;
+			case NOR_GATE  : r = bdd.not_(bdd.or_(a, b)); break;
+			case XOR_GATE  : r = bdd.xor_(a, b); break;
+			case AND3_GATE : r = bdd.and_(bdd.and_(a, b), c); break;
+			case NAND3_GATE: r = bdd.not_(bdd.and_(bdd.and_(a, b), c)); break;
+			case OR3_GATE  : r = bdd.or_(bdd.or_(a, b), c); break;
+			case NOR3_GATE : r = bdd.not_(bdd.or_(bdd.or_(a, b), c)); break;
+			default: assert(false); r = Bdd::ZERO;
+		}
+		f[n.dst] = r;
+	}
+	return f;
+}
+
+EquivalenceResult check_equivalence (EquivalenceJob const& job) {
+	ZoneScoped;
+
+	EquivalenceResult res;
+
+	// both chips share one manager and the same input variables, so equal functions have equal refs
+	Bdd bdd;
+	try {
+		auto fa = build_bdds(bdd, *job.netlist_a, job.inputs_a, job.chip_a);
+		auto fb = build_bdds(bdd, *job.netlist_b, job.inputs_b, job.chip_b);
+
+		res.equivalent = true;
+		for (size_t o=0; o<job.output_names.size(); ++o) {
+			Bdd::Ref a = fa[job.outputs_a[o]];
+			Bdd::Ref b = fb[job.outputs_b[o]];
+			if (a == b)
+				continue;
+
+			auto assign = bdd.sat_one(bdd.xor_(a, b), (int)job.input_names.size());
+
+			res.equivalent = false;
+			res.output = job.output_names[o];
+			for (size_t i=0; i<assign.size(); ++i)
+				res.counterexample.push_back({ job.input_names[i], assign[i] });
+
+			// evaluate both outputs under the counterexample
+			auto eval = [&] (Bdd::Ref r) {
+				while (r != Bdd::ZERO && r != Bdd::ONE)
+					r = assign[bdd.nodes[r].var] ? bdd.nodes[r].hi : bdd.nodes[r].lo;
+				return r == Bdd::ONE;
+			};
+			res.value_a = eval(a);
+			res.value_b = eval(b);
+			break;
+		}
+	}
+	catch (EquivError& err) {
+		res.error = err.msg;
+	}
+	catch (Bdd::Overflow&) {
+		res.error = prints("bdd exceeded %llu nodes, chips are too large to compare", (unsigned long long)bdd.max_nodes);
+	}
+
+	res.bdd_nodes = bdd.nodes.size();
+	return res;
+}
+
+////
+void EquivalenceTool::run (LogicSim& sim) {
+	if (busy())
+		return;
+	has_result = false;
+	result = {};
+
+	Chip* a = sim.find_saved_chip(chip_a);
+	Chip* b = sim.find_saved_chip(chip_b);
+	if (!a || !b) {
+		result.error = prints("no saved chip named \"%s\"", (!a ? chip_a : chip_b).c_str());
+		has_result = true;
+		return;
+	}
+
+	EquivalenceJob job;
+	if (!prepare_equivalence(sim, *a, *b, job, &result.error)) {
+		has_result = true;
+		return;
+	}
+
+	started = std::chrono::steady_clock::now();
+	pending = std::async(std::launch::async, [job = std::move(job)] () {
+		return check_equivalence(job);
+	});
+}
+
+void EquivalenceTool::imgui (LogicSim& sim) {
+	if (pending.valid() && !busy()) {
+		result = pending.get();
+		has_result = true;
+		last_run_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - started).count();
+	}
+
+	if (ImGui::TreeNodeEx("Equivalence Check")) {
+		saved_chip_combo("chip A##equivalence", sim, chip_a);
+		saved_chip_combo("chip B##equivalence", sim, chip_b);
+
+		ImGui::BeginDisabled(busy());
+		if (ImGui::Button("Check"))
+			run(sim);
+		ImGui::EndDisabled();
+		ImGui::SameLine();
+		if (busy())
+			ImGui::Text("Running...");
+		else if (has_result && result.error.empty())
+			ImGui::Text("%llu bdd nodes in %.1f ms", (unsigned long long)result.bdd_nodes, last_run_ms);
+
+		if (has_result) {
+			if (!result.error.empty()) {
+				ImGui::TextColored(ImVec4(1.00f, 0.20f, 0.20f, 1), "%s", result.error.c_str());
+			}
+			else if (result.equivalent) {
+				ImGui::TextColored(ImVec4(0.20f, 1.00f, 0.20f, 1), "equivalent for all inputs");
+			}
+			else {
+				ImGui::TextColored(ImVec4(1.00f, 0.20f, 0.20f, 1), "not equivalent: %s is %d in A but %d in B for",
+					result.output.c_str(), result.value_a, result.value_b);
+
+				std::string inputs;
+				for (auto& [name, val] : result.counterexample)
+					inputs += prints("%s%s=%d", inputs.empty() ? "" : " ", name.c_str(), (int)val);
+				ImGui::TextUnformatted(inputs.c_str());
+			}
+		}
+
+		ImGui::TreePop();
+	}
+}
+
+}
@@ -0,0 +1,110 @@
+#pragma once
+#include "common.hpp"
+#include "logic_sim.hpp"
+#include <future>
+
+namespace logic_sim {
+
+// Reduced ordered binary decision diagrams
+// nodes are hash-consed in a unique table, so two functions are equal exactly when their refs are equal
+// results of and/or/xor are memoized in a direct mapped computed cache, where colliding entries simply overwrite each other
+// variable order is the variable index, terminals have var = INT_MAX so they sort after every variable
+struct Bdd {
+	using Ref = int32_t;
+	static constexpr Ref ZERO = 0;
+	static constexpr Ref ONE  = 1;
+
+	struct Node {
+		int32_t var;
+		Ref     lo, hi;
+	};
+	std::vector<Node> nodes;
+
+	// building more nodes than this throws Bdd::Overflow, functions like multipliers blow up exponentially
+	size_t max_nodes;
+
+	struct Overflow {};
+
+	Bdd (size_t max_nodes = 1 << 24);
+
+	Ref var (int v);
+
+	Ref not_ (Ref a) { return xor_(a, ONE); }
+	Ref and_ (Ref a, Ref b) { return apply(AND, a, b); }
+	Ref or_  (Ref a, Ref b) { return apply(OR,  a, b); }
+	Ref xor_ (Ref a, Ref b) { return apply(XOR, a, b); }
+
+	// one input assignment for which f is 1 (f != ZERO), variables not on the path are 0
+	std::vector<bool> sat_one (Ref f, int var_count) const;
+
+private:
+	enum Op : int32_t { AND, OR, XOR };
+
+	std::vector<Ref> unique; // open addressing, -1 is empty
+	size_t unique_count = 0;
+
+	struct CacheEntry {
+		Ref a = -1, b = -1;
+		int32_t op = -1;
+		Ref res;
+	};
+	std::vector<CacheEntry> cache;
+
+	Ref make (int32_t var, Ref lo, Ref hi);
+	Ref apply (Op op, Ref a, Ref b);
+	void grow_unique ();
+};
+
+// Proves that two combinational chips compute the same function for every input, or finds an input where they differ
+// outputs of both chips are built as BDDs over shared input variables, pins are matched by name if every name matches, otherwise by order
+struct EquivalenceResult {
+	bool        equivalent = false;
+	std::string error; // chips could not be compared
+
+	// first differing output and an input vector showing the difference
+	std::string output;
+	std::vector<std::pair<std::string, bool>> counterexample;
+	bool value_a = false, value_b = false;
+
+	size_t bdd_nodes = 0;
+};
+
+struct EquivalenceJob {
+	std::string chip_a, chip_b;
+	std::shared_ptr<Netlist const> netlist_a, netlist_b;
+
+	std::vector<std::string> input_names;
+	std::vector<int32_t>     inputs_a, inputs_b; // sids of matched input pins
+	std::vector<std::string> output_names;
+	std::vector<int32_t>     outputs_a, outputs_b;
+};
+
+// call on main thread, returns false if the pins of the chips do not match
+bool prepare_equivalence (LogicSim& sim, Chip& a, Chip& b, EquivalenceJob& job, std::string* error);
+EquivalenceResult check_equivalence (EquivalenceJob const& job);
+
+// "Equivalence Check" ui, runs in the background
+struct EquivalenceTool {
+	std::string chip_a, chip_b;
+
+	EquivalenceResult result;
+	bool has_result = false;
+	float last_run_ms = 0;
+
+	bool busy () const {
+		return pending.valid() && pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready;
+	}
+
+	void run (LogicSim& sim);
+	void imgui (LogicSim& sim);
+
+	~EquivalenceTool () {
+		if (pending.valid())
+			pending.wait();
+	}
+private:
+	std::future<EquivalenceResult> pending;
+	std::chrono::steady_clock::time_point started;
+};
+
+}
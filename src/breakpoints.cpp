@@ -0,0 +1,397 @@
+#include "common.hpp"
+#include "breakpoints.hpp"
+#include <functional>
+
+namespace logic_sim {
+
+static constexpr int MAX_STACK = 64;
+
+uint64_t WatchExpr::eval (uint64_t const* cur, uint64_t const* prev) const {
+	uint64_t stack[MAX_STACK];
+	int top = 0;
+
+	for (auto& in : code) {
+		switch (in.op) {
+			case CONST:   stack[top++] = in.val; break;
+			case VALUE:   stack[top++] = cur[in.slot]; break;
+			case RISE:    stack[top++] = !prev[in.slot] && cur[in.slot]; break;
+			case FALL:    stack[top++] = prev[in.slot] && !cur[in.slot]; break;
+			case CHANGED: stack[top++] = prev[in.slot] != cur[in.slot]; break;
+			case NOT:     stack[top-1] = !stack[top-1]; break;
+			default: {
+				uint64_t r = stack[--top];
+				uint64_t& l = stack[top-1];
+				switch (in.op) {
+					case AND: l = l && r; break;
+					case OR:  l = l || r; break;
+					case EQ:  l = l == r; break;
+					case NE:  l = l != r; break;
+					case LT:  l = l <  r; break;
+					case LE:  l = l <= r; break;
+					case GT:  l = l >  r; break;
+					case GE:  l = l >= r; break;
+					default: assert(false);
+				}
+			}
+		}
+	}
+	assert(top == 1);
+	return stack[0];
+}
+
+////
+namespace {
+	struct ExprError {
+		std::string msg;
+	};
+
+	// recursive descent, emitting postfix code
+	struct ExprParser {
+		std::string_view src;
+		size_t pos = 0;
+		// name -> slot, throws ExprError if the name does not exist
+		std::function<int32_t(std::string const&)> resolve;
+
+		WatchExpr prog;
+		int depth = 0, max_depth = 0;
+
+		void emit (WatchExpr::Op op, int32_t slot=0, uint64_t val=0) {
+			prog.code.push_back({ op, slot, val });
+
+			if (op <= WatchExpr::CHANGED) depth++;
+			else if (op != WatchExpr::NOT) depth--;
+			max_depth = max(max_depth, depth);
+		}
+
+		void skip_space () {
+			while (pos < src.size() && isspace((unsigned char)src[pos]))
+				pos++;
+		}
+		bool accept (std::string_view tok) {
+			skip_space();
+			if (src.substr(pos, tok.size()) != tok)
+				return false;
+			pos += tok.size();
+			return true;
+		}
+		void expect (std::string_view tok) {
+			if (!accept(tok))
+				throw ExprError{ prints("expected '%.*s' at %d", (int)tok.size(), tok.data(), (int)pos) };
+		}
+
+		static bool is_name_char (char c) {
+			return isalnum((unsigned char)c) || c == '_' || c == '.' || c == '/' || c == '[' || c == ']';
+		}
+		std::string name () {
+			skip_space();
+			if (pos < src.size() && src[pos] == '"') {
+				size_t end = src.find('"', pos+1);
+				if (end == std::string_view::npos)
+					throw ExprError{ "unterminated \"" };
+				std::string n(src.substr(pos+1, end - (pos+1)));
+				pos = end+1;
+				return n;
+			}
+
+			size_t start = pos;
+			while (pos < src.size() && is_name_char(src[pos]))
+				pos++;
+			if (pos == start)
+				throw ExprError{ prints("expected name at %d", (int)pos) };
+			return std::string(src.substr(start, pos - start));
+		}
+
+		uint64_t number () {
+			int base = 10;
+			if      (accept("0x") || accept("0X")) base = 16;
+			else if (accept("0b") || accept("0B")) base = 2;
+
+			size_t start = pos;
+			uint64_t val = 0;
+			for (; pos < src.size(); ++pos) {
+				char c = (char)tolower((unsigned char)src[pos]);
+				int digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : 99;
+				if (digit >= base)
+					break;
+				val = val * base + digit;
+			}
+			if (pos == start)
+				throw ExprError{ prints("expected number at %d", (int)pos) };
+			return val;
+		}
+
+		void primary () {
+			skip_space();
+			if (pos >= src.size())
+				throw ExprError{ "unexpected end of expression" };
+
+			if (accept("(")) {
+				expr();
+				expect(")");
+				return;
+			}
+			if (isdigit((unsigned char)src[pos])) {
+				emit(WatchExpr::CONST, 0, number());
+				return;
+			}
+
+			static constexpr struct { std::string_view name; WatchExpr::Op op; } edges[] = {
+				{ "rise(",    WatchExpr::RISE    },
+				{ "fall(",    WatchExpr::FALL    },
+				{ "changed(", WatchExpr::CHANGED },
+			};
+			for (auto& e : edges) {
+				if (accept(e.name)) {
+					emit(e.op, resolve(name()));
+					expect(")");
+					return;
+				}
+			}
+
+			emit(WatchExpr::VALUE, resolve(name()));
+		}
+		void unary () {
+			if (accept("!")) {
+				unary();
+				emit(WatchExpr::NOT);
+				return;
+			}
+			primary();
+		}
+		void compare () {
+			unary();
+
+			static constexpr struct { std::string_view tok; WatchExpr::Op op; } ops[] = {
+				{ "==", WatchExpr::EQ }, { "!=", WatchExpr::NE },
+				{ "<=", WatchExpr::LE }, { ">=", WatchExpr::GE },
+				{ "<",  WatchExpr::LT }, { ">",  WatchExpr::GT },
+			};
+			for (auto& o : ops) {
+				if (accept(o.tok)) {
+					unary();
+					emit(o.op);
+					return;
+				}
+			}
+		}
+		void and_ () {
+			compare();
+			while (accept("&&")) {
+				compare();
+				emit(WatchExpr::AND);
+			}
+		}
+		void expr () {
+			and_();
+			while (accept("||")) {
+				and_();
+				emit(WatchExpr::OR);
+			}
+		}
+
+		void parse () {
+			expr();
+			skip_space();
+			if (pos != src.size())
+				throw ExprError{ prints("unexpected '%c' at %d", src[pos], (int)pos) };
+			if (max_depth > MAX_STACK)
+				throw ExprError{ "expression too complex" };
+		}
+	};
+}
+
+void Breakpoints::read_slots (LogicSim const& sim, int buf, std::vector<uint64_t>& values) const {
+	uint8_t const* state = sim.state[buf].data();
+
+	values.resize(slots.size());
+	for (size_t i=0; i<slots.size(); ++i) {
+		auto& sids = slots[i].sids;
+
+		uint64_t v = 0;
+		for (size_t bit=0; bit<sids.size(); ++bit)
+			v |= (uint64_t)(state[sids[bit]] != 0) << bit;
+		values[i] = v;
+	}
+}
+
+void Breakpoints::compile (LogicSim& sim) {
+	ZoneScoped;
+
+	chip = sim.viewed_chip.get();
+	hash = structural_hash(*chip);
+	compiled = true;
+
+	slots.clear();
+
+	// share slots between expressions that read the same signal
+	std::unordered_map<std::string, int32_t> name2slot;
+
+	auto resolve = [&] (std::string const& name) -> int32_t {
+		auto it = name2slot.find(name);
+		if (it != name2slot.end())
+			return it->second;
+
+		Slot slot;
+		int32_t sid = sim.signals.find(sim, name);
+		if (sid >= 0) {
+			slot.sids.push_back(sid);
+		}
+		else {
+			// bus of name[i] or namei
+			for (int i=0; ; ++i) {
+				int32_t bit = sim.signals.find(sim, prints("%s[%d]", name.c_str(), i));
+				if (bit < 0)
+					bit = sim.signals.find(sim, prints("%s%d", name.c_str(), i));
+				if (bit < 0)
+					break;
+				slot.sids.push_back(bit);
+			}
+			if (slot.sids.empty())
+				throw ExprError{ prints("unknown signal \"%s\"", name.c_str()) };
+			if (slot.sids.size() > 64)
+				throw ExprError{ prints("bus \"%s\" wider than 64 bits", name.c_str()) };
+		}
+
+		int32_t idx = (int32_t)slots.size();
+		slots.push_back(std::move(slot));
+		name2slot.emplace(name, idx);
+		return idx;
+	};
+
+	for (auto& e : entries) {
+		e.prog = {};
+		e.valid = false;
+		e.error.clear();
+
+		ExprParser p;
+		p.src = e.expr;
+		p.resolve = resolve;
+		try {
+			p.parse();
+			e.prog = std::move(p.prog);
+			e.valid = true;
+		}
+		catch (ExprError& err) {
+			e.error = std::move(err.msg);
+		}
+	}
+
+	// the other buffer holds the previous tick, so edges of the tick that triggered the compile are not missed
+	read_slots(sim, sim.cur_state, cur);
+	read_slots(sim, sim.cur_state^1, prev);
+
+	for (auto& e : entries) {
+		if (e.is_watch && e.valid)
+			e.value = e.prog.eval(cur.data(), prev.data());
+	}
+}
+
+bool Breakpoints::check (LogicSim& sim, int tick_counter) {
+	if (entries.empty())
+		return false;
+	ZoneScoped;
+
+	if (!compiled || sim.viewed_chip.get() != chip || structural_hash(*sim.viewed_chip) != hash) {
+		compile(sim); // reads both ticks
+	}
+	else {
+		std::swap(cur, prev);
+		read_slots(sim, sim.cur_state, cur);
+	}
+
+	bool pause = false;
+	for (int i=0; i<(int)entries.size(); ++i) {
+		auto& e = entries[i];
+		if (!e.valid || !e.enabled)
+			continue;
+
+		uint64_t val = e.prog.eval(cur.data(), prev.data());
+		if (e.is_watch) {
+			e.value = val;
+		}
+		else if (val && ++e.hits >= e.hits_needed) {
+			e.hits = 0;
+			if (!pause) {
+				hit_idx = i;
+				hit_tick = tick_counter;
+			}
+			pause = true;
+		}
+	}
+	return pause;
+}
+
+////
+void Breakpoints::imgui (LogicSim& sim) {
+	if (ImGui::TreeNodeEx("Breakpoints")) {
+		// compile right away to show errors while paused
+		if (!compiled && !entries.empty() && sim.viewed_chip->state_count >= 0)
+			compile(sim);
+
+		ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x * 0.6f);
+		ImGui::InputText("##new_expr", &new_expr);
+		ImGui::SameLine();
+		ImGui::BeginDisabled(new_expr.empty());
+		bool add_break = ImGui::Button("Break");
+		ImGui::SameLine();
+		bool add_watch = ImGui::Button("Watch");
+		ImGui::EndDisabled();
+		if (add_break || add_watch) {
+			Entry e;
+			e.expr = std::move(new_expr);
+			e.is_watch = add_watch;
+			entries.push_back(std::move(e));
+			new_expr.clear();
+			compiled = false;
+		}
+
+		if (hit_idx >= 0 && hit_idx < (int)entries.size())
+			ImGui::TextColored(ImVec4(1.00f, 0.80f, 0.20f, 1), "Hit \"%s\" at tick %d", entries[hit_idx].expr.c_str(), hit_tick);
+
+		int remove = -1;
+		if (!entries.empty() && ImGui::BeginTable("Breakpoints", 4, ImGuiTableFlags_Borders)) {
+			for (int i=0; i<(int)entries.size(); ++i) {
+				auto& e = entries[i];
+				ImGui::PushID(i);
+
+				ImGui::TableNextColumn();
+				ImGui::Checkbox("##enabled", &e.enabled);
+
+				ImGui::TableNextColumn();
+				ImGui::SetNextItemWidth(-1);
+				if (ImGui::InputText("##expr", &e.expr))
+					compiled = false;
+				if (!e.error.empty())
+					ImGui::TextColored(ImVec4(1.00f, 0.20f, 0.20f, 1), "%s", e.error.c_str());
+
+				ImGui::TableNextColumn();
+				if (e.is_watch) {
+					ImGui::Text("= %llu (0x%llx)", (unsigned long long)e.value, (unsigned long long)e.value);
+				}
+				else {
+					ImGui::SetNextItemWidth(120);
+					ImGui::DragInt("##hits_needed", &e.hits_needed, 1, 1, INT_MAX, "after %d");
+					e.hits_needed = max(e.hits_needed, 1);
+					ImGui::SameLine();
+					ImGui::Text("%d", e.hits);
+				}
+
+				ImGui::TableNextColumn();
+				if (ImGui::Button("X"))
+					remove = i;
+
+				ImGui::PopID();
+			}
+			ImGui::EndTable();
+		}
+		if (remove >= 0) {
+			entries.erase(entries.begin() + remove);
+			hit_idx = -1;
+			compiled = false;
+		}
+
+		ImGui::TreePop();
+	}
+}
+
+}
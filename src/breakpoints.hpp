@@ -0,0 +1,76 @@
+#pragma once
+#include "common.hpp"
+#include "logic_sim.hpp"
+
+namespace logic_sim {
+
+// Expression over named signals of the viewed chip, compiled to a small stack program over value slots
+// names are paths of the viewed chip (see SignalIndex), like pin names or cpu.alu.cout, "quoted" if they contain spaces
+// a name that does not exist by itself is read as a bus of name[0], name[1] ... (or name0, name1 ...) with bit 0 as lsb
+//  expr:  a || b   a && b   !a   a == b   a != b   a < b   a <= b   a > b   a >= b   (expr)
+//  value: name   rise(name)   fall(name)   changed(name)   123   0x1F   0b101
+// rise/fall/changed compare against the value on the previous tick
+struct WatchExpr {
+	enum Op : uint8_t {
+		CONST, VALUE, RISE, FALL, CHANGED,
+		NOT, AND, OR, EQ, NE, LT, LE, GT, GE,
+	};
+	struct Instr {
+		Op       op;
+		int32_t  slot; // for VALUE, RISE, FALL, CHANGED
+		uint64_t val;  // for CONST
+	};
+	std::vector<Instr> code;
+
+	uint64_t eval (uint64_t const* cur, uint64_t const* prev) const;
+};
+
+// Breakpoints that pause the sim and watch expressions that show a value, both evaluated after every sim tick
+// all signals used by any expression are gathered into a shared list of slots (each slot a list of state indices),
+// so a check only reads the watched states instead of the whole state
+// expressions are recompiled when the viewed chip or its structure changes, since that invalidates the state indices
+struct Breakpoints {
+	struct Entry {
+		std::string expr;
+		bool enabled = true;
+		bool is_watch = false;
+
+		int hits_needed = 1; // pause after the condition was true this many times, eg. 1000 for the 1000th rising edge
+		int hits = 0;
+
+		uint64_t value = 0; // last value for watches
+
+		WatchExpr   prog;
+		bool        valid = false;
+		std::string error;
+	};
+	std::vector<Entry> entries;
+
+	std::string new_expr;
+
+	// last breakpoint that paused the sim
+	int hit_idx = -1;
+	int hit_tick = 0;
+
+	// call after every sim tick, returns true if a breakpoint hit and the sim should pause
+	bool check (LogicSim& sim, int tick_counter);
+
+	void imgui (LogicSim& sim);
+
+private:
+	struct Slot {
+		std::vector<int32_t> sids; // lsb first
+	};
+	std::vector<Slot>     slots;
+	std::vector<uint64_t> cur;
+	std::vector<uint64_t> prev;
+
+	bool     compiled = false;
+	Chip*    chip = nullptr;
+	uint64_t hash = 0;
+
+	void compile (LogicSim& sim);
+	void read_slots (LogicSim const& sim, int buf, std::vector<uint64_t>& values) const; // from sim.state[buf]
+};
+
+}
@@ -0,0 +1,219 @@
+#include "common.hpp"
+#include "checkpoint.hpp"
+#include "autosave.hpp"
+
+namespace logic_sim {
+
+////
+static void pack (std::vector<uint64_t>& bits, uint8_t const* state, int count) {
+	bits.assign(((size_t)count + 63) / 64, 0);
+	for (int sid=0; sid<count; ++sid)
+		bits[sid >> 6] |= (uint64_t)(state[sid] != 0) << (sid & 63);
+}
+static void unpack (std::vector<uint64_t> const& bits, uint8_t* state, int count) {
+	for (int sid=0; sid<count; ++sid)
+		state[sid] = (uint8_t)((bits[sid >> 6] >> (sid & 63)) & 1);
+}
+
+SimCheckpoint take_checkpoint (LogicSim& sim, int64_t tick_counter) {
+	ZoneScoped;
+
+	SimCheckpoint cp;
+	cp.hash         = structural_hash(*sim.viewed_chip);
+	cp.state_count  = (int32_t)sim.state[0].size();
+	cp.cur_state    = sim.cur_state;
+	cp.tick_counter = tick_counter;
+	cp.ternary      = sim.ternary && sim.xstate[0].size() == sim.state[0].size();
+
+	for (int i=0; i<2; ++i) {
+		pack(cp.bits[i], sim.state[i].data(), cp.state_count);
+		if (cp.ternary)
+			pack(cp.xbits[i], sim.xstate[i].data(), cp.state_count);
+	}
+	return cp;
+}
+
+bool restore_checkpoint (LogicSim& sim, SimCheckpoint const& cp, int64_t* tick_counter) {
+	ZoneScoped;
+
+	if (cp.hash != structural_hash(*sim.viewed_chip) || cp.state_count != (int32_t)sim.state[0].size())
+		return false;
+
+	for (int i=0; i<2; ++i) {
+		unpack(cp.bits[i], sim.state[i].data(), cp.state_count);
+
+		// a checkpoint taken without ternary mode only has known values
+		if (sim.ternary) {
+			sim.xstate[i].assign(cp.state_count, 0);
+			if (cp.ternary)
+				unpack(cp.xbits[i], sim.xstate[i].data(), cp.state_count);
+		}
+	}
+	sim.cur_state = cp.cur_state;
+	sim.state_generation++;
+	sim.state_changed = true;
+
+	if (tick_counter)
+		*tick_counter = cp.tick_counter;
+	return true;
+}
+
+////
+// file: CheckpointHeader, then uint64[(state_count+63)/64] for state[0] and state[1], then the same for the x planes if ternary
+// integers are stored in host byte order
+namespace {
+	inline constexpr char     CHECKPOINT_MAGIC[8] = { 'L','S','I','M','S','T','T','\0' };
+	inline constexpr uint32_t CHECKPOINT_VERSION  = 2; // 1 had no x planes
+
+	struct CheckpointHeader {
+		char     magic[8];
+		uint32_t version;
+		int32_t  state_count;
+		uint64_t hash;
+		int64_t  tick_counter;
+		int32_t  cur_state;
+		int32_t  ternary; // 0 in version 1
+	};
+}
+
+bool save_checkpoint (std::string const& filepath, SimCheckpoint const& cp) {
+	ZoneScoped;
+
+	CheckpointHeader hdr = {};
+	memcpy(hdr.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+	hdr.version      = CHECKPOINT_VERSION;
+	hdr.state_count  = cp.state_count;
+	hdr.hash         = cp.hash;
+	hdr.tick_counter = cp.tick_counter;
+	hdr.cur_state    = cp.cur_state;
+	hdr.ternary      = cp.ternary;
+
+	std::string data;
+	data.reserve(sizeof(hdr) + (cp.ternary ? 4 : 2) * cp.bits[0].size() * sizeof(uint64_t));
+
+	data.append((char const*)&hdr, sizeof(hdr));
+	for (auto& bits : cp.bits)
+		data.append((char const*)bits.data(), bits.size() * sizeof(uint64_t));
+	if (cp.ternary) {
+		for (auto& bits : cp.xbits)
+			data.append((char const*)bits.data(), bits.size() * sizeof(uint64_t));
+	}
+
+	// atomic so an interrupted save never destroys the previous checkpoint
+	return write_file_atomic(filepath, data);
+}
+
+bool load_checkpoint (std::string const& filepath, SimCheckpoint& cp) {
+	ZoneScoped;
+
+	FILE* f = fopen(filepath.c_str(), "rb");
+	if (!f)
+		return false;
+
+	SimCheckpoint c;
+
+	CheckpointHeader hdr;
+	bool ok = fread(&hdr, sizeof(hdr), 1, f) == 1 &&
+		memcmp(hdr.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) == 0 &&
+		(hdr.version == 1 || hdr.version == CHECKPOINT_VERSION) && hdr.state_count >= 0 && (hdr.cur_state == 0 || hdr.cur_state == 1);
+
+	if (ok) {
+		c.hash         = hdr.hash;
+		c.state_count  = hdr.state_count;
+		c.cur_state    = hdr.cur_state;
+		c.tick_counter = hdr.tick_counter;
+		c.ternary      = hdr.version >= 2 && hdr.ternary != 0;
+
+		auto read_bits = [&] (std::vector<uint64_t>& bits) {
+			bits.resize(((size_t)c.state_count + 63) / 64);
+			return fread(bits.data(), sizeof(uint64_t), bits.size(), f) == bits.size();
+		};
+		for (int i=0; ok && i<2; ++i)
+			ok = read_bits(c.bits[i]);
+		for (int i=0; ok && c.ternary && i<2; ++i)
+			ok = read_bits(c.xbits[i]);
+	}
+	fclose(f);
+
+	if (!ok) {
+		fprintf(stderr, "Checkpoint \"%s\" invalid\n", filepath.c_str());
+		return false;
+	}
+
+	cp = std::move(c);
+	return true;
+}
+
+////
+void Checkpoints::poll () {
+	if (pending.valid() && !busy()) {
+		bool ok = pending.get();
+		status = ok ? "Saved" : "Save failed!";
+		status_error = !ok;
+	}
+}
+
+void Checkpoints::save (LogicSim& sim, int64_t tick_counter) {
+	poll();
+	if (pending.valid())
+		return; // previous save still running
+
+	// packing is cheap, file io can take a while for big chips
+	pending = std::async(std::launch::async, [cp = take_checkpoint(sim, tick_counter), path = filepath] () {
+		return save_checkpoint(path, cp);
+	});
+	status = "Saving...";
+	status_error = false;
+}
+
+bool Checkpoints::restore (LogicSim& sim, int64_t* tick_counter) {
+	if (pending.valid())
+		pending.wait(); // might be saving to the same file
+
+	SimCheckpoint cp;
+	if (!load_checkpoint(filepath, cp)) {
+		status = "Could not load checkpoint!";
+		status_error = true;
+		return false;
+	}
+	if (!restore_checkpoint(sim, cp, tick_counter)) {
+		status = "Checkpoint belongs to a different chip layout!";
+		status_error = true;
+		return false;
+	}
+
+	status = prints("Restored at tick %lld", (long long)cp.tick_counter);
+	status_error = false;
+	return true;
+}
+
+bool Checkpoints::imgui (LogicSim& sim, int& tick_counter) {
+	poll();
+
+	bool restored = false;
+	if (ImGui::TreeNodeEx("State Checkpoint")) {
+		ImGui::InputText("file##checkpoint", &filepath);
+
+		ImGui::BeginDisabled(busy());
+		if (ImGui::Button("Save State"))
+			save(sim, tick_counter);
+		ImGui::EndDisabled();
+		ImGui::SameLine();
+		if (ImGui::Button("Restore State")) {
+			int64_t ticks;
+			restored = restore(sim, &ticks);
+			if (restored)
+				tick_counter = (int)ticks;
+		}
+
+		if (!status.empty()) {
+			if (status_error) ImGui::TextColored(ImVec4(1.00f, 0.20f, 0.20f, 1), "%s", status.c_str());
+			else              ImGui::Text("%s", status.c_str());
+		}
+
+		ImGui::TreePop();
+	}
+	return restored;
+}
+
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include "common.hpp"
+#include "logic_sim.hpp"
+#include <future>
+
+namespace logic_sim {
+
+// Simulation state of the viewed chip, so long running sims can be resumed and failure states shared
+// both state buffers are stored bit-packed (the previous state is needed to animate the wires after a restore),
+// in ternary mode their X planes as well
+// state indices are only meaningful for the exact chip structure, so the structural hash of the viewed chip is stored
+// and a checkpoint is only restored onto a chip with the same hash
+struct SimCheckpoint {
+	uint64_t hash = 0;
+	int32_t  state_count = 0;
+	int32_t  cur_state = 0;
+	int64_t  tick_counter = 0;
+	bool     ternary = false;
+
+	std::vector<uint64_t> bits[2];
+	std::vector<uint64_t> xbits[2]; // only if ternary
+};
+
+// call on main thread, result can be saved on any thread
+SimCheckpoint take_checkpoint (LogicSim& sim, int64_t tick_counter);
+// false if the checkpoint does not match the viewed chip
+bool restore_checkpoint (LogicSim& sim, SimCheckpoint const& cp, int64_t* tick_counter);
+
+bool save_checkpoint (std::string const& filepath, SimCheckpoint const& cp);
+bool load_checkpoint (std::string const& filepath, SimCheckpoint& cp);
+
+// save/restore buttons, where saving writes the file on a background thread
+struct Checkpoints {
+	std::string filepath = "state.lsimstate";
+
+	std::future<bool> pending;
+	std::string status;
+	bool status_error = false;
+
+	bool busy () const {
+		return pending.valid() && pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready;
+	}
+
+	void save (LogicSim& sim, int64_t tick_counter);
+	bool restore (LogicSim& sim, int64_t* tick_counter);
+
+	// returns true if state was restored
+	bool imgui (LogicSim& sim, int& tick_counter);
+
+	~Checkpoints () {
+		if (pending.valid())
+			pending.wait();
+	}
+private:
+	void poll ();
+};
+
+}
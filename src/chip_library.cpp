@@ -0,0 +1,673 @@
+#include "common.hpp"
+#include "chip_library.hpp"
+#include "parallel.hpp"
+#include "autosave.hpp"
+#include <random>
+#include <fstream>
+
+#ifdef _WIN32
+	#ifndef WIN32_LEAN_AND_MEAN
+	#define WIN32_LEAN_AND_MEAN
+	#endif
+	#ifndef NOMINMAX
+	#define NOMINMAX
+	#endif
+	#include <windows.h>
+#else
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+namespace logic_sim {
+using namespace binlib;
+
+////
+// Read-only memory mapping of a whole file
+struct MappedFile {
+	uint8_t const* data = nullptr;
+	size_t         size = 0;
+
+#ifdef _WIN32
+	HANDLE file    = INVALID_HANDLE_VALUE;
+	HANDLE mapping = NULL;
+
+	bool open (const char* filepath) {
+		file = CreateFileA(filepath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER sz;
+		if (!GetFileSizeEx(file, &sz) || sz.QuadPart == 0)
+			return false;
+		size = (size_t)sz.QuadPart;
+
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (!mapping)
+			return false;
+
+		data = (uint8_t const*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		return data != nullptr;
+	}
+	~MappedFile () {
+		if (data)                         UnmapViewOfFile(data);
+		if (mapping)                      CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+	}
+#else
+	int fd = -1;
+
+	bool open (const char* filepath) {
+		fd = ::open(filepath, O_RDONLY);
+		if (fd < 0)
+			return false;
+
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size == 0)
+			return false;
+		size = (size_t)st.st_size;
+
+		void* ptr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (ptr == MAP_FAILED)
+			return false;
+
+		data = (uint8_t const*)ptr;
+		return true;
+	}
+	~MappedFile () {
+		if (data)   munmap((void*)data, size);
+		if (fd >= 0) ::close(fd);
+	}
+#endif
+};
+
+////
+bool save_library_binary (LogicSim const& sim, const char* filepath) {
+	ZoneScoped;
+
+	std::vector<LibChip>  chips;
+	std::vector<LibPart>  parts;
+	std::vector<LibInput> inputs;
+	std::vector<float>    points;
+	std::string           strings;
+
+	std::unordered_map<Chip*, int> chip2idx;
+	chip2idx.reserve(sim.saved_chips.size());
+	for (int i=0; i<(int)sim.saved_chips.size(); ++i)
+		chip2idx[sim.saved_chips[i].get()] = i;
+
+	auto add_string = [&] (std::string const& str) {
+		Range r = { (uint32_t)strings.size(), (uint32_t)str.size() };
+		strings += str;
+		return r;
+	};
+
+	std::unordered_map<Part*, int> part2idx;
+
+	for (auto& chip : sim.saved_chips) {
+		auto& c = chips.emplace_back();
+		c.uid          = chip->uid;
+		c.name         = add_string(chip->name);
+		c.col[0]       = chip->col.x;
+		c.col[1]       = chip->col.y;
+		c.col[2]       = chip->col.z;
+		c.size[0]      = chip->size.x;
+		c.size[1]      = chip->size.y;
+		c.output_count = (uint32_t)chip->outputs.size();
+		c.input_count  = (uint32_t)chip->inputs.size();
+		c.parts.first  = (uint32_t)parts.size();
+		c._pad         = 0;
+
+		part2idx.clear();
+		int idx = 0;
+		for (auto& part : chip->outputs) part2idx[part.get()] = idx++;
+		for (auto& part : chip->inputs ) part2idx[part.get()] = idx++;
+		for (auto& part : chip->parts  ) part2idx[part.get()] = idx++;
+
+		auto add_part = [&] (Part& part) {
+			auto& p = parts.emplace_back();
+			p.chip         = is_gate(part.chip) ? gate_type(part.chip) : chip2idx.at(part.chip) + GATE_COUNT;
+			p.name         = add_string(part.name);
+			p.pos[0]       = part.pos.pos.x;
+			p.pos[1]       = part.pos.pos.y;
+			p.scale        = part.pos.scale;
+			p.rot          = part.pos.rot;
+			p.mirror       = part.pos.mirror;
+			p._pad         = 0;
+			p.inputs.first = (uint32_t)inputs.size();
+			p.inputs.count = (uint32_t)part.chip->inputs.size();
+
+			for (int i=0; i<(int)part.chip->inputs.size(); ++i) {
+				auto& wire = part.inputs[i];
+				auto& inp = inputs.emplace_back();
+				inp.part_idx      = wire.part ? part2idx.at(wire.part) : -1;
+				inp.pin           = wire.part ? wire.pin : 0;
+				inp.points.first  = (uint32_t)(points.size() / 2);
+				inp.points.count  = wire.part ? (uint32_t)wire.wire_points.size() : 0;
+
+				if (wire.part) {
+					for (auto& pt : wire.wire_points) {
+						points.push_back(pt.x);
+						points.push_back(pt.y);
+					}
+				}
+			}
+		};
+
+		for (auto& part : chip->outputs) add_part(*part);
+		for (auto& part : chip->inputs ) add_part(*part);
+		for (auto& part : chip->parts  ) add_part(*part);
+
+		c.parts.count = (uint32_t)parts.size() - c.parts.first;
+	}
+
+	// lay out sections after header
+	LibHeader header = {};
+	memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version     = VERSION;
+	header.viewed_chip = indexof_chip(sim.saved_chips, sim.viewed_chip.get());
+
+	uint64_t offset = sizeof(LibHeader);
+	auto section = [&] (Section& s, uint64_t count, size_t elem_size) {
+		s.offset = offset;
+		s.count  = count;
+		offset = (offset + count * elem_size + 7) & ~(uint64_t)7;
+	};
+	section(header.chips,   chips  .size(),    sizeof(LibChip));
+	section(header.parts,   parts  .size(),    sizeof(LibPart));
+	section(header.inputs,  inputs .size(),    sizeof(LibInput));
+	section(header.points,  points .size(),    sizeof(float));
+	section(header.strings, strings.size(),    sizeof(char));
+
+	std::vector<uint8_t> file(offset, 0);
+	auto write = [&] (Section const& s, void const* data, size_t elem_size) {
+		if (s.count > 0)
+			memcpy(file.data() + s.offset, data, s.count * elem_size);
+	};
+	memcpy(file.data(), &header, sizeof(header));
+	write(header.chips,   chips  .data(), sizeof(LibChip));
+	write(header.parts,   parts  .data(), sizeof(LibPart));
+	write(header.inputs,  inputs .data(), sizeof(LibInput));
+	write(header.points,  points .data(), sizeof(float));
+	write(header.strings, strings.data(), sizeof(char));
+
+	return write_file_atomic(filepath, std::string_view((char const*)file.data(), file.size()));
+}
+
+////
+// a chip using itself as a part (directly or inside a subchip) would recurse infinitely, the editor prevents placing those
+static bool has_recursive_chips (std::vector<std::shared_ptr<Chip>> const& chips) {
+	enum : uint8_t { UNVISITED=0, ON_STACK, DONE };
+	std::unordered_map<Chip*, uint8_t> visit;
+
+	// iterative dfs over custom parts, reaching a chip that is still on the stack closes a cycle
+	std::vector<std::pair<Chip*, int>> stack;
+	for (auto& root : chips) {
+		if (visit[root.get()] != UNVISITED)
+			continue;
+		visit[root.get()] = ON_STACK;
+		stack.push_back({ root.get(), 0 });
+
+		while (!stack.empty()) {
+			auto& [chip, i] = stack.back();
+			if (i == (int)chip->parts.size()) {
+				visit[chip] = DONE;
+				stack.pop_back();
+				continue;
+			}
+
+			Chip* dep = chip->parts[i++]->chip;
+			if (is_gate(dep))
+				continue;
+
+			auto& v = visit[dep];
+			if (v == ON_STACK)
+				return true;
+			if (v == UNVISITED) {
+				v = ON_STACK;
+				stack.push_back({ dep, 0 });
+			}
+		}
+	}
+	return false;
+}
+
+////
+bool load_library_binary (const char* filepath, LogicSim& sim) {
+	ZoneScoped;
+
+	MappedFile file;
+	if (!file.open(filepath)) {
+		fprintf(stderr, "load_library_binary: could not open \"%s\"\n", filepath);
+		return false;
+	}
+
+	auto fail = [&] (const char* reason) {
+		fprintf(stderr, "load_library_binary: \"%s\" is invalid (%s)\n", filepath, reason);
+		return false;
+	};
+
+	if (file.size < sizeof(LibHeader))
+		return fail("too small");
+
+	LibHeader header;
+	memcpy(&header, file.data, sizeof(header));
+	if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0)
+		return fail("not a chip library");
+	if (header.version != VERSION)
+		return fail("unsupported version");
+
+	// get typed pointer to section after checking that it lies inside the file
+	auto get_section = [&] <typename T> (Section const& s, T const*& out) {
+		if (s.offset % alignof(T) != 0 ||
+		    s.offset > file.size ||
+		    s.count > (file.size - s.offset) / sizeof(T))
+			return false;
+		out = (T const*)(file.data + s.offset);
+		return true;
+	};
+
+	LibChip  const* lchips;
+	LibPart  const* lparts;
+	LibInput const* linputs;
+	float    const* lpoints;
+	char     const* lstrings;
+	if (!get_section(header.chips,   lchips)  ||
+	    !get_section(header.parts,   lparts)  ||
+	    !get_section(header.inputs,  linputs) ||
+	    !get_section(header.points,  lpoints) ||
+	    !get_section(header.strings, lstrings))
+		return fail("section out of bounds");
+
+	auto in_range = [] (Range r, uint64_t count) {
+		return (uint64_t)r.first + r.count <= count;
+	};
+	auto get_string = [&] (Range r) {
+		return std::string(lstrings + r.first, r.count);
+	};
+
+	int chip_count = (int)header.chips.count;
+	if (header.viewed_chip < -1 || header.viewed_chip >= chip_count)
+		return fail("viewed chip out of range");
+
+	// create chips without parts, so that parts can reference any chip
+	std::vector<std::shared_ptr<Chip>> chips;
+	chips.reserve(chip_count);
+	std::unordered_set<uint64_t> uids;
+
+	for (int i=0; i<chip_count; ++i) {
+		auto& lc = lchips[i];
+		if (!in_range(lc.name, header.strings.count) ||
+		    !in_range(lc.parts, header.parts.count) ||
+		    (uint64_t)lc.output_count + lc.input_count > lc.parts.count)
+			return fail("chip out of range");
+
+		auto& chip = chips.emplace_back(std::make_shared<Chip>());
+		chip->name = get_string(lc.name);
+		chip->col  = lrgb(lc.col[0], lc.col[1], lc.col[2]);
+		chip->size = float2(lc.size[0], lc.size[1]);
+		// duplicates get a new uid on the next split save
+		chip->uid  = lc.uid != 0 && uids.insert(lc.uid).second ? lc.uid : 0;
+
+		chip->outputs.resize(lc.output_count);
+		chip->inputs .resize(lc.input_count);
+	}
+
+	// chips are independent after creating the shells, so create their parts in parallel
+	// returns error or nullptr
+	auto load_chip_body = [&] (int i) -> const char* {
+		auto& lc = lchips[i];
+		auto& chip = *chips[i];
+
+		LibPart const* lchip_parts = lparts + lc.parts.first;
+		int part_count = (int)lc.parts.count;
+		int out_count  = (int)lc.output_count;
+		int inp_count  = (int)lc.input_count;
+
+		// first pass to create part pointers
+		std::vector<Part*> idx2part(part_count, nullptr);
+		chip.parts.reserve(part_count - out_count - inp_count);
+
+		for (int j=0; j<part_count; ++j) {
+			auto& lp = lchip_parts[j];
+			if (lp.chip < 0 || lp.chip >= GATE_COUNT + chip_count ||
+			    !in_range(lp.name, header.strings.count) ||
+			    !in_range(lp.inputs, header.inputs.count))
+				return "part out of range";
+
+			Chip* part_chip = lp.chip < GATE_COUNT ? &gates[lp.chip] : chips[lp.chip - GATE_COUNT].get();
+			if (lp.inputs.count != part_chip->inputs.size())
+				return "part input count mismatch";
+
+			Placement pos;
+			pos.pos    = float2(lp.pos[0], lp.pos[1]);
+			pos.scale  = lp.scale;
+			pos.rot    = (short)wrap((int)lp.rot, 4);
+			pos.mirror = lp.mirror != 0;
+
+			auto* ptr = idx2part[j] = new Part(part_chip, get_string(lp.name), pos);
+
+			if      (j < out_count)             chip.outputs[j] = std::unique_ptr<Part>(ptr);
+			else if (j < out_count + inp_count) chip.inputs[j - out_count] = std::unique_ptr<Part>(ptr);
+			else                                chip.parts.add(ptr);
+		}
+
+		// second pass to link parts via existing pointers
+		for (int j=0; j<part_count; ++j) {
+			auto& lp = lchip_parts[j];
+			auto& part = *idx2part[j];
+
+			for (int k=0; k<(int)lp.inputs.count; ++k) {
+				auto& li = linputs[lp.inputs.first + k];
+				if (li.part_idx < 0 || li.part_idx >= part_count)
+					continue;
+
+				auto* src = idx2part[li.part_idx];
+				if (li.pin < 0 || li.pin >= (int)src->chip->outputs.size() ||
+				    !in_range(li.points, header.points.count / 2))
+					return "wire out of range";
+
+				auto& inp = part.inputs[k];
+				inp.part = src;
+				inp.pin  = li.pin;
+
+				float const* pts = lpoints + (size_t)li.points.first * 2;
+				inp.wire_points.resize(li.points.count);
+				for (uint32_t p=0; p<li.points.count; ++p)
+					inp.wire_points[p] = float2(pts[p*2], pts[p*2 + 1]);
+			}
+		}
+		return nullptr;
+	};
+
+	std::vector<const char*> errors(chip_count, nullptr);
+	worker_pool().parallel_for(chip_count, [&] (int i) {
+		errors[i] = load_chip_body(i);
+	});
+	for (auto* err : errors) {
+		if (err)
+			return fail(err);
+	}
+	if (has_recursive_chips(chips))
+		return fail("chip uses itself");
+
+	sim.saved_chips = std::move(chips);
+	sim.recompute_chip_users();
+
+	if (header.viewed_chip >= 0)
+		sim.switch_to_chip_view(sim.saved_chips[header.viewed_chip]);
+	else
+		sim.switch_to_chip_view(std::make_shared<Chip>());
+
+	return true;
+}
+
+////
+uint64_t hash_fnv1a (std::string_view data) {
+	uint64_t h = 14695981039346656037ull;
+	for (char c : data) {
+		h ^= (uint8_t)c;
+		h *= 1099511628211ull;
+	}
+	return h;
+}
+
+std::string uid2str (uint64_t uid) {
+	return prints("%016llx", (unsigned long long)uid);
+}
+bool str2uid (std::string const& str, uint64_t* uid) {
+	if (str.size() != 16)
+		return false;
+	char* end;
+	*uid = (uint64_t)strtoull(str.c_str(), &end, 16);
+	return end == str.c_str() + str.size() && *uid != 0;
+}
+uint64_t new_chip_uid () {
+	static std::mt19937_64 rng( std::random_device{}() );
+	uint64_t uid;
+	do {
+		uid = rng();
+	} while (uid == 0);
+	return uid;
+}
+
+bool read_file (std::filesystem::path const& path, std::string* text) {
+	std::ifstream f(path, std::ios::binary);
+	if (!f)
+		return false;
+	text->assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+	return !f.bad();
+}
+
+bool save_library_split (LogicSim& sim, std::string const& dirpath) {
+	ZoneScoped;
+	namespace fs = std::filesystem;
+
+	fs::path chips_dir = fs::path(dirpath) / "chips";
+
+	std::error_code ec;
+	fs::create_directories(chips_dir, ec);
+	if (ec)
+		return false;
+
+	// file hashes are only known for the directory we last saved to or loaded from
+	bool same_dir = sim.split_library_dir == dirpath;
+
+	for (auto& chip : sim.saved_chips) {
+		if (chip->uid == 0) {
+			chip->uid = new_chip_uid();
+			chip->snapshot = nullptr; // uid is part of the chip json
+		}
+	}
+
+	json index;
+	index["version"] = 1;
+	index["viewed_chip"] = nullptr;
+	auto& jchips = index["chips"];
+	jchips = json::array();
+
+	std::unordered_set<std::string> files;
+	int written = 0;
+
+	for (auto& chip : sim.saved_chips) {
+		std::string id = uid2str(chip->uid);
+
+		auto snap = snapshot_chip(*chip);
+		if (!same_dir || snap != chip->file_snapshot) {
+			json jfile = snap->get_json();
+			jfile["id"] = id;
+			auto& jdeps = jfile["deps"];
+			jdeps = json::array();
+			for (auto* dep : snap->deps)
+				jdeps.emplace_back(uid2str(dep->uid));
+
+			std::string text = jfile.dump(1, '\t');
+			uint64_t hash = hash_fnv1a(text);
+
+			if (!same_dir || hash != chip->file_hash) {
+				if (!write_file_atomic((chips_dir / (id + ".json")).string(), text))
+					return false;
+				written++;
+			}
+
+			chip->file_hash = hash;
+			chip->file_snapshot = snap;
+		}
+
+		jchips.push_back({
+			{"id",   id},
+			{"name", chip->name},
+			{"hash", uid2str(chip->file_hash)},
+		});
+		files.insert(id + ".json");
+
+		if (chip == sim.viewed_chip)
+			index["viewed_chip"] = id;
+	}
+
+	// delete files of chips that were deleted
+	for (auto& entry : fs::directory_iterator(chips_dir, ec)) {
+		auto filename = entry.path().filename().string();
+		if (entry.path().extension() == ".json" && !files.contains(filename))
+			fs::remove(entry.path(), ec);
+	}
+
+	if (!write_file_atomic((fs::path(dirpath) / "index.json").string(), index.dump(1, '\t')))
+		return false;
+
+	sim.split_library_dir = dirpath;
+	return true;
+}
+
+// json2chip only asserts on chip ids and pins, but chip files can be merged by hand, so check them like load_library_binary does
+// (may throw json::exception)
+static bool valid_chip_parts (json const& jchip, std::vector<Chip*> const& idx2chip) {
+	std::vector<Chip*> part_chips;
+	for (auto* list : { "outputs", "inputs", "parts" }) {
+		for (auto& jpart : jchip.at(list)) {
+			int chip_id = jpart.at("chip");
+			if (chip_id < 0 || chip_id >= GATE_COUNT + (int)idx2chip.size())
+				return false;
+			part_chips.push_back(chip_id < GATE_COUNT ? &gates[chip_id] : idx2chip[chip_id - GATE_COUNT]);
+		}
+	}
+
+	int idx = 0;
+	for (auto* list : { "outputs", "inputs", "parts" }) {
+		for (auto& jpart : jchip.at(list)) {
+			Chip* chip = part_chips[idx++];
+			if (!jpart.contains("inputs"))
+				continue;
+
+			auto& jinputs = jpart.at("inputs");
+			if (jinputs.size() != chip->inputs.size())
+				return false;
+			for (auto& jinp : jinputs) {
+				int part_idx = jinp.at("part_idx");
+				if (part_idx < 0 || part_idx >= (int)part_chips.size())
+					continue; // not connected
+				int pin_idx = jinp.at("pin_idx");
+				if (pin_idx < 0 || pin_idx >= (int)part_chips[part_idx]->outputs.size())
+					return false;
+			}
+		}
+	}
+	return true;
+}
+
+bool load_library_split (std::string const& dirpath, LogicSim& sim) {
+	ZoneScoped;
+	namespace fs = std::filesystem;
+
+	auto fail = [&] (const char* reason) {
+		fprintf(stderr, "load_library_split: \"%s\" is invalid (%s)\n", dirpath.c_str(), reason);
+		return false;
+	};
+
+	std::string index_text;
+	if (!read_file(fs::path(dirpath) / "index.json", &index_text)) {
+		fprintf(stderr, "load_library_split: could not open \"%s\"\n", dirpath.c_str());
+		return false;
+	}
+	json index = json::parse(index_text, nullptr, false);
+	if (index.is_discarded() || !index.contains("chips") || !index["chips"].is_array())
+		return fail("index.json");
+
+	auto& jentries = index["chips"];
+	int chip_count = (int)jentries.size();
+
+	// read and parse chip files in parallel
+	std::vector<json>     jchips(chip_count);
+	std::vector<uint64_t> hashes(chip_count);
+	std::vector<uint64_t> uids(chip_count);
+	std::vector<uint8_t>  ok(chip_count, 0);
+
+	worker_pool().parallel_for(chip_count, [&] (int i) {
+		auto& jentry = jentries[i];
+		if (!jentry.contains("id") || !jentry["id"].is_string() || !str2uid(jentry["id"], &uids[i]))
+			return;
+
+		std::string text;
+		if (!read_file(fs::path(dirpath) / "chips" / (jentry["id"].get<std::string>() + ".json"), &text))
+			return;
+
+		hashes[i] = hash_fnv1a(text);
+		jchips[i] = json::parse(text, nullptr, false);
+		ok[i] = !jchips[i].is_discarded();
+	});
+
+	std::vector<std::shared_ptr<Chip>> chips;
+	std::unordered_map<uint64_t, Chip*> uid2chip;
+	chips.reserve(chip_count);
+
+	try {
+		// create chips without parts
+		for (int i=0; i<chip_count; ++i) {
+			if (!ok[i])
+				return fail("missing or invalid chip file");
+
+			auto& jchip = jchips[i];
+			auto& chip = chips.emplace_back(std::make_shared<Chip>());
+			chip->name      = jchip.at("name");
+			chip->col       = jchip.at("col");
+			chip->size      = jchip.at("size");
+			chip->uid       = uids[i];
+			chip->file_hash = hashes[i];
+
+			chip->outputs.resize(jchip.at("outputs").size());
+			chip->inputs .resize(jchip.at("inputs" ).size());
+
+			if (!uid2chip.try_emplace(chip->uid, chip.get()).second)
+				return fail("duplicate chip id");
+		}
+
+		// chip ids of parts are local to each chip file
+		std::vector<std::vector<Chip*>> idx2chip(chip_count);
+		for (int i=0; i<chip_count; ++i) {
+			for (auto& jdep : jchips[i].at("deps")) {
+				uint64_t uid;
+				if (!jdep.is_string() || !str2uid(jdep, &uid) || !uid2chip.contains(uid))
+					return fail("unknown chip dependency");
+				idx2chip[i].push_back(uid2chip[uid]);
+			}
+		}
+
+		// then create parts, chips are independent now
+		std::vector<uint8_t> parts_ok(chip_count, 0);
+		worker_pool().parallel_for(chip_count, [&] (int i) {
+			try {
+				if (!valid_chip_parts(jchips[i], idx2chip[i]))
+					return;
+				json2chip(jchips[i], *chips[i], idx2chip[i]);
+				parts_ok[i] = 1;
+			}
+			catch (json::exception&) {}
+		});
+		if (contains(parts_ok, (uint8_t)0))
+			return fail("invalid parts");
+		if (has_recursive_chips(chips))
+			return fail("chip uses itself");
+	}
+	catch (json::exception&) {
+		return fail("invalid chip json");
+	}
+
+	std::shared_ptr<Chip> viewed;
+	auto& jviewed = index["viewed_chip"];
+	uint64_t viewed_uid;
+	if (jviewed.is_string() && str2uid(jviewed, &viewed_uid) && uid2chip.contains(viewed_uid)) {
+		for (auto& c : chips) {
+			if (c->uid == viewed_uid)
+				viewed = c;
+		}
+	}
+
+	sim.saved_chips = std::move(chips);
+	sim.recompute_chip_users();
+	sim.switch_to_chip_view(viewed ? viewed : std::make_shared<Chip>());
+	sim.split_library_dir = dirpath;
+	return true;
+}
+
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include "common.hpp"
+#include "logic_sim.hpp"
+
+namespace logic_sim {
+
+// Compact binary format for saved_chips, alternative to the json in debug.json for large chip libraries
+// the file is memory mapped and parts are created directly from fixed-size records, no text parsing involved
+//
+// Layout: LibHeader followed by the sections it points to (each 8 byte aligned)
+//   chips   LibChip  [count]
+//   parts   LibPart  [count]  parts of all chips, each chip owns a range in json index order (outputs, inputs, parts)
+//   inputs  LibInput [count]  input wires of all parts, each part owns a range with one entry per input pin
+//   points  float    [count]  pooled wire points as x,y pairs, inputs own a range (in points)
+//   strings char     [count]  pooled chip and part names, not null terminated
+// part links are indices relative to the first part of the chip (like part_idx in json)
+// chip ids are gate types (< GATE_COUNT) or GATE_COUNT + index into chips (like chip in json)
+// integers and floats are stored in host byte order (little endian on all platforms we build for)
+namespace binlib {
+	inline constexpr char     MAGIC[8] = { 'L','S','I','M','L','I','B','\0' };
+	inline constexpr uint32_t VERSION  = 2; // 2: chip uids
+
+	struct Range {
+		uint32_t first;
+		uint32_t count;
+	};
+	struct Section {
+		uint64_t offset; // in bytes from start of file
+		uint64_t count;  // in elements
+	};
+
+	struct LibHeader {
+		char     magic[8];
+		uint32_t version;
+		int32_t  viewed_chip; // -1 if none
+
+		Section  chips;
+		Section  parts;
+		Section  inputs;
+		Section  points;
+		Section  strings;
+	};
+	struct LibChip {
+		uint64_t uid; // Chip::uid, so split libraries saved after an import keep their chip file names, 0 if none
+		Range    name;
+		float    col[3];
+		float    size[2];
+		uint32_t output_count;
+		uint32_t input_count;
+		Range    parts; // outputs + inputs + parts
+		uint32_t _pad;
+	};
+	struct LibPart {
+		int32_t  chip;
+		Range    name;
+		float    pos[2];
+		float    scale;
+		int16_t  rot;
+		uint8_t  mirror;
+		uint8_t  _pad;
+		Range    inputs;
+	};
+	struct LibInput {
+		int32_t  part_idx; // -1 if unconnected
+		int32_t  pin;
+		Range    points;
+	};
+
+	static_assert(sizeof(LibHeader) == 96, "");
+	static_assert(sizeof(LibChip)   == 56, "");
+	static_assert(sizeof(LibPart)   == 36, "");
+	static_assert(sizeof(LibInput)  == 16, "");
+}
+
+// write all saved chips (and which one is viewed) to filepath, returns false on io error
+bool save_library_binary (LogicSim const& sim, const char* filepath);
+
+// replace saved chips in (freshly constructed) sim with the chips in filepath and view the stored viewed chip
+// returns false and leaves sim untouched if the file could not be opened or is invalid
+bool load_library_binary (const char* filepath, LogicSim& sim);
+
+////
+// Split library: a directory with one json file per chip plus an index, so saves only rewrite edited chips
+// and version control diffs stay small
+//
+//   <dir>/index.json      {"version", "viewed_chip": id or null, "chips": [{"id", "name", "hash"}]} in saved_chips order
+//   <dir>/chips/<id>.json chip json like in debug.json, plus "id" and "deps" (ids of the custom chips it uses),
+//                         part chip ids >= GATE_COUNT index into deps instead of saved_chips
+// ids are Chip::uid in hex, so they stay the same when chips are reordered,
+// hash is a 64 bit FNV-1a hash of the chip file, chip files are only rewritten if their hash changes
+
+// assigns ids to new chips, only writes chips whose content changed since they were last written to dirpath
+// and deletes files of chips that no longer exist, returns false on io error
+bool save_library_split (LogicSim& sim, std::string const& dirpath);
+
+// replace saved chips in (freshly constructed) sim with the chips in dirpath, chips files are read in parallel
+// returns false and leaves sim untouched if the library could not be read or is invalid
+bool load_library_split (std::string const& dirpath, LogicSim& sim);
+
+}
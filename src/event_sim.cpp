@@ -0,0 +1,351 @@
+#include "common.hpp"
+#include "event_sim.hpp"
+
+namespace logic_sim {
+
+////
+// mirrors the order of state indices (see LogicSim::update_state_indices)
+static void mark_gate_parts (Chip& chip, int state_base, std::vector<uint8_t>& is_gate_part) {
+	for (auto& part : chip.parts) {
+		int sid = state_base + part->sid;
+
+		if (is_gate(part->chip))
+			is_gate_part[sid] = 1;
+		else
+			mark_gate_parts(*part->chip, sid, is_gate_part);
+	}
+}
+
+void EventSim::rebuild (LogicSim& sim) {
+	ZoneScoped;
+
+	if (!sim.netlist_valid)
+		sim.update_netlist();
+	auto& nl = sim.netlist;
+
+	if (chip != sim.viewed_chip.get())
+		instance_delay.clear();
+
+	chip = sim.viewed_chip.get();
+	netlist_hash = nl.hash;
+	int count = nl.state_count;
+
+	nodes.assign(count, Node{});
+	for (int type=0; type<GATE_COUNT; ++type) {
+		for (auto& n : nl.nodes[type]) {
+			auto& g = nodes[n.dst];
+			g.type = (int8_t)type;
+			for (int i=0; i<3; ++i)
+				g.src[i] = n.src[i];
+		}
+	}
+
+	is_gate_part.assign(count, 0);
+	mark_gate_parts(*chip, 0, is_gate_part);
+
+	// users of each state as compressed adjacency lists
+	first_user.assign(count + 1, 0);
+	for (auto& g : nodes) {
+		if (g.type < 0) continue;
+		for (int32_t src : g.src) {
+			if (src >= 0) first_user[src + 1]++;
+		}
+	}
+	for (int i=0; i<count; ++i)
+		first_user[i+1] += first_user[i];
+
+	users.resize(first_user.back());
+	std::vector<int32_t> fill(first_user.begin(), first_user.end() - 1);
+	for (int32_t sid=0; sid<count; ++sid) {
+		auto& g = nodes[sid];
+		if (g.type < 0) continue;
+		for (int32_t src : g.src) {
+			if (src >= 0) users[fill[src]++] = sid;
+		}
+	}
+
+	for (auto& level : wheel) {
+		for (auto& slot : level)
+			slot.clear();
+	}
+	overflow.clear();
+	now = 0;
+	zero_delay_loop = false;
+
+	// start from the current sim state and evaluate every gate once
+	val = sim.state[sim.cur_state];
+	projected = val;
+	stamp.assign(count, 0);
+	changed_prev.clear();
+	changed_cur.clear();
+	full_sync = true;
+
+	delays_dirty = true;
+	update_delays();
+
+	std::vector<Event> initial;
+	for (int32_t sid=0; sid<count; ++sid) {
+		if (nodes[sid].type < 0) continue;
+		uint8_t r = eval(sid);
+		if (r != projected[sid]) {
+			projected[sid] = r;
+			if (delay[sid] == 0) initial.push_back({ now, sid, r });
+			else                 schedule({ now + delay[sid], sid, r });
+		}
+	}
+	process(initial);
+
+	valid = true;
+}
+
+void EventSim::update_delays () {
+	if (!delays_dirty)
+		return;
+
+	delay.assign(nodes.size(), 0);
+	for (int32_t sid=0; sid<(int32_t)nodes.size(); ++sid) {
+		if (nodes[sid].type >= 0 && is_gate_part[sid])
+			delay[sid] = type_delay[nodes[sid].type];
+	}
+	for (auto& [sid, d] : instance_delay) {
+		if (sid >= 0 && sid < (int32_t)nodes.size() && is_gate_part[sid])
+			delay[sid] = d;
+	}
+
+	delays_dirty = false;
+}
+
+////
+void EventSim::schedule (Event e) {
+	assert(e.time >= now); // == now when cascaded into the slot that is processed next
+
+	// lowest level on which the event is in the current round of slots
+	// (level 0 also takes anything closer than one round, since its slot is reached before it comes around again)
+	for (int level=0; level<WHEEL_LEVELS; ++level) {
+		int shift = level * WHEEL_BITS;
+		if ((e.time >> (shift + WHEEL_BITS)) == (now >> (shift + WHEEL_BITS)) || (level == 0 && e.time - now < WHEEL_SIZE)) {
+			wheel[level][(e.time >> shift) & (WHEEL_SIZE-1)].push_back(e);
+			return;
+		}
+	}
+	overflow.push_back(e);
+}
+
+void EventSim::cascade (int level, int slot) {
+	std::vector<Event> events;
+	std::swap(events, wheel[level][slot]);
+	for (auto& e : events)
+		schedule(e);
+}
+
+uint8_t EventSim::eval (int32_t sid) const {
+	auto& g = nodes[sid];
+	bool a = g.src[0] >= 0 && val[g.src[0]];
+	bool b = g.src[1] >= 0 && val[g.src[1]];
+	bool c = g.src[2] >= 0 && val[g.src[2]];
+
+	switch (g.type) {
+		case BUF_GATE  : return   a;
+		case NOT_GATE  : return  !a;
+		case AND_GATE  : return   a && b;
+		case NAND_GATE : return !(a && b);
+		case OR_GATE   : return   a || b;
+		case NOR_GATE  : return !(a || b);
+		case XOR_GATE  : return   a != b;
+		case AND3_GATE : return   a && b && c;
+		case NAND3_GATE: return !(a && b && c);
+		case OR3_GATE  : return   a || b || c;
+		case NOR3_GATE : return !(a || b || c);
+		default: assert(false); return 0;
+	}
+}
+
+// apply the events of the current time unit, then evaluate the users of every changed state
+// zero delay results are applied in further delta cycles of the same time unit
+void EventSim::process (std::vector<Event>& events) {
+	std::vector<int32_t> changed;
+	std::vector<Event> next;
+
+	for (int cycle=0; !events.empty(); ++cycle) {
+		if (cycle >= MAX_DELTA_CYCLES) {
+			zero_delay_loop = true;
+			events.clear();
+			break;
+		}
+
+		changed.clear();
+		for (auto& e : events) {
+			if (val[e.sid] != e.val) {
+				val[e.sid] = e.val;
+				changed.push_back(e.sid);
+				changed_cur.push_back(e.sid);
+			}
+		}
+		events_last_tick += events.size();
+
+		cur_stamp++;
+		for (int32_t sid : changed) {
+			for (int32_t u = first_user[sid]; u < first_user[sid+1]; ++u) {
+				int32_t user = users[u];
+				if (stamp[user] == cur_stamp)
+					continue;
+				stamp[user] = cur_stamp;
+
+				uint8_t r = eval(user);
+				if (r == projected[user])
+					continue;
+				projected[user] = r;
+
+				if (delay[user] == 0) next.push_back({ now, user, r });
+				else                  schedule({ now + delay[user], user, r });
+			}
+		}
+
+		std::swap(events, next);
+		next.clear();
+	}
+}
+
+void EventSim::simulate (LogicSim& sim) {
+	ZoneScoped;
+
+	events_last_tick = 0;
+
+	// after both buffers were overwritten (reset, checkpoint restore, time travel seek) the scheduled events belong to another
+	// history and the buffer written next no longer holds the states of two ticks ago, so start over from the current state
+	// (events in flight at the restored tick are not part of the state, they are rederived from the gate inputs)
+	bool stale = !valid || !sim.netlist_valid || chip != sim.viewed_chip.get() || netlist_hash != sim.netlist.hash ||
+		val.size() != sim.state[sim.cur_state].size() || state_generation != sim.state_generation;
+	if (stale) {
+		rebuild(sim); // starts from the current state
+		state_generation = sim.state_generation;
+	}
+	update_delays();
+
+	// states written from outside (gate toggles) become events of the current time unit
+	auto& cur = sim.state[sim.cur_state];
+	if (!stale && memcmp(cur.data(), val.data(), val.size()) != 0) {
+		std::vector<Event> external;
+		for (int32_t sid=0; sid<(int32_t)val.size(); ++sid) {
+			if (cur[sid] != val[sid]) {
+				projected[sid] = cur[sid];
+				external.push_back({ now, sid, cur[sid] });
+			}
+		}
+		process(external);
+
+		// driven gates that were toggled recover on their next evaluation like in the unit delay sim
+		for (auto& e : external) {
+			if (nodes[e.sid].type < 0)
+				continue;
+			uint8_t r = eval(e.sid);
+			if (r != projected[e.sid]) {
+				projected[e.sid] = r;
+				schedule({ now + max(delay[e.sid], 1), e.sid, r });
+			}
+		}
+	}
+
+	std::vector<Event> events;
+	for (int i=0; i<units_per_tick; ++i) {
+		now++;
+
+		// slots of higher levels are cascaded down once the lower levels wrap around
+		if ((now & ((1ull << (WHEEL_BITS * WHEEL_LEVELS)) - 1)) == 0) {
+			std::vector<Event> far;
+			std::swap(far, overflow);
+			for (auto& e : far)
+				schedule(e);
+		}
+		for (int level=WHEEL_LEVELS-1; level>=1; --level) {
+			if ((now & ((1ull << (WHEEL_BITS * level)) - 1)) == 0)
+				cascade(level, (int)((now >> (WHEEL_BITS * level)) & (WHEEL_SIZE-1)));
+		}
+
+		auto& slot = wheel[0][now & (WHEEL_SIZE-1)];
+		if (slot.empty())
+			continue;
+		events.clear();
+		std::swap(events, slot);
+		process(events);
+	}
+
+	pending_events = overflow.size();
+	for (auto& level : wheel) {
+		for (auto& slot : level)
+			pending_events += slot.size();
+	}
+
+	// next buffer holds the state of two ticks ago, so writing the states changed in the last two ticks brings it up to date
+	auto& next = sim.state[sim.cur_state^1];
+	if (full_sync) {
+		next = val;
+		full_sync = false;
+	}
+	else {
+		for (int32_t sid : changed_prev) next[sid] = val[sid];
+		for (int32_t sid : changed_cur)  next[sid] = val[sid];
+	}
+	std::swap(changed_prev, changed_cur);
+	changed_cur.clear();
+
+	sim.cur_state ^= 1;
+	sim.state_changed = true;
+}
+
+////
+void EventSim::imgui (LogicSim& sim, Editor& editor) {
+	if (ImGui::TreeNodeEx("Event Driven Timing")) {
+		if (ImGui::Checkbox("Use Event Driven Engine", &enabled))
+			valid = false;
+		if (enabled && sim.ternary)
+			ImGui::TextColored(ImVec4(1.00f, 0.80f, 0.20f, 1), "ternary X states are ignored by this engine");
+
+		ImGui::InputInt("time units per tick", &units_per_tick);
+		units_per_tick = clamp(units_per_tick, 1, 1 << 16);
+
+		if (ImGui::TreeNodeEx("Gate Delays")) {
+			for (int type=BUF_GATE; type<GATE_COUNT; ++type) {
+				if (ImGui::InputInt(gates[type].name.c_str(), &type_delay[type])) {
+					type_delay[type] = clamp(type_delay[type], 1, 1 << 20);
+					delays_dirty = true;
+				}
+			}
+			ImGui::TreePop();
+		}
+
+		{ // instance overrides from the editor selection
+			ImGui::InputInt("delay##selected", &selection_delay);
+			selection_delay = clamp(selection_delay, 1, 1 << 20);
+
+			auto* e = std::get_if<Editor::EditMode>(&editor.mode);
+			bool has_sel = e && e->sel;
+
+			ImGui::BeginDisabled(!has_sel);
+			if (ImGui::Button("Set for Selected Gates")) {
+				for (auto& item : e->sel.items) {
+					if (is_gate(item.part->chip))
+						instance_delay[e->sel.chip.sid + item.part->sid] = selection_delay;
+				}
+				delays_dirty = true;
+			}
+			ImGui::EndDisabled();
+			ImGui::SameLine();
+			if (ImGui::Button(prints("Clear %d Overrides", (int)instance_delay.size()).c_str())) {
+				instance_delay.clear();
+				delays_dirty = true;
+			}
+		}
+
+		if (enabled) {
+			ImGui::Text("time %llu, %llu events last tick, %llu pending",
+				(unsigned long long)now, (unsigned long long)events_last_tick, (unsigned long long)pending_events);
+			if (zero_delay_loop)
+				ImGui::TextColored(ImVec4(1.00f, 0.20f, 0.20f, 1), "loop without delay (only through pins), stopped after %d delta cycles", MAX_DELTA_CYCLES);
+		}
+
+		ImGui::TreePop();
+	}
+}
+
+}
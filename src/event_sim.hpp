@@ -0,0 +1,89 @@
+#pragma once
+#include "common.hpp"
+#include "logic_sim.hpp"
+
+namespace logic_sim {
+
+// Event driven simulation with integer propagation delays, selectable instead of the unit delay LogicSim::simulate
+// gates have a delay per GateType, which can be overridden per gate instance of the viewed chip,
+// pin buffers inserted by flattening have zero delay and are resolved in delta cycles within the same time unit
+// delays are transport delays: every change of a gate output is scheduled, so glitches shorter than the delay still show up
+// events are stored in a hierarchical timing wheel, so the cost is O(events) instead of O(gates * time units)
+// a sim tick advances time by units_per_tick, ternary X states are not simulated by this engine
+struct EventSim {
+	bool enabled = false;
+	int  units_per_tick = 1;
+
+	int type_delay[GATE_COUNT];
+	// instance overrides, keyed by state index of the gate in the viewed chip
+	std::unordered_map<int32_t, int> instance_delay;
+	int selection_delay = 1; // set for the editor selection in imgui
+
+	// stats
+	uint64_t now = 0;
+	size_t   events_last_tick = 0;
+	size_t   pending_events = 0;
+	bool     zero_delay_loop = false;
+
+	EventSim () {
+		for (auto& d : type_delay)
+			d = 1;
+	}
+
+	// advance by units_per_tick, then write the values into the next state buffer of sim like LogicSim::simulate
+	void simulate (LogicSim& sim);
+
+	// engine selection, delays and stats, delays of selected gates can be set through the editor selection
+	void imgui (LogicSim& sim, Editor& editor);
+
+private:
+	static constexpr int WHEEL_BITS   = 8;
+	static constexpr int WHEEL_SIZE   = 1 << WHEEL_BITS;
+	static constexpr int WHEEL_LEVELS = 3;
+	static constexpr int MAX_DELTA_CYCLES = 1000;
+
+	struct Event {
+		uint64_t time;
+		int32_t  sid;
+		uint8_t  val;
+	};
+
+	// level l slot s holds events whose time has bits [l*WHEEL_BITS, (l+1)*WHEEL_BITS) equal to s,
+	// slots are cascaded down a level when the time reaches them, events beyond the last level wait in overflow
+	std::vector<Event> wheel[WHEEL_LEVELS][WHEEL_SIZE];
+	std::vector<Event> overflow;
+
+	// per state index
+	struct Node {
+		int8_t  type = -1; // -1 if not a netlist node (inputs, kept states)
+		int32_t src[3];
+	};
+	std::vector<Node>    nodes;
+	std::vector<uint8_t> is_gate_part; // node is a gate part, not a pin buffer
+	std::vector<int32_t> delay;
+	std::vector<int32_t> first_user, users;
+
+	std::vector<uint8_t> val;       // current values
+	std::vector<uint8_t> projected; // value of the last scheduled event of each state (or val)
+	std::vector<uint32_t> stamp;
+	uint32_t cur_stamp = 0;
+
+	std::vector<int32_t> changed_prev, changed_cur; // states written in the last and this tick, to update the state buffers
+	bool full_sync = true; // state buffers do not match after a rebuild
+	uint64_t state_generation = 0; // of sim at the last rebuild, a rebuild is needed after outside writes to both buffers
+
+	uint64_t netlist_hash = 0;
+	Chip*    chip = nullptr;
+	bool     valid = false;
+	bool     delays_dirty = true;
+
+	void rebuild (LogicSim& sim);
+	void update_delays ();
+
+	void schedule (Event e);
+	void cascade (int level, int slot);
+	void process (std::vector<Event>& events);
+	uint8_t eval (int32_t sid) const;
+};
+
+}
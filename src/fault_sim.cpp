@@ -0,0 +1,233 @@
+#include "common.hpp"
+#include "fault_sim.hpp"
+#include <bit>
+
+namespace logic_sim {
+
+static constexpr int FAULTS_PER_WORD = 63; // lane 0 is the good machine
+
+////
+// gate parts at any depth, mirrors the order of state indices (see LogicSim::update_state_indices)
+static void collect_sites (Chip& chip, int state_base, std::vector<FaultSite>& sites) {
+	for (auto& part : chip.parts) {
+		int sid = state_base + part->sid;
+
+		if (is_gate(part->chip))
+			sites.push_back({ sid });
+		else
+			collect_sites(*part->chip, sid, sites);
+	}
+}
+
+void prepare_fault_sim (LogicSim& sim, std::string const& filepath, FaultSimJob& job) {
+	ZoneScoped;
+
+	if (!sim.netlist_valid)
+		sim.update_netlist();
+
+	auto& chip = *sim.viewed_chip;
+
+	job = {};
+	job.chip = chip.name;
+	job.filepath = filepath;
+	job.netlist = std::make_shared<Netlist const>(sim.netlist);
+	job.pins = TestPins(chip);
+	collect_sites(chip, 0, job.sites);
+
+	// same paths that signals can be searched by
+	for (auto& site : job.sites)
+		site.name = std::string(sim.signals.path(sim, site.sid));
+}
+
+namespace {
+	// forces the faulty lanes of one state
+	struct Injection {
+		int32_t  sid;
+		uint64_t clear;
+		uint64_t set;
+	};
+}
+
+static void inject (std::vector<Injection> const& inj, uint64_t* state) {
+	for (auto& i : inj)
+		state[i.sid] = (state[i.sid] & ~i.clear) | i.set;
+}
+
+// returns the detected lanes of one group of faults
+static uint64_t simulate_group (Netlist const& nl, TestBench const& bench, std::vector<Injection> const& inj, uint64_t lanes,
+		std::vector<uint64_t> (&state)[2]) {
+	std::fill(state[0].begin(), state[0].end(), 0);
+	std::fill(state[1].begin(), state[1].end(), 0);
+	inject(inj, state[0].data());
+	inject(inj, state[1].data());
+	int cur = 0;
+
+	uint64_t detected = 0;
+	for (auto& vec : bench.vectors) {
+		// every machine sees the same inputs
+		for (auto& in : vec.inputs) {
+			auto& col = bench.columns[in.column];
+			for (size_t bit=0; bit<col.sids.size(); ++bit) {
+				uint64_t v = (in.val >> bit) & 1 ? ~0ull : 0;
+				state[0][col.sids[bit]] = v;
+				state[1][col.sids[bit]] = v;
+			}
+		}
+
+		for (int t=0; t<vec.ticks; ++t) {
+			nl.simulate_lanes(state[cur].data(), state[cur^1].data());
+			inject(inj, state[cur^1].data());
+			cur ^= 1;
+		}
+
+		for (auto& out : vec.outputs) {
+			auto& col = bench.columns[out.column];
+			for (size_t bit=0; bit<col.sids.size(); ++bit) {
+				if (!((out.care >> bit) & 1))
+					continue;
+				uint64_t w = state[cur][col.sids[bit]];
+				uint64_t good = w & 1 ? ~0ull : 0;
+				detected |= w ^ good;
+			}
+		}
+
+		// no need to run the rest of the bench once every fault was seen
+		if ((detected & lanes) == lanes)
+			break;
+	}
+	return detected & lanes;
+}
+
+FaultSimResult run_fault_sim (FaultSimJob const& job, WorkerPool& pool) {
+	ZoneScoped;
+
+	FaultSimResult res;
+	res.chip = job.chip;
+	res.filepath = job.filepath;
+	res.sites = job.sites;
+
+	TestBench bench;
+	if (!parse_testbench(job.filepath, job.pins, bench, &res.error))
+		return res;
+	res.vectors = (int)bench.vectors.size();
+
+	std::vector<Fault> faults;
+	for (int s=0; s<(int)job.sites.size(); ++s) {
+		faults.push_back({ s, false });
+		faults.push_back({ s, true });
+	}
+	res.fault_count = (int)faults.size();
+
+	int groups = (int)((faults.size() + FAULTS_PER_WORD-1) / FAULTS_PER_WORD);
+	std::vector<uint64_t> detected(groups, 0);
+
+	auto& nl = *job.netlist;
+	pool.parallel_for(groups, [&] (int g) {
+		int first = g * FAULTS_PER_WORD;
+		int count = min(FAULTS_PER_WORD, (int)faults.size() - first);
+
+		std::vector<Injection> inj;
+		for (int i=0; i<count; ++i) {
+			auto& f = faults[first + i];
+			uint64_t lane = 1ull << (i + 1);
+			int32_t sid = job.sites[f.site].sid;
+
+			if (inj.empty() || inj.back().sid != sid)
+				inj.push_back({ sid, 0, 0 });
+			inj.back().clear |= lane;
+			if (f.stuck_at)
+				inj.back().set |= lane;
+		}
+		uint64_t lanes = ((1ull << count) - 1) << 1;
+
+		std::vector<uint64_t> state[2];
+		state[0].resize(nl.state_count);
+		state[1].resize(nl.state_count);
+
+		detected[g] = simulate_group(nl, bench, inj, lanes, state);
+	});
+
+	for (int g=0; g<groups; ++g) {
+		res.detected += std::popcount(detected[g]);
+
+		int first = g * FAULTS_PER_WORD;
+		int count = min(FAULTS_PER_WORD, (int)faults.size() - first);
+		for (int i=0; i<count; ++i) {
+			if (!((detected[g] >> (i + 1)) & 1))
+				res.undetected.push_back(faults[first + i]);
+		}
+	}
+	return res;
+}
+
+////
+void FaultSimTool::run (LogicSim& sim) {
+	if (busy())
+		return;
+
+	FaultSimJob job;
+	prepare_fault_sim(sim, filepath.empty() ? dir + "/" + sim.viewed_chip->name + ".tv" : filepath, job);
+
+	started = std::chrono::steady_clock::now();
+
+	// own pool, since parallel_for on the shared pool would block the main thread meanwhile
+	pending = std::async(std::launch::async, [job = std::move(job)] () {
+		WorkerPool pool;
+		return run_fault_sim(job, pool);
+	});
+}
+
+void FaultSimTool::imgui (LogicSim& sim) {
+	if (pending.valid() && !busy()) {
+		result = pending.get();
+		has_result = true;
+		last_run_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - started).count();
+	}
+
+	if (ImGui::TreeNodeEx("Fault Simulation")) {
+		ImGui::InputText("test bench##fault_sim", &filepath);
+		if (filepath.empty()) {
+			ImGui::SameLine();
+			ImGui::TextDisabled("%s/%s.tv", dir.c_str(), sim.viewed_chip->name.c_str());
+		}
+
+		ImGui::BeginDisabled(busy());
+		if (ImGui::Button("Run Stuck-At Faults"))
+			run(sim);
+		ImGui::EndDisabled();
+		ImGui::SameLine();
+		if (busy())
+			ImGui::Text("Running...");
+		else if (has_result && result.error.empty())
+			ImGui::Text("%d faults, %d vectors in %.1f ms", result.fault_count, result.vectors, last_run_ms);
+
+		if (has_result) {
+			auto& r = result;
+			if (!r.error.empty()) {
+				ImGui::TextColored(ImVec4(1.00f, 0.20f, 0.20f, 1), "%s: %s", r.filepath.c_str(), r.error.c_str());
+			}
+			else {
+				ImVec4 col = r.detected == r.fault_count ? ImVec4(0.20f, 1.00f, 0.20f, 1) : ImVec4(1.00f, 0.80f, 0.20f, 1);
+				ImGui::TextColored(col, "coverage %.2f%% (%d / %d detected)", r.coverage() * 100, r.detected, r.fault_count);
+
+				if (!r.undetected.empty()) {
+					ImGui::Text("Undetected:");
+					ImGui::BeginChild("undetected", ImVec2(0, 150), true);
+					ImGuiListClipper clip;
+					clip.Begin((int)r.undetected.size());
+					while (clip.Step()) {
+						for (int i=clip.DisplayStart; i<clip.DisplayEnd; ++i) {
+							auto& f = r.undetected[i];
+							ImGui::Text("%s stuck-at-%d", r.sites[f.site].name.c_str(), (int)f.stuck_at);
+						}
+					}
+					ImGui::EndChild();
+				}
+			}
+		}
+
+		ImGui::TreePop();
+	}
+}
+
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include "common.hpp"
+#include "logic_sim.hpp"
+#include "testbench.hpp"
+#include "parallel.hpp"
+#include <future>
+
+namespace logic_sim {
+
+// Stuck-at fault simulation of the viewed chip against a test bench
+// every primitive gate output gets a stuck-at-0 and a stuck-at-1 fault, a fault counts as detected
+// if any checked output bit of the bench differs from the good machine on the last tick of a vector
+// lane 0 of every word runs the good machine and lanes 1..63 one faulty machine each, groups of 63 faults are split across threads
+struct FaultSite {
+	int32_t     sid;
+	std::string name; // path of the gate, see SignalIndex
+};
+struct Fault {
+	int  site;
+	bool stuck_at; // value the gate output is stuck at
+};
+
+struct FaultSimJob {
+	std::string chip;
+	std::string filepath;
+
+	std::shared_ptr<Netlist const> netlist;
+	TestPins pins;
+	std::vector<FaultSite> sites;
+};
+
+struct FaultSimResult {
+	std::string chip;
+	std::string filepath;
+	std::string error; // test bench could not be read or parsed
+
+	std::vector<FaultSite> sites;
+	std::vector<Fault> undetected;
+	int fault_count = 0;
+	int detected = 0;
+	int vectors = 0;
+
+	float coverage () const { return fault_count ? (float)detected / (float)fault_count : 0; }
+};
+
+// call on main thread, flattens the viewed chip
+void prepare_fault_sim (LogicSim& sim, std::string const& filepath, FaultSimJob& job);
+FaultSimResult run_fault_sim (FaultSimJob const& job, WorkerPool& pool);
+
+// "Fault Simulation" ui, runs in the background
+struct FaultSimTool {
+	std::string dir = "tests";
+	std::string filepath; // <dir>/<viewed chip>.tv if empty
+
+	FaultSimResult result;
+	bool has_result = false;
+	float last_run_ms = 0;
+
+	bool busy () const {
+		return pending.valid() && pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready;
+	}
+
+	void run (LogicSim& sim);
+	void imgui (LogicSim& sim);
+
+	~FaultSimTool () {
+		if (pending.valid())
+			pending.wait();
+	}
+private:
+	std::future<FaultSimResult> pending;
+	std::chrono::steady_clock::time_point started;
+};
+
+}
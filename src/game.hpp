@@ -3,6 +3,19 @@
 #include "camera.hpp"
 #include "engine/dbgdraw.hpp"
 #include "logic_sim.hpp"
+#include "chip_library.hpp"
+#include "netlist_import.hpp"
+#include "vcd.hpp"
+#include "waveform.hpp"
+#include "checkpoint.hpp"
+#include "time_travel.hpp"
+#include "breakpoints.hpp"
+#include "testbench.hpp"
+#include "truth_table.hpp"
+#include "bdd.hpp"
+#include "fault_sim.hpp"
+#include "event_sim.hpp"
+#include "activity.hpp"
 #include "opengl/renderer.hpp"
 
 struct Game {
@@ -15,7 +28,10 @@ struct Game {
 		t.sim = {}; // reset entire sim
 		t.sim.reset_chip_view(t.cam);
 
-		if (j.contains("sim")) from_json(j["sim"], t.sim);
+		if (j.contains("sim")) {
+			if (t.lazy_loading) from_json_lazy(j["sim"], t.sim);
+			else                from_json(j["sim"], t.sim);
+		}
 
 		SERIALIZE_FROM_JSON_EXPAND(cam)
 	}
@@ -38,10 +54,83 @@ struct Game {
 	// set to zero using imgui input field, let sim run via unpause and now you know how many ticks something takes
 	int tick_counter = 0;
 
+	// binary chip library file for import/export, see chip_library.hpp
+	std::string library_filepath = "library.lslib";
+	// directory for split library (one file per chip)
+	std::string split_library_dir = "library";
+	// BLIF or structural verilog file to import as chips
+	std::string netlist_filepath = "netlist.blif";
+	std::string netlist_import_error;
+	std::vector<std::string> netlist_import_warnings;
+
+	logic_sim::VcdExport vcd;
+	logic_sim::WaveCapture waves;
+	logic_sim::Checkpoints checkpoints;
+	logic_sim::TimeTravel  history;
+	logic_sim::Breakpoints breakpoints;
+	logic_sim::TestRunner  tests;
+	logic_sim::TruthTableTool truth_table;
+	logic_sim::EquivalenceTool equivalence;
+	logic_sim::FaultSimTool fault_sim;
+	logic_sim::EventSim timing; // event driven engine, used instead of sim.simulate if enabled
+	logic_sim::ToggleActivity activity;
+
+	// only create the parts of chips once they are viewed, placed or used by another chip when loading json
+	bool lazy_loading = true;
+
 	Game () {
 		
 	}
 
+	// exports leave unsaved_changes alone, it tracks debug.json which is what gets loaded on startup
+	bool export_library () {
+		sim.materialize_all();
+		return logic_sim::save_library_binary(sim, library_filepath.c_str());
+	}
+	bool save_split_library () {
+		return logic_sim::save_library_split(sim, split_library_dir);
+	}
+
+	// replaces all saved chips like loading debug.json does
+	bool import_library () {
+		logic_sim::LogicSim loaded;
+		if (!logic_sim::load_library_binary(library_filepath.c_str(), loaded))
+			return false;
+
+		replace_library(std::move(loaded));
+		return true;
+	}
+	bool load_split_library () {
+		logic_sim::LogicSim loaded;
+		if (!logic_sim::load_library_split(split_library_dir, loaded))
+			return false;
+
+		replace_library(std::move(loaded));
+		return true;
+	}
+	// adds the chips of the netlist to the library and views the top-level chip
+	bool import_netlist () {
+		netlist_import_warnings.clear();
+		auto top = logic_sim::import_netlist(sim, netlist_filepath, &netlist_import_error, &netlist_import_warnings);
+		if (!top)
+			return false;
+
+		netlist_import_error.clear();
+		sim_t = 1;
+		editor = {};
+		sim.switch_to_chip_view(top);
+		sim.adjust_camera_for_viewed_chip(cam);
+		return true;
+	}
+	void replace_library (logic_sim::LogicSim&& loaded) {
+		sim_t = 1;
+		tick_counter = 0;
+
+		editor = {}; // reset editor
+		sim = std::move(loaded);
+		sim.adjust_camera_for_viewed_chip(cam);
+	}
+
 	void imgui (Input& I) {
 		ZoneScoped;
 
@@ -51,6 +140,50 @@ struct Game {
 			
 			sim.imgui(I);
 
+			if (ImGui::TreeNodeEx("Binary Library")) {
+				ImGui::InputText("file", &library_filepath);
+
+				if (ImGui::Button("Export"))
+					export_library();
+				ImGui::SameLine();
+				if (ImGui::Button("Import"))
+					import_library();
+
+				ImGui::TreePop();
+			}
+			if (ImGui::TreeNodeEx("Split Library")) {
+				ImGui::InputText("directory", &split_library_dir);
+
+				if (ImGui::Button("Save"))
+					save_split_library();
+				ImGui::SameLine();
+				if (ImGui::Button("Load"))
+					load_split_library();
+
+				ImGui::TreePop();
+			}
+			if (ImGui::TreeNodeEx("Import Netlist")) {
+				ImGui::InputText("file##netlist", &netlist_filepath);
+
+				if (ImGui::Button("Import"))
+					import_netlist();
+
+				if (!netlist_import_error.empty())
+					ImGui::TextColored(ImVec4(1.00f, 0.20f, 0.20f, 1), "%s", netlist_import_error.c_str());
+				for (auto& w : netlist_import_warnings)
+					ImGui::TextColored(ImVec4(1.00f, 0.80f, 0.20f, 1), "%s", w.c_str());
+
+				ImGui::TreePop();
+			}
+			vcd.imgui(sim, editor);
+			waves.imgui(sim, editor);
+			checkpoints.imgui(sim, tick_counter);
+			tests.imgui(sim);
+			truth_table.imgui(sim);
+			equivalence.imgui(sim);
+			fault_sim.imgui(sim);
+			ImGui::Checkbox("Lazy Library Loading", &lazy_loading);
+
 			ImGui::Separator();
 
 			cam.imgui("View");
@@ -74,11 +207,18 @@ struct Game {
 				ImGui::SameLine();
 				ImGui::TextEx("Tick");
 			}
+			history.imgui(sim, tick_counter, sim_paused);
+			breakpoints.imgui(sim);
+			timing.imgui(sim, editor);
+			activity.imgui(sim);
+			sim.signals.imgui(sim);
 
 			ImGui::PopID();
 		}
 
 		editor.imgui(sim, cam);
+
+		waves.imgui_window();
 	}
 
 	IApp::ShouldClose close_confirmation (IApp* app) {
@@ -94,6 +234,15 @@ struct Game {
 		return IApp::ShouldClose::CLOSE_NOW;
 	}
 
+	// one tick of the selected engine
+	void simulate (Input& I) {
+		if (timing.enabled)
+			timing.simulate(sim);
+		else
+			sim.simulate(I);
+		activity.count(sim);
+	}
+
 	void update (Window& window, ogl::Renderer& r) {
 		ZoneScoped;
 
@@ -101,6 +250,10 @@ struct Game {
 
 		manual_tick = I.buttons['T'].went_down || manual_tick;
 		if (I.buttons[' '].went_down) sim_paused = !sim_paused;
+		if (I.buttons['B'].went_down) {
+			sim_paused = true;
+			history.step_back(sim, tick_counter);
+		}
 
 		r.view = cam.update(I, (float2)I.window_size);
 		
@@ -110,19 +263,34 @@ struct Game {
 			
 			for (int i=0; i<10 && sim_t >= 1.0f; ++i) {
 				
-				sim.simulate(I);
+				simulate(I);
+				vcd.capture(sim);
+				waves.capture(sim);
+				history.record(sim);
 				tick_counter++;
 				
 				sim_t -= 1.0f;
+
+				if (breakpoints.check(sim, tick_counter)) {
+					sim_paused = true;
+					sim_t = min(sim_t, 0.999f); // don't run the remaining ticks of this frame
+					break;
+				}
 			}
 			assert(sim_t >= 0.0f && sim_t < 1.0f);
 			
 			sim_t += I.dt * sim_freq;
 		}
 		else if (manual_tick) {
-			sim.simulate(I);
+			simulate(I);
+			vcd.capture(sim);
+			waves.capture(sim);
+			history.record(sim);
 			tick_counter++;
 
+			if (breakpoints.check(sim, tick_counter))
+				sim_paused = true;
+
 			sim_t = 0.5f;
 		}
 		manual_tick = false;
@@ -2,132 +2,93 @@
 #include "logic_sim.hpp"
 #include "game.hpp"
 #include "opengl/renderer.hpp"
+#include "parallel.hpp"
+#include "timing_analysis.hpp"
 
 namespace logic_sim {
 	
 ////
-void simulate_chip (Chip& chip, int state_base, uint8_t* cur, uint8_t* next) {
-		
-	int sid = state_base;
-	
-	for (auto& part : chip.outputs) {
-		assert(part->chip == &gates[OUT_PIN]);
-		assert(part->chip->state_count == 1);
-		
-		Part* src_a = part->inputs[0].part;
+void LogicSim::update_netlist () {
+	ZoneScoped;
 
-		if (!src_a) {
-			// keep prev state (needed to toggle gates via LMB)
-			next[sid] = cur[sid];
-		}
-		else {
-			bool new_state = src_a && cur[state_base + src_a->sid + part->inputs[0].pin] != 0;
-			
-			next[sid] = new_state;
-		}
+	uint64_t hash = structural_hash(*viewed_chip);
 
-		sid += 1;
+	// edits that don't change the structure (moving parts, renames, wire points) keep the netlist
+	if (netlist.hash == hash && netlist.state_count == viewed_chip->state_count) {
+		netlist_valid = true;
+		netlist_store = false;
+		return;
 	}
-	
-	// skip inputs which were updated by caller
-	sid += (int)chip.inputs.size();
-
-	for (auto& part : chip.parts) {
-		int input_count = (int)part->chip->inputs.size();
 
-		if (!is_gate(part->chip)) {
-			int output_count = (int)part->chip->outputs.size();
+	netlist_from_cache = !netlist_cache_dir.empty() && load_netlist_cache(netlist_cache_dir, hash, netlist) &&
+		netlist.state_count == viewed_chip->state_count;
+	if (!netlist_from_cache) {
+		netlist = flatten_chip(*viewed_chip);
 
-			for (int i=0; i<input_count; ++i) {
-				Part* src = part->inputs[i].part;
-					
-				uint8_t new_state;
+		if (netlist_store && !netlist_cache_dir.empty())
+			save_netlist_cache(netlist_cache_dir, netlist);
+	}
 
-				if (!src) {
-					// keep prev state (needed to toggle gates via LMB)
-					new_state = cur[sid + output_count + i] != 0;
-				}
-				else {
-					// read input connection
-					new_state = cur[state_base + src->sid + part->inputs[i].pin] != 0;
-					// write input part state
-				}
+	assert(netlist.state_count == viewed_chip->state_count);
+	netlist_valid = true;
+	netlist_store = false;
+}
 
-				next[sid + output_count + i] = new_state;
-			}
+// gates without connected inputs keep their (toggled) value, so they are known from the start
+static void mark_switches_known (Chip& chip, int state_base, uint8_t* xstate) {
+	for (auto& part : chip.parts) {
+		int sid = state_base + part->sid;
 
-			simulate_chip(*part->chip, sid, cur, next);
+		if (!is_gate(part->chip)) {
+			mark_switches_known(*part->chip, sid, xstate);
+			continue;
 		}
-		else {
-			auto type = gate_type(part->chip);
 
-			assert(type != INP_PIN && type != OUT_PIN);
-			
-			assert(part->chip->state_count == 1);
-			
-			// TODO: cache part_idx in input as well to avoid indirection
-			Part* src_a = input_count >= 1 ? part->inputs[0].part : nullptr;
-			Part* src_b = input_count >= 2 ? part->inputs[1].part : nullptr;
-			Part* src_c = input_count >= 3 ? part->inputs[2].part : nullptr;
-
-			if (!src_a && !src_b) {
-				// keep prev state (needed to toggle gates via LMB)
-				next[sid] = cur[sid];
-			}
-			else {
-				bool a = src_a && cur[state_base + src_a->sid + part->inputs[0].pin] != 0;
-				bool b = src_b && cur[state_base + src_b->sid + part->inputs[1].pin] != 0;
-				bool c = src_c && cur[state_base + src_c->sid + part->inputs[2].pin] != 0;
-					
-				uint8_t new_state;
-				switch (type) {
-					case BUF_GATE : new_state =  a;     break;
-					case NOT_GATE : new_state = !a;     break;
-					
-					case AND_GATE : new_state =   a && b;    break;
-					case NAND_GATE: new_state = !(a && b);   break;
-					
-					case OR_GATE  : new_state =   a || b;    break;
-					case NOR_GATE : new_state = !(a || b);   break;
-					
-					case XOR_GATE : new_state =   a != b;    break;
-
-					case AND3_GATE : new_state =   a && b && c;    break;
-					case NAND3_GATE: new_state = !(a && b && c);   break;
-					
-					case OR3_GATE  : new_state =   a || b || c;    break;
-					case NOR3_GATE : new_state = !(a || b || c);   break;
-
-					default: assert(false);
-				}
+		bool connected = false;
+		for (int i=0; i<(int)part->chip->inputs.size(); ++i)
+			connected = connected || part->inputs[i].part;
+		if (!connected)
+			xstate[sid] = 0;
+	}
+}
 
-				next[sid] = new_state;
-			}
+void LogicSim::reset_state () {
+	for (int i=0; i<2; ++i) {
+		state[i].assign(viewed_chip->state_count, 0);
 
-			// don't recurse
+		if (ternary) {
+			xstate[i].assign(viewed_chip->state_count, 1);
+			mark_switches_known(*viewed_chip, 0, xstate[i].data());
+		}
+		else {
+			xstate[i] = {};
 		}
-
-		sid += part->chip->state_count;
 	}
-	
-	assert(chip.state_count >= 0); // state_count stale!
-	assert(sid - state_base == chip.state_count); // state_count invalid!
+	state_generation++;
+	state_changed = true;
 }
 
 void LogicSim::simulate (Input& I) {
 	ZoneScoped;
+
+	if (!netlist_valid)
+		update_netlist();
 	
 	uint8_t* cur  = state[cur_state  ].data();
 	uint8_t* next = state[cur_state^1].data();
 
-	// keep prev state (needed to toggle gates via LMB)
-	for (auto& part : viewed_chip->inputs) {
-		next[part->sid] = cur[part->sid] != 0;
+	if (ternary) {
+		// x planes are stale after anything resized the state without knowing about ternary mode
+		if (xstate[0].size() != state[0].size())
+			reset_state();
+		netlist.simulate_ternary(cur, xstate[cur_state].data(), next, xstate[cur_state^1].data());
+	}
+	else {
+		netlist.simulate(cur, next);
 	}
-
-	simulate_chip(*viewed_chip, 0, cur, next);
 
 	cur_state ^= 1;
+	state_changed = true;
 }
 
 ////
@@ -181,12 +142,21 @@ Chip Chip::deep_copy () const {
 }
 
 void _add_user_to_chip_deps (Chip* chip, Chip* user) {
-	for (auto& p : chip->parts) {
-		if (!is_gate(p->chip)) {
-			// iterate unique recursive dependencies
-			if (p->chip->users.try_add(user)) {
-				_add_user_to_chip_deps(p->chip, user);
-			}
+	auto add_dep = [&] (Chip* dep) {
+		// iterate unique recursive dependencies
+		if (dep->users.try_add(user)) {
+			_add_user_to_chip_deps(dep, user);
+		}
+	};
+
+	if (chip->lazy) {
+		for (auto* dep : chip->lazy->deps)
+			add_dep(dep);
+	}
+	else {
+		for (auto& p : chip->parts) {
+			if (!is_gate(p->chip))
+				add_dep(p->chip);
 		}
 	}
 }
@@ -199,11 +169,9 @@ void LogicSim::recompute_chip_users () {
 	}
 }
 
-json part2json (LogicSim const& sim, Part& part, std::unordered_map<Part*, int>& part2idx) {
+json part2json (ChipSnapshot::PartData const& part) {
 	json j;
-	j["chip"] = is_gate(part.chip) ?
-			gate_type(part.chip) :
-			indexof_chip(sim.saved_chips, part.chip) + GATE_COUNT;
+	j["chip"] = part.chip;
 	
 	if (!part.name.empty())
 		j["name"] = part.name;
@@ -212,76 +180,183 @@ json part2json (LogicSim const& sim, Part& part, std::unordered_map<Part*, int>&
 	
 	auto& inputs = j["inputs"];
 
-	for (int i=0; i<part.chip->inputs.size(); ++i) {
+	for (auto& inp : part.inputs) {
 		json& ij = inputs.emplace_back();
 
-		ij["part_idx"] = part.inputs[i].part ? part2idx[part.inputs[i].part] : -1;
-		if (part.inputs[i].part) {
-			ij["pin_idx"] = part.inputs[i].pin;
+		ij["part_idx"] = inp.part_idx;
+		if (inp.part_idx >= 0) {
+			ij["pin_idx"] = inp.pin;
 
-			if (!part.inputs[i].wire_points.empty())
-				ij["wire_points"] = part.inputs[i].wire_points;
+			if (!inp.wire_points.empty())
+				ij["wire_points"] = inp.wire_points;
 		}
 	}
 
 	return j;
 }
-json chip2json (const Chip& chip, LogicSim const& sim) {
-	std::unordered_map<Part*, int> part2idx;
-	part2idx.reserve(chip.inputs.size() + chip.outputs.size() + chip.parts.size());
-	
-	int idx = 0;
-	for (auto& part : chip.outputs) {
-		part2idx[part.get()] = idx++;
-	}
-	for (auto& part : chip.inputs) {
-		part2idx[part.get()] = idx++;
-	}
-	for (auto& part : chip.parts) {
-		part2idx[part.get()] = idx++;
+json ChipSnapshot::to_json () const {
+	ZoneScoped;
+
+	if (lazy_src) {
+		// parts not loaded, write the json the chip was loaded from with chip ids remapped to deps
+		json j = lazy_src->chips[lazy_idx];
+
+		std::unordered_map<Chip*, int> dep2idx;
+		for (int i=0; i<(int)deps.size(); ++i)
+			dep2idx[deps[i]] = i;
+
+		for (auto* list : { "outputs", "inputs", "parts" }) {
+			for (auto& jpart : j.at(list)) {
+				int chip_id = jpart.at("chip");
+				if (chip_id >= GATE_COUNT)
+					jpart["chip"] = dep2idx.at(lazy_src->idx2chip[chip_id - GATE_COUNT]) + GATE_COUNT;
+			}
+		}
+		j["name"] = name;
+		j["col"]  = col;
+		j["size"] = size;
+		if (uid)
+			j["uid"] = uid;
+		return j;
 	}
-	
+
 	json jouts  = json::array();
 	json jinps  = json::array();
 	json jparts = json::array();
 
-	for (auto& part : chip.outputs) {
-		jouts.emplace_back( part2json(sim, *part, part2idx) );
-	}
-
-	for (auto& part : chip.inputs) {
-		jinps.emplace_back( part2json(sim, *part, part2idx) );
-	}
-
-	for (auto& part : chip.parts) {
-		jparts.emplace_back( part2json(sim, *part, part2idx) );
+	for (int i=0; i<(int)parts.size(); ++i) {
+		auto& list = i < output_count ? jouts : i < output_count + input_count ? jinps : jparts;
+		list.emplace_back( part2json(parts[i]) );
 	}
 	
 	json j = {
-		{"name",     chip.name},
-		{"col",      chip.col},
-		{"size",     chip.size},
+		{"name",     name},
+		{"col",      col},
+		{"size",     size},
 		{"inputs",   std::move(jinps)},
 		{"outputs",  std::move(jouts)},
 		{"parts",    std::move(jparts)},
 	};
+	if (uid) // stable id, see split library in chip_library.hpp
+		j["uid"] = uid;
 	return j;
 }
-void to_json (json& j, LogicSim const& sim) {
+std::shared_ptr<ChipSnapshot const> snapshot_chip (Chip& chip) {
+	if (chip.snapshot)
+		return chip.snapshot;
+
+	auto snap = std::make_shared<ChipSnapshot>();
+	snap->name = chip.name;
+	snap->col  = chip.col;
+	snap->size = chip.size;
+	snap->uid  = chip.uid;
+
+	// chip ids local to this chip
+	std::unordered_map<Chip*, int> dep2idx;
+	auto add_dep = [&] (Chip* dep) {
+		if (dep2idx.try_emplace(dep, (int)snap->deps.size()).second)
+			snap->deps.push_back(dep);
+	};
+	if (chip.lazy) {
+		for (auto* dep : chip.lazy->deps)
+			add_dep(dep);
+
+		snap->lazy_src = chip.lazy->src;
+		snap->lazy_idx = chip.lazy->idx;
+	}
+	else {
+		for (auto& part : chip.parts) {
+			if (!is_gate(part->chip))
+				add_dep(part->chip);
+		}
+
+		std::unordered_map<Part*, int> part2idx;
+		part2idx.reserve(chip.inputs.size() + chip.outputs.size() + chip.parts.size());
+		
+		int idx = 0;
+		for (auto& part : chip.outputs) part2idx[part.get()] = idx++;
+		for (auto& part : chip.inputs ) part2idx[part.get()] = idx++;
+		for (auto& part : chip.parts  ) part2idx[part.get()] = idx++;
+
+		snap->output_count = (int)chip.outputs.size();
+		snap->input_count  = (int)chip.inputs.size();
+		snap->parts.reserve(idx);
+
+		auto copy_part = [&] (Part& part) {
+			auto& p = snap->parts.emplace_back();
+			p.chip = is_gate(part.chip) ? gate_type(part.chip) : dep2idx.at(part.chip) + GATE_COUNT;
+			p.name = part.name;
+			p.pos  = part.pos;
+
+			p.inputs.resize(part.chip->inputs.size());
+			for (int i=0; i<(int)p.inputs.size(); ++i) {
+				auto& inp = part.inputs[i];
+				p.inputs[i].part_idx = inp.part ? part2idx[inp.part] : -1;
+				p.inputs[i].pin      = inp.pin;
+				if (inp.part)
+					p.inputs[i].wire_points = inp.wire_points;
+			}
+		};
+		for (auto& part : chip.outputs) copy_part(*part);
+		for (auto& part : chip.inputs ) copy_part(*part);
+		for (auto& part : chip.parts  ) copy_part(*part);
+	}
+
+	chip.snapshot = snap;
+	return snap;
+}
+
+LibrarySnapshot LogicSim::take_snapshot () const {
+	ZoneScoped;
+
+	LibrarySnapshot snap;
+	snap.viewed_chip = indexof_chip(saved_chips, viewed_chip.get());
+
+	snap.chips.reserve(saved_chips.size());
+	snap.chip2idx.reserve(saved_chips.size());
+	for (int i=0; i<(int)saved_chips.size(); ++i) {
+		snap.chips.emplace_back( snapshot_chip(*saved_chips[i]) );
+		snap.chip2idx[saved_chips[i].get()] = i;
+	}
+	return snap;
+}
+
+json LibrarySnapshot::to_json () const {
+	ZoneScoped;
 
-	j["viewed_chip"] = indexof_chip(sim.saved_chips, sim.viewed_chip.get());
+	json j;
+	j["viewed_chip"] = viewed_chip;
 
 	json& jchips = j["chips"];
-	for (auto& chip : sim.saved_chips) {
-		jchips.emplace_back( chip2json(*chip, sim) );
+	jchips = json::array();
+	for (auto& snap : chips) {
+		json jchip = snap->get_json();
+
+		// local chip ids to saved_chips indices
+		for (auto* list : { "outputs", "inputs", "parts" }) {
+			for (auto& jpart : jchip.at(list)) {
+				int chip_id = jpart.at("chip");
+				if (chip_id >= GATE_COUNT)
+					jpart["chip"] = chip2idx.at(snap->deps[chip_id - GATE_COUNT]) + GATE_COUNT;
+			}
+		}
+
+		jchips.emplace_back(std::move(jchip));
 	}
+	return j;
+}
 
-	// HACK: const-cast, only way around this would be not using const in json lib
-	//  or using global bool, which I want to avoid
-	((LogicSim&)sim).unsaved_changes = false;
+void to_json (json& j, LogicSim const& sim) {
+	// unsaved_changes is cleared by whoever actually writes the json to disk
+	if (sim.deferred_snapshot) {
+		*sim.deferred_snapshot = sim.take_snapshot();
+		j = nullptr;
+		return;
+	}
+	j = sim.take_snapshot().to_json();
 }
 
-Part* json2part (const json& j, LogicSim const& sim) {
+Part* json2part (const json& j, std::vector<Chip*> const& idx2chip) {
 	
 	int chip_id      = j.at("chip");
 	std::string name = j.contains("name") ? j.at("name") : "";
@@ -293,14 +368,14 @@ Part* json2part (const json& j, LogicSim const& sim) {
 		if (chip_id >= 0 && chip_id < GATE_COUNT)
 			part_chip = &gates[chip_id];
 		else if (chip_id >= 0)
-			part_chip = sim.saved_chips[chip_id - GATE_COUNT].get();
+			part_chip = idx2chip[chip_id - GATE_COUNT];
 	}
 
 	return new Part(part_chip, std::move(name), pos);
 }
 void json2links (const json& j, Part& part, std::vector<Part*>& idx2part) {
 	if (j.contains("inputs")) {
-		json inputsj = j.at("inputs");
+		json const& inputsj = j.at("inputs");
 		
 		assert(part.chip->inputs.size() == inputsj.size());
 		
@@ -320,7 +395,8 @@ void json2links (const json& j, Part& part, std::vector<Part*>& idx2part) {
 		}
 	}
 }
-void json2chip (const json& j, Chip& chip, LogicSim& sim) {
+// only writes to chip, so chips can be converted in parallel once all chips exist
+void json2chip (const json& j, Chip& chip, std::vector<Chip*> const& idx2chip) {
 	
 	auto& jouts = j.at("outputs");
 	auto& jinps = j.at("inputs");
@@ -336,15 +412,15 @@ void json2chip (const json& j, Chip& chip, LogicSim& sim) {
 	int idx = 0;
 	int out_idx = 0, inp_idx = 0;
 	for (auto& j : jouts) {
-		auto* ptr = idx2part[idx++] = json2part(j, sim);
+		auto* ptr = idx2part[idx++] = json2part(j, idx2chip);
 		chip.outputs[out_idx++] = std::unique_ptr<Part>(ptr);
 	}
 	for (auto& j : jinps) {
-		auto* ptr = idx2part[idx++] = json2part(j, sim);
+		auto* ptr = idx2part[idx++] = json2part(j, idx2chip);
 		chip.inputs[inp_idx++] = std::unique_ptr<Part>(ptr);
 	}
 	for (auto& j : jparts) {
-		auto* ptr = idx2part[idx++] = json2part(j, sim);
+		auto* ptr = idx2part[idx++] = json2part(j, idx2chip);
 		chip.parts.add(ptr);
 	}
 
@@ -360,31 +436,124 @@ void json2chip (const json& j, Chip& chip, LogicSim& sim) {
 		json2links(j, *idx2part[idx++], idx2part);
 	}
 }
-void from_json (const json& j, LogicSim& sim) {
+// lazy_src holds jchips if the chips should be loaded lazily
+void load_chips (const json& jchips, int viewed_chip_idx, LogicSim& sim, std::shared_ptr<LazySource> const& lazy_src) {
+	ZoneScoped;
+
 	// create chips without parts
-	for (auto& jchip : j["chips"]) {
+	std::vector<Chip*> idx2chip;
+	idx2chip.reserve(jchips.size());
+
+	for (auto& jchip : jchips) {
 		auto& chip = sim.saved_chips.emplace_back(std::make_unique<Chip>());
 		
 		chip->name    = jchip.at("name");
 		chip->col     = jchip.at("col");
 		chip->size    = jchip.at("size");
 
+		chip->uid     = jchip.value("uid", (uint64_t)0);
+
 		chip->outputs.resize(jchip.at("outputs").size());
 		chip->inputs .resize(jchip.at("inputs" ).size());
+
+		idx2chip.push_back(chip.get());
 	}
-	// then convert chip ids references in parts to valid chips
-	auto cur = sim.saved_chips.begin();
-	for (auto& jchip : j["chips"]) {
-		json2chip(jchip, *(*cur++), sim);
+
+	if (lazy_src) {
+		// keep json around and only record dependencies
+		lazy_src->idx2chip = idx2chip;
+
+		for (int i=0; i<(int)idx2chip.size(); ++i) {
+			auto lazy_chip = std::make_unique<LazyChip>();
+			lazy_chip->src = lazy_src;
+			lazy_chip->idx = i;
+
+			for (auto& jpart : jchips[i].at("parts")) {
+				int chip_id = jpart.at("chip");
+				if (chip_id >= GATE_COUNT) {
+					Chip* dep = idx2chip[chip_id - GATE_COUNT];
+					if (!contains(lazy_chip->deps, dep))
+						lazy_chip->deps.push_back(dep);
+				}
+			}
+
+			idx2chip[i]->lazy = std::move(lazy_chip);
+		}
+	}
+	else {
+		// then convert chip ids references in parts to valid chips, chips are independent now
+		worker_pool().parallel_for((int)idx2chip.size(), [&] (int i) {
+			json2chip(jchips[i], *idx2chip[i], idx2chip);
+		});
 	}
 
 	sim.recompute_chip_users();
 
-	int viewed_chip_idx = j["viewed_chip"];
 	if (viewed_chip_idx >= 0) {
 		sim.switch_to_chip_view( sim.saved_chips[viewed_chip_idx]);
 	}
 }
+void from_json (const json& j, LogicSim& sim) {
+	load_chips(j.at("chips"), j.at("viewed_chip"), sim, nullptr);
+}
+void from_json_lazy (json j, LogicSim& sim) {
+	int viewed_chip_idx = j.at("viewed_chip");
+
+	// take over the chips instead of copying them, libraries can be hundreds of MB
+	auto src = std::make_shared<LazySource>();
+	src->chips = std::move(j.at("chips"));
+	load_chips(src->chips, viewed_chip_idx, sim, src);
+}
+
+void materialize_chips (LogicSim& sim, std::vector<Chip*> const& chips) {
+	if (chips.empty())
+		return;
+	ZoneScoped;
+
+	worker_pool().parallel_for((int)chips.size(), [&] (int i) {
+		auto& chip = *chips[i];
+		auto& src = *chip.lazy->src;
+		json2chip(src.chips[chip.lazy->idx], chip, src.idx2chip);
+	});
+
+	for (auto* chip : chips)
+		chip->lazy = nullptr;
+
+	// users stay the same, but the new chips need state indices
+	sim.update_all_chip_state_indices();
+}
+
+void LogicSim::materialize (Chip& chip) {
+	std::vector<Chip*> pending;
+	std::unordered_set<Chip*> visited;
+
+	auto collect = [&] (Chip* c, auto& collect) -> void {
+		// materialized chips always have materialized dependencies
+		if (!c->lazy || !visited.insert(c).second)
+			return;
+		pending.push_back(c);
+
+		for (auto* dep : c->lazy->deps)
+			collect(dep, collect);
+	};
+	collect(&chip, collect);
+
+	materialize_chips(*this, pending);
+}
+void LogicSim::materialize_users (Chip& chip) {
+	for (auto* user : chip.users) {
+		if (user->lazy)
+			materialize(*user);
+	}
+}
+void LogicSim::materialize_all () {
+	std::vector<Chip*> pending;
+	for (auto& chip : saved_chips) {
+		if (chip->lazy)
+			pending.push_back(chip.get());
+	}
+	materialize_chips(*this, pending);
+}
 
 ////
 
@@ -411,15 +580,17 @@ void Editor::select_gate_imgui (LogicSim& sim, const char* name, Chip* type) {
 
 void Editor::viewed_chip_imgui (LogicSim& sim, Camera2D& cam) {
 
-	ImGui::InputText("name",  &sim.viewed_chip->name);
-	ImGui::ColorEdit3("col",  &sim.viewed_chip->col.x);
-	ImGui::DragFloat2("size", &sim.viewed_chip->size.x);
+	bool data_changed = false;
+	data_changed |= ImGui::InputText("name",  &sim.viewed_chip->name);
+	data_changed |= ImGui::ColorEdit3("col",  &sim.viewed_chip->col.x);
+	if (ImGui::DragFloat2("size", &sim.viewed_chip->size.x))
+		sim.chip_edited(*sim.viewed_chip);
 
 	if (ImGui::TreeNodeEx("Inputs")) {
 		for (int i=0; i<(int)sim.viewed_chip->inputs.size(); ++i) {
 			ImGui::PushID(i);
 			ImGui::SetNextItemWidth(ImGui::CalcItemWidth() * 0.5f);
-			ImGui::InputText(prints("Input Pin #%d###name", i).c_str(), &sim.viewed_chip->inputs[i]->name);
+			data_changed |= ImGui::InputText(prints("Input Pin #%d###name", i).c_str(), &sim.viewed_chip->inputs[i]->name);
 			ImGui::PopID();
 		}
 		ImGui::TreePop();
@@ -428,12 +599,20 @@ void Editor::viewed_chip_imgui (LogicSim& sim, Camera2D& cam) {
 		for (int i=0; i<(int)sim.viewed_chip->outputs.size(); ++i) {
 			ImGui::PushID(i);
 			ImGui::SetNextItemWidth(ImGui::CalcItemWidth() * 0.5f);
-			ImGui::InputText(prints("Output Pin #%d###name", i).c_str(), &sim.viewed_chip->outputs[i]->name);
+			data_changed |= ImGui::InputText(prints("Output Pin #%d###name", i).c_str(), &sim.viewed_chip->outputs[i]->name);
 			ImGui::PopID();
 		}
 		ImGui::TreePop();
 	}
 
+	if (ImGui::TreeNodeEx("Timing")) {
+		chip_timing_imgui(sim, *sim.viewed_chip, show_critical_path);
+		ImGui::TreePop();
+	}
+
+	if (data_changed)
+		sim.chip_data_edited(*sim.viewed_chip);
+
 	ImGui::Separator();
 	int users = sim.viewed_chip->users.size();
 
@@ -555,6 +734,7 @@ void Editor::saved_chips_imgui (LogicSim& sim, Camera2D& cam) {
 					}
 					else if (can_place) {
 						if (selected) {
+							sim.materialize(*chip);
 							mode = PlaceMode{ { chip.get(), {} } };
 						}
 						else {
@@ -619,7 +799,7 @@ void Editor::saved_chips_imgui (LogicSim& sim, Camera2D& cam) {
 	//}
 }
 
-void Editor::selection_imgui (PartSelection& sel) {
+void Editor::selection_imgui (LogicSim& sim, PartSelection& sel) {
 	ImGui::Text("%d Item selected", (int)sel.items.size());
 
 	auto& part = *sel.items[0].part;
@@ -629,16 +809,22 @@ void Editor::selection_imgui (PartSelection& sel) {
 
 	ImGui::Text("First Selected: %s Instance", part.chip->name.c_str());
 
-	ImGui::InputText("name",          &part.name);
+	if (ImGui::InputText("name",      &part.name))
+		sim.chip_data_edited(*sel.chip.ptr);
 
 	ImGui::Text("Placement in parent chip:");
 
+	bool changed = false;
+
 	int rot = (int)part.pos.rot;
-	ImGui::DragFloat2("pos",          &part.pos.pos.x, 0.1f);
-	ImGui::SliderInt("rot [R]",       &rot, 0, 3);
-	ImGui::Checkbox("mirror (X) [M]", &part.pos.mirror);
-	ImGui::DragFloat("scale",         &part.pos.scale, 0.1f, 0.001f, 100.0f);
+	changed |= ImGui::DragFloat2("pos",          &part.pos.pos.x, 0.1f);
+	changed |= ImGui::SliderInt("rot [R]",       &rot, 0, 3);
+	changed |= ImGui::Checkbox("mirror (X) [M]", &part.pos.mirror);
+	changed |= ImGui::DragFloat("scale",         &part.pos.scale, 0.1f, 0.001f, 100.0f);
 	part.pos.rot = (short)rot;
+
+	if (changed)
+		sim.chip_edited(*sel.chip.ptr);
 }
 
 void Editor::imgui (LogicSim& sim, Camera2D& cam) {
@@ -672,7 +858,7 @@ void Editor::imgui (LogicSim& sim, Camera2D& cam) {
 						ImGui::Text("Nothing selected");
 					}
 					else {
-						selection_imgui(e.sel);
+						selection_imgui(sim, e.sel);
 					}
 				}
 			}
@@ -748,6 +934,16 @@ void Editor::imgui (LogicSim& sim, Camera2D& cam) {
 	}
 }
 
+void saved_chip_combo (const char* label, LogicSim& sim, std::string& name) {
+	if (ImGui::BeginCombo(label, name.c_str())) {
+		for (auto& chip : sim.saved_chips) {
+			if (ImGui::Selectable(chip->name.c_str(), chip->name == name))
+				name = chip->name;
+		}
+		ImGui::EndCombo();
+	}
+}
+
 void delete_subpart_popup (bool open) {
 	if (open) {
 		ImGui::OpenPopup("POPUP_DeleteSubpart");
@@ -771,6 +967,8 @@ void Editor::add_part (LogicSim& sim, Chip& chip, PartPreview& part) {
 	else if (part.chip == &gates[INP_PIN]) {
 		// insert input at end of inputs list
 		
+		sim.materialize_users(chip);
+
 		// resize input array of every part of this chip type
 		int count = (int)chip.inputs.size();
 		for (auto& schip : sim.saved_chips) {
@@ -798,12 +996,12 @@ void Editor::add_part (LogicSim& sim, Chip& chip, PartPreview& part) {
 	sim.update_all_chip_state_indices();
 
 	// TODO
-	for (int i=0; i<2; ++i)
-		sim.state[i].assign(sim.viewed_chip->state_count, 0);
+	sim.reset_state();
 	
 	sim.recompute_chip_users();
 	
-	sim.unsaved_changes = true;
+	sim.chip_edited(chip);
+	sim.state_changed = true;
 }
 void Editor::remove_part (LogicSim& sim, Chip* chip, Part* part) {
 	assert(chip == sim.viewed_chip.get());
@@ -828,6 +1026,8 @@ void Editor::remove_part (LogicSim& sim, Chip* chip, Part* part) {
 		int idx = indexof(chip->outputs, part, Partptr_equal());
 		assert(idx >= 0);
 		
+		sim.materialize_users(*chip);
+		
 		// remove wires to this chip output pin in all chips using this chip as a part
 		for (auto& schip : sim.saved_chips) {
 			for (auto& p : schip->parts) {
@@ -844,6 +1044,8 @@ void Editor::remove_part (LogicSim& sim, Chip* chip, Part* part) {
 	else if (part->chip == &gates[INP_PIN]) {
 		int idx = indexof(chip->inputs, part, Partptr_equal());
 		assert(idx >= 0);
+		
+		sim.materialize_users(*chip);
 	
 		// resize input array of every part of this chip type
 		int count = (int)chip->inputs.size();
@@ -864,12 +1066,12 @@ void Editor::remove_part (LogicSim& sim, Chip* chip, Part* part) {
 	sim.update_all_chip_state_indices();
 
 	// TODO
-	for (int i=0; i<2; ++i)
-		sim.state[i].assign(sim.viewed_chip->state_count, 0);
+	sim.reset_state();
 
 	sim.recompute_chip_users();
 
-	sim.unsaved_changes = true;
+	sim.chip_edited(*chip);
+	sim.state_changed = true;
 }
 
 void Editor::add_wire (LogicSim& sim, Chip* chip, WireConn src, WireConn dst, std::vector<float2>&& wire_points) {
@@ -881,7 +1083,7 @@ void Editor::add_wire (LogicSim& sim, Chip* chip, WireConn src, WireConn dst, st
 
 	dst.part->inputs[dst.pin] = { src.part, src.pin, std::move(wire_points) };
 
-	sim.unsaved_changes = true;
+	sim.chip_edited(*chip);
 }
 void Editor::remove_wire (LogicSim& sim, Chip* chip, WireConn dst) {
 
@@ -896,19 +1098,22 @@ void Editor::remove_wire (LogicSim& sim, Chip* chip, WireConn dst) {
 
 	dst.part->inputs[dst.pin] = {};
 
-	sim.unsaved_changes = true;
+	sim.chip_edited(*chip);
 }
 
-void edit_placement (LogicSim& sim, Input& I, Placement& p, float2 center=0) {
+// returns true if placement was changed
+bool edit_placement (Input& I, Placement& p, float2 center=0) {
+	bool changed = false;
 	if (I.buttons['R'].went_down) {
 		int dir = I.buttons[KEY_LEFT_SHIFT].is_down ? -1 : +1;
 		p.rotate_around(center, dir);
-		sim.unsaved_changes = true;
+		changed = true;
 	}
 	if (I.buttons['M'].went_down) {
 		p.mirror_around(center);
-		sim.unsaved_changes = true;
+		changed = true;
 	}
+	return changed;
 }
 
 constexpr float part_text_sz = 20;
@@ -920,6 +1125,7 @@ constexpr lrgba named_part_col  = lrgba(0.3f, 0.2f, 1, 1);
 constexpr lrgba hover_col       = lrgba(0.3f, 0.2f, 1, 1);
 constexpr lrgba sel_col         = lrgba(0, 1, 1, 1);
 constexpr lrgba multisel_col    = lrgba(0, 1, 1, 0.5f);
+constexpr lrgba critical_col    = lrgba(1, 0.5f, 0, 1);
 
 std::string_view part_name (Part& part, std::string& buf) {
 	if (part.chip == &gates[OUT_PIN] || part.chip == &gates[INP_PIN])
@@ -961,43 +1167,101 @@ void highlight_chip_names (ogl::Renderer& r, Chip& chip, float2x3 const& chip2wo
 	}
 }
 
+void update_hitboxes (Chip& chip) {
+	auto& hb = chip.hitboxes;
+	if (hb.valid)
+		return;
+	ZoneScoped;
+
+	hb.boxes.clear();
+
+	std::vector<float> pin_x, pin_y;
+
+	auto add_part = [&] (Part& part) {
+		auto add_pins = [&] (std::vector<std::unique_ptr<Part>> const& pins, bool inp) {
+			// pin centers in part space, transformed to chip space in one batch
+			int count = (int)pins.size();
+			pin_x.assign(soa_padded(count), 0);
+			pin_y.assign(soa_padded(count), 0);
+			for (int i=0; i<count; ++i) {
+				float2 pos = inp ? get_inp_pos(*pins[i]) : get_out_pos(*pins[i]);
+				pin_x[i] = pos.x;
+				pin_y[i] = pos.y;
+			}
+
+			transform_points(part.pos.calc_matrix(), pin_x.data(), pin_y.data(), pin_x.data(), pin_y.data(), count);
+
+			for (int i=0; i<count; ++i)
+				hb.boxes.add(float2(pin_x[i], pin_y[i]), PIN_SIZE*0.5f * pins[i]->pos.scale * part.pos.scale);
+		};
+
+		if (part.chip != &gates[OUT_PIN])
+			add_pins(part.chip->outputs, false);
+		if (part.chip != &gates[INP_PIN])
+			add_pins(part.chip->inputs, true);
+
+		auto aabb = part.get_aabb();
+		hb.boxes.add((aabb.lo + aabb.hi) * 0.5f, (aabb.hi - aabb.lo) * 0.5f);
+	};
+
+	for (auto& part : chip.outputs) {
+		add_part(*part);
+	}
+	for (auto& part : chip.inputs) {
+		add_part(*part);
+	}
+	for (auto& part : chip.parts) {
+		add_part(*part);
+	}
+
+	hb.hits.resize(hb.boxes.lo_x.size());
+	hb.valid = true;
+}
+
 // find last (depth first search) hovered part or pin, where pins have priority over parts
 void Editor::find_hover (Chip& chip, SelectInput& I,
 		float2x3 const& chip2world, float2x3 const& world2chip, int state_base) {
+	assert(_cursor_valid);
 
 	// state index
 	int sid = state_base;
 
 	auto chip_id = ChipInstanceID{ &chip, state_base };
 	
+	// test all pins and parts of this chip at once, then apply the hits in traversal order
+	update_hitboxes(chip);
+	auto& hb = chip.hitboxes;
+
+	int hit_count = hit_test_boxes(hb.boxes, world2chip * _cursor_pos, hb.hits.data());
+	int box = 0;
+
 	auto edit_part = [&] (Part& part) {
-		auto part2world = chip2world * part.pos.calc_matrix();
-		auto world2part = part.pos.calc_inv_matrix() * world2chip;
+		int out_count = part.chip != &gates[OUT_PIN] ? (int)part.chip->outputs.size() : 0;
+		int inp_count = part.chip != &gates[INP_PIN] ? (int)part.chip->inputs.size() : 0;
+
+		uint8_t const* out_hits = &hb.hits[box];
+		uint8_t const* inp_hits = out_hits + out_count;
+		bool part_hit = inp_hits[inp_count];
+
+		box += out_count + inp_count + 1;
 		
 		// only hover parts that are part of the desired chip instance
-		if (!I.only_chip || I.only_chip == chip_id) {
+		if (hit_count > 0 && (!I.only_chip || I.only_chip == chip_id)) {
 			// check part pins for hover
 			if (I.allow_pins) {
-				if (part.chip != &gates[OUT_PIN]) {
-					for (int i=0; i<(int)part.chip->outputs.size(); ++i) {
-						if (hitbox(PIN_SIZE, get_out_pos_invmat(*part.chip->outputs[i]) * world2part))
-							hover = { Hover::PIN_OUT, chip_id, &part, i, chip2world, world2chip };
-					}
+				for (int i=0; i<out_count; ++i) {
+					if (out_hits[i])
+						hover = { Hover::PIN_OUT, chip_id, &part, i, chip2world, world2chip };
 				}
-				if (part.chip != &gates[INP_PIN]) {
-					for (int i=0; i<(int)part.chip->inputs.size(); ++i) {
-						if (hitbox(PIN_SIZE, get_inp_pos_invmat(*part.chip->inputs[i]) * world2part))
-							hover = { Hover::PIN_INP, chip_id, &part, i, chip2world, world2chip };
-					}
+				for (int i=0; i<inp_count; ++i) {
+					if (inp_hits[i])
+						hover = { Hover::PIN_INP, chip_id, &part, i, chip2world, world2chip };
 				}
 			}
-		
-			// check part hitbox
-			//bool hit = hitbox(part.chip->size, world2part);
 
 			// hover part if hitbox hit and _not_ yet hovering a pin (pins act as a prioritized layer for hovering)
 			bool hovering_pin = hover.type == Hover::PIN_OUT || hover.type == Hover::PIN_INP;
-			if (I.allow_parts && !hovering_pin && hitbox(part.chip->size, world2part))
+			if (I.allow_parts && !hovering_pin && part_hit)
 				hover = { Hover::PART, chip_id, &part, -1, chip2world, world2chip };
 		}
 
@@ -1005,6 +1269,9 @@ void Editor::find_hover (Chip& chip, SelectInput& I,
 		// I.only_chip != &chip: if only allow this part we don't need to recurse further
 		//if (hit && !is_gate(part.chip)) { // optimization
 		if (!is_gate(part.chip)) {
+			auto part2world = chip2world * part.pos.calc_matrix();
+			auto world2part = part.pos.calc_inv_matrix() * world2chip;
+
 			find_hover(*part.chip, I, part2world, world2part, sid);
 		}
 
@@ -1125,7 +1392,7 @@ void Editor::update (Input& I, LogicSim& sim, ogl::Renderer& r) {
 	if (in_mode<PlaceMode>()) {
 		auto& preview_part = std::get<PlaceMode>(mode).preview_part;
 		
-		edit_placement(sim, I, preview_part.pos);
+		edit_placement(I, preview_part.pos); // preview is redrawn every frame
 		
 		if (_cursor_valid) {
 			
@@ -1172,7 +1439,7 @@ void Editor::update (Input& I, LogicSim& sim, ogl::Renderer& r) {
 			else if (hover.type == Hover::PIN_INP || hover.type == Hover::PIN_OUT) {
 				if (!shift && !ctrl) {
 
-					mode = WireMode{ hover.chip, hover.world2chip,
+					mode = WireMode{ hover.chip, hover.chip2world, hover.world2chip,
 						hover.type == Hover::PIN_INP, { hover.part, hover.pin } };
 			
 					if (hover.type == Hover::PIN_INP && hover.part->inputs[hover.pin].part)
@@ -1331,7 +1598,7 @@ void Editor::update (Input& I, LogicSim& sim, ogl::Renderer& r) {
 							for (auto& item : e.sel.items)
 								item.part->pos.pos = item.bounds_offs + bounds_center;
 
-							sim.unsaved_changes = true;
+							sim.chip_edited(*e.sel.chip.ptr);
 						}
 					}
 					// stop dragging gate
@@ -1342,9 +1609,12 @@ void Editor::update (Input& I, LogicSim& sim, ogl::Renderer& r) {
 			}
 
 			// TODO: rotate around mouse cursor when dragging?
+			bool placement_changed = false;
 			for (auto& i : e.sel.items) {
-				edit_placement(sim, I, i.part->pos, bounds_center);
+				placement_changed |= edit_placement(I, i.part->pos, bounds_center);
 			}
+			if (placement_changed)
+				sim.chip_edited(*e.sel.chip.ptr);
 
 			// Duplicate selected part with CTRL+C
 			// TODO: CTRL+D moves the camera to the right, change that?
@@ -1426,6 +1696,17 @@ void Editor::update (Input& I, LogicSim& sim, ogl::Renderer& r) {
 	
 //// Highlights
 	highlight_chip_names(r, *sim.viewed_chip, float2x3::identity());
+
+	if (show_critical_path) {
+		auto& t = chip_timing(sim, *sim.viewed_chip);
+
+		for (auto* part : t.critical_path)
+			r.draw_highlight_box(part->chip->size, part->pos.calc_matrix(), critical_col);
+		if (!t.critical_path.empty()) {
+			auto* end = t.critical_path.back();
+			r.draw_highlight_text(end->chip->size, end->pos.calc_matrix(), prints("%d ticks", t.depth), part_text_sz, critical_col);
+		}
+	}
 	
 	if (in_mode<EditMode>()) {
 		auto& e = std::get<EditMode>(mode);
@@ -1497,6 +1778,9 @@ void Editor::update_toggle_gate (Input& I, LogicSim& sim, Window& window) {
 		}
 		if (v.toggle_sid >= 0) {
 			sim.state[sim.cur_state][v.toggle_sid] = v.state_toggle_value;
+			if (sim.ternary)
+				sim.xstate[sim.cur_state][v.toggle_sid] = 0;
+			sim.state_changed = true;
 	
 			if (I.buttons[MOUSE_BUTTON_LEFT].went_up)
 				v.toggle_sid = -1;
@@ -2,9 +2,11 @@
 #include "common.hpp"
 #include "camera.hpp"
 #include "opengl/renderer.hpp"
+#include "soa_kernels.hpp"
 
 #include <variant>
 #include <unordered_set>
+#include <mutex>
 
 namespace ogl { struct Renderer; }
 
@@ -285,6 +287,85 @@ namespace logic_sim {
 		};
 	};
 
+	// Pin and part hitboxes of a chip in chip space, so hovering can test all of them in one batch, see Editor::find_hover
+	// boxes are in hover traversal order: for each part (outputs, inputs, parts) its output pins, input pins, then the part itself
+	struct ChipHitboxes {
+		SoABoxes boxes;
+		std::vector<uint8_t> hits; // result of last hit_test_boxes, only used during find_hover
+
+		bool valid = false;
+	};
+
+	// Chips of a lazily loaded json library, a chip only gets its parts created once it is needed, see LogicSim::materialize
+	struct LazySource {
+		json chips; // "chips" array of the loaded json
+		std::vector<Chip*> idx2chip; // chip ids at load time
+	};
+	struct LazyChip {
+		std::shared_ptr<LazySource const> src;
+		int idx; // into src->chips
+
+		std::vector<Chip*> deps; // custom chips used as parts, to compute users without creating the parts
+	};
+
+	// Immutable serialized chip, parts reference custom chips by index into deps (+ GATE_COUNT) instead of the saved_chips index,
+	// so it stays valid when saved_chips is reordered
+	// taking the snapshot only copies the plain data of the chip (on the main thread, while nothing edits it),
+	// the json is built on the first get_json() call, which is usually on the autosave thread
+	struct ChipSnapshot {
+		std::vector<Chip*> deps;
+
+		struct PartData {
+			int         chip; // gate type or GATE_COUNT + index into deps
+			std::string name;
+			Placement   pos;
+
+			struct InputData {
+				int part_idx; // -1 if unconnected
+				int pin;
+				std::vector<float2> wire_points;
+			};
+			std::vector<InputData> inputs;
+		};
+
+		std::string name;
+		lrgb        col;
+		float2      size;
+		uint64_t    uid;
+
+		int output_count = 0;
+		int input_count  = 0;
+		std::vector<PartData> parts; // outputs, inputs, then parts like in the json
+
+		// parts of a chip that was never materialized are still in the json it was loaded from
+		std::shared_ptr<LazySource const> lazy_src;
+		int lazy_idx = -1;
+
+		// thread safe
+		json const& get_json () const {
+			std::call_once(converted, [this] () { j = to_json(); });
+			return j;
+		}
+
+	private:
+		mutable std::once_flag converted;
+		mutable json j;
+
+		json to_json () const;
+	};
+	// Immutable snapshot of all saved chips, can be converted to json on any thread while the chips keep being edited
+	struct LibrarySnapshot {
+		std::vector<std::shared_ptr<ChipSnapshot const>> chips;
+		std::unordered_map<Chip*, int> chip2idx;
+		int viewed_chip = -1;
+
+		// same format as to_json(LogicSim)
+		json to_json () const;
+	};
+
+	// Path delays of a chip, see timing_analysis.hpp
+	struct ChipTiming;
+
 	// A chip design that can be edited or simulated if viewed as the "global" chip
 	// Uses other chips as parts, which are instanced into it's own editing or simulation
 	// (but cannot use itself as part because this would cause infinite recursion)
@@ -307,6 +388,27 @@ namespace logic_sim {
 
 		VectorSet<Chip*> users;
 		
+		// not null while parts are not loaded yet (lazy loading), name, col, size and pin counts are always valid
+		std::unique_ptr<LazyChip> lazy;
+
+		// cached gates and wires of this chip in chip space, drawn once per placed instance of this chip
+		// invalidated via LogicSim::chip_edited, rebuilt lazily by the renderer
+		ogl::ChipMesh mesh;
+		// cached like mesh
+		ChipHitboxes hitboxes;
+		// last serialized version of this chip, shared with in-flight saves, reset when chip is edited
+		std::shared_ptr<ChipSnapshot const> snapshot;
+
+		// split library (one file per chip, see chip_library.hpp)
+		uint64_t uid = 0; // stable id used as file name and for references between chip files, 0 until first saved
+		uint64_t file_hash = 0; // content hash of chip file on disk
+		std::shared_ptr<ChipSnapshot const> file_snapshot; // snapshot that file_hash was computed from
+
+		// hash of the simulated structure of this chip and its dependencies (not names or positions), keys the netlist cache
+		uint64_t struct_hash = 0; // 0 if stale
+		// static path delays, null if stale (see chip_timing)
+		std::shared_ptr<ChipTiming const> timing;
+		
 		// TODO: store set of direct users of chip as chip* -> usecount hashmap
 		// adding a chip a as a part inside a chip c is a->users[c]++
 		// this can be iterated to find if chip can be placed
@@ -485,6 +587,106 @@ namespace logic_sim {
 	}
 	
 ////
+	// The viewed chip flattened into one node per state index, each computing the next state of its index from the current states
+	// produces exactly the same states as walking the part tree, but simulates in a few tight loops over plain arrays
+	// nodes are grouped by gate type, pins are BUF_GATE nodes (they delay by one tick like buffers)
+	struct Netlist {
+		struct Node {
+			int32_t dst;
+			int32_t src[3]; // -1 if unconnected (reads as 0)
+		};
+
+		uint64_t hash = 0; // struct_hash of the flattened chip
+		int state_count = 0;
+		std::vector<Node> nodes[GATE_COUNT];
+		// states that keep their previous value (needed to toggle gates via LMB): unconnected pins and gates, viewed chip inputs
+		std::vector<int32_t> keep;
+
+		int node_count () const {
+			int count = 0;
+			for (auto& n : nodes)
+				count += (int)n.size();
+			return count;
+		}
+
+		void simulate (uint8_t const* cur, uint8_t* next) const;
+		// same as simulate, but every state is 64 independent lanes (one bit each), to simulate 64 input combinations at once
+		void simulate_lanes (uint64_t const* cur, uint64_t* next) const;
+		// three valued (0/1/X) simulate, x planes are 1 where the value is unknown (value plane is 0 there)
+		// X propagates unless a known input dominates (0 AND X = 0, 1 OR X = 1), unconnected gate inputs still read as 0
+		// while unconnected pins keep their value and so stay X until driven
+		void simulate_ternary (uint8_t const* cur, uint8_t const* cur_x, uint8_t* next, uint8_t* next_x) const;
+	};
+
+	// Netlist nodes in dependency order, for analyses that evaluate every node once instead of simulating ticks
+	// a node's level is its longest path in gates from states that are not nodes (inputs, kept states)
+	struct NetlistOrder {
+		struct Entry {
+			GateType type;
+			int32_t  node; // index into Netlist::nodes[type]
+		};
+		std::vector<Entry>   order;  // sources first, nodes on or behind cycles are missing
+		std::vector<int32_t> level;  // per state index, 0 for states that are not nodes
+		int  max_level = 0;
+		bool cyclic = false;
+	};
+	NetlistOrder order_netlist (Netlist const& nl);
+
+	// compute (cached) Chip::struct_hash, state indices of chip and its dependencies need to be valid
+	uint64_t structural_hash (Chip& chip);
+	Netlist flatten_chip (Chip& chip);
+
+	// Netlist cache: flattened netlists stored as <dirpath>/<struct hash>.netlist, so big chips don't have to be flattened again
+	// the hash covers all dependencies, so editing any chip changes the hash of everything using it and stale entries are never hit
+	bool load_netlist_cache (std::string const& dirpath, uint64_t hash, Netlist& netlist);
+	bool save_netlist_cache (std::string const& dirpath, Netlist const& netlist);
+
+	struct LogicSim;
+	// flatten any chip (not just the viewed one) for analysis, materializes it if needed and uses the netlist cache of sim
+	// call on main thread, the result can be used on any thread
+	Netlist flatten_saved_chip (LogicSim& sim, Chip& chip);
+
+////
+	// Hierarchical path of every state index of the viewed chip, to address states by name without walking the part tree
+	// paths are '.' seperated like trace signals: pins of the viewed chip by pin name (or in<i>/out<i>),
+	// parts by Part::name (or <chip name>_<sid> with sid relative to their parent), the states of a subchip below its scope,
+	// eg. "cpu.alu.adder3.cout" is the output pin cout of subchip adder3, lookups also accept '/' as seperator
+	// custom parts with a single output can also be found by the part path alone, like in trace signals
+	// rebuilt on the first access after the viewed chip, any names or state indices changed (see LogicSim::names_version)
+	struct SignalIndex {
+		// state index of a path, -1 if there is none, O(1)
+		int32_t find (LogicSim& sim, std::string_view path);
+		// path of a state index, O(1)
+		std::string_view path (LogicSim& sim, int32_t sid);
+
+		// sids in path order, pattern is a prefix unless it contains wildcards, then it has to match the whole path
+		// with * for any characters and ? for one character, returns false if there were more than max_results matches
+		bool search (LogicSim& sim, std::string_view pattern, std::vector<int32_t>& sids, int max_results=INT_MAX);
+
+		int duplicates = 0; // paths that exist more than once (parts with the same name in one chip), only the first is found
+
+		void imgui (LogicSim& sim);
+
+	private:
+		std::string names; // paths of all sids concatenated
+		std::vector<uint32_t> offsets; // path of sid is names[offsets[sid], offsets[sid+1])
+		std::vector<int32_t> sorted; // sids sorted by path, for prefix search
+		std::unordered_map<std::string_view, int32_t> sid_of; // includes the paths of single output parts
+
+		Chip*    chip = nullptr;
+		uint64_t version = 0;
+		bool     valid = false;
+
+		std::string pattern; // search ui
+		std::vector<int32_t> results;
+		bool more_results = false;
+
+		void update (LogicSim& sim);
+		std::string_view get (int32_t sid) const {
+			return std::string_view(names).substr(offsets[sid], offsets[sid+1] - offsets[sid]);
+		}
+	};
+
 	struct LogicSim {
 		
 		// (de)serialize a chip to json, translating between gate and custom chip pointers and a single integer id
@@ -492,10 +694,13 @@ namespace logic_sim {
 		friend void from_json (const json& j, Chip& chip, LogicSim& sim);
 
 		// (de)serialize all saved chips (if the viewed_chip is not saved as a new chip it will be deleted, TODO: add warning?)
-		// simulation state is never (de)serialized
+		// simulation state is never (de)serialized, see checkpoint.hpp for saving it separately
 		// editor state is never (de)serialized
 		friend void to_json (json& j, const LogicSim& sim);
 		friend void from_json (const json& j, LogicSim& sim);
+		// like from_json, but only creates the parts of the viewed chip and its dependencies, others are materialized when needed
+		// keeps the "chips" json around, pass it as an rvalue to avoid a copy
+		friend void from_json_lazy (json j, LogicSim& sim);
 
 
 		std::vector<std::shared_ptr<Chip>> saved_chips;
@@ -505,8 +710,56 @@ namespace logic_sim {
 		std::vector<uint8_t> state[2];
 
 		int cur_state = 0;
+		// incremented when both state buffers are overwritten from outside a sim tick (reset, checkpoint restore, time travel seek),
+		// so engines that patch the buffers incrementally know to resync (see EventSim)
+		uint64_t state_generation = 0;
+
+		// Ternary (0/1/X) simulation: xstate is a second byte plane next to state, 1 where the value is unknown (state is 0 there)
+		// states start as X except gates without any connected input, which are switches (or imported constants) starting at 0
+		// toggling a gate makes it known, checkpoints and history store both planes, other tools (waves, vcd) only see the value plane
+		bool ternary = false;
+		std::vector<uint8_t> xstate[2];
+
+		// all states 0, or X in ternary mode
+		void reset_state ();
+		void set_ternary (bool enable) {
+			ternary = enable;
+			reset_state();
+		}
+		// states of viewed chip outputs that are still X
+		int unknown_outputs () const {
+			int count = 0;
+			if (ternary && !xstate[cur_state].empty()) {
+				for (auto& pin : viewed_chip->outputs)
+					count += xstate[cur_state][pin->sid];
+			}
+			return count;
+		}
 
 		bool unsaved_changes = false;
+
+		// directory the saved chips were last saved to or loaded from as split library, where Chip::file_hash is valid
+		std::string split_library_dir;
+
+		// Dirty flags so the renderer can keep its gpu buffers around instead of rebuilding them every frame, reset by the renderer
+		// layout_changed: any edit that changes how the viewed chip is drawn (parts, wires, placements, chip size)
+		// state_changed:  state[] was written (sim tick, gate toggle, state reset)
+		bool layout_changed = true;
+		bool state_changed  = true;
+
+		// incremented by anything that can change the paths of the viewed chip (part and pin names, state indices, view switches)
+		uint64_t names_version = 0;
+		SignalIndex signals;
+
+		// flattened viewed chip used by simulate, rebuilt on the next tick after the viewed chip or any dependency was edited
+		Netlist netlist;
+		bool netlist_valid = false;
+		// only store netlists in the cache after switching views, not after every edit, which would flood the cache with stale entries
+		bool netlist_store = false;
+		bool netlist_from_cache = false;
+		std::string netlist_cache_dir = "netlist_cache"; // empty disables the cache
+
+		void update_netlist ();
 		
 		static int update_state_indices (Chip& chip) {
 			// state count cached, early out
@@ -537,23 +790,123 @@ namespace logic_sim {
 				c->state_count = -1;
 			viewed_chip->state_count = -1;
 
-			for (auto& c : saved_chips)
-				update_state_indices(*c);
+			for (auto& c : saved_chips) {
+				if (!c->lazy) // can't count states without parts, recomputed when materialized
+					update_state_indices(*c);
+			}
 			update_state_indices(*viewed_chip);
+			names_version++;
 		}
 		void recompute_chip_users ();
 
+		Chip* find_saved_chip (std::string_view name) {
+			for (auto& chip : saved_chips) {
+				if (chip->name == name)
+					return chip.get();
+			}
+			return nullptr;
+		}
+
+		// lazy loading: create parts of chip and all its (recursive) dependencies if not done yet
+		void materialize (Chip& chip);
+		// create parts of all chips using chip, needed before editing its pins, since that edits the parts of its users
+		void materialize_users (Chip& chip);
+		void materialize_all ();
+
+		// call after editing chip data that does not affect how it is drawn (chip, pin and part names, color)
+		void chip_data_edited (Chip& chip) {
+			chip.snapshot = nullptr;
+			unsaved_changes = true;
+			names_version++;
+		}
+
+		// snapshot of all saved chips, only copies chips edited since the last snapshot
+		// call on main thread, resulting snapshot can be used (and converted to json) on any thread
+		LibrarySnapshot take_snapshot () const;
+		// while set, to_json(LogicSim) only takes the snapshot into it and writes null,
+		// so the caller can serialize everything else and convert the library on another thread
+		LibrarySnapshot* deferred_snapshot = nullptr;
+
+		int lazy_chip_count () const {
+			int count = 0;
+			for (auto& c : saved_chips)
+				count += c->lazy ? 1 : 0;
+			return count;
+		}
+
+		// call after editing a chip, invalidates its cached mesh and the ones of all chips using it
+		// (users draw wires to its pins and bake state indices that shift with its state_count)
+		void chip_edited (Chip& chip) {
+			chip.mesh.valid = false;
+			chip.hitboxes.valid = false;
+			chip.snapshot = nullptr;
+			chip.struct_hash = 0;
+			auto invalidate_user = [] (Chip* user) {
+				user->mesh.valid = false;
+				user->hitboxes.valid = false;
+				user->snapshot = nullptr; // pin edits change the parts of users
+				user->struct_hash = 0; // includes hash of chip
+			};
+			for (auto* user : chip.users)
+				invalidate_user(user);
+
+			invalidate_timing(chip);
+
+			if (viewed_chip_uses(chip)) {
+				invalidate_user(viewed_chip.get());
+				viewed_chip->timing = nullptr;
+			}
+
+			unsaved_changes = true;
+			layout_changed = true;
+			netlist_valid = false;
+			names_version++;
+		}
+		// users are only computed over saved chips, so an unsaved viewed chip is not in them
+		bool viewed_chip_uses (Chip& chip) const {
+			if (!viewed_chip || viewed_chip.get() == &chip || chip.users.contains(viewed_chip.get()))
+				return false;
+			std::unordered_set<Chip*> parts;
+			for (auto& part : viewed_chip->parts)
+				parts.insert(part->chip);
+
+			if (parts.count(&chip))
+				return true;
+			for (auto* user : chip.users) {
+				if (parts.count(user))
+					return true;
+			}
+			return false;
+		}
+		// path delays of users are composed from the ones of their parts, so all users up the hierarchy are stale too
+		// (users can only have cached timing while the chip has)
+		static void invalidate_timing (Chip& chip) {
+			if (!chip.timing)
+				return;
+			chip.timing = nullptr;
+			for (auto* user : chip.users)
+				invalidate_timing(*user);
+		}
+
 		void switch_to_chip_view (std::shared_ptr<Chip> chip) {
 			// TODO: delete chip warning if main_chip will be deleted by this?
+			materialize(*chip);
 			viewed_chip = std::move(chip); // move copy of shared ptr (ie original still exists)
 
 			update_all_chip_state_indices();
 
+			reset_state();
 			for (int i=0; i<2; ++i) {
-				state[i].assign(viewed_chip->state_count, 0);
 				state[i].shrink_to_fit();
+				xstate[i].shrink_to_fit();
 			}
 			cur_state = 0;
+
+			layout_changed = true;
+			state_changed = true;
+			netlist_valid = false;
+			netlist_store = true;
+			names_version++;
 		}
 		void reset_chip_view (Camera2D& cam) {
 			switch_to_chip_view(std::make_shared<Chip>());
@@ -591,10 +944,36 @@ namespace logic_sim {
 				ImGui::Text("No unsaved changes");
 			}
 			ImGui::Text("Gates (# of states): %d", (int)state[0].size());
+
+			int lazy = lazy_chip_count();
+			if (lazy > 0) {
+				int total = (int)saved_chips.size();
+				ImGui::ProgressBar((float)(total - lazy) / (float)total, ImVec2(-1, 0),
+					prints("%d / %d chips loaded", total - lazy, total).c_str());
+				if (ImGui::Button("Load All Chips"))
+					materialize_all();
+			}
+
+			if (netlist_valid)
+				ImGui::Text("Netlist: %d nodes (%s)", netlist.node_count(), netlist_from_cache ? "cached" : "flattened");
+
+			bool t = ternary;
+			if (ImGui::Checkbox("Ternary (0/1/X)", &t))
+				set_ternary(t);
+			if (int x = unknown_outputs())
+				ImGui::TextColored(ImVec4(1.00f, 0.80f, 0.20f, 1), "%d outputs unresolved (X)", x);
 		}
 		
 		void simulate (Input& I);
 	};
+
+	// serialized chip, cached in Chip::snapshot
+	std::shared_ptr<ChipSnapshot const> snapshot_chip (Chip& chip);
+	// create parts of chip from its json, chip ids of parts are looked up in idx2chip (- GATE_COUNT)
+	void json2chip (const json& j, Chip& chip, std::vector<Chip*> const& idx2chip);
+
+	// combo box to pick a saved chip by name, for tools that work on any saved chip
+	void saved_chip_combo (const char* label, LogicSim& sim, std::string& name);
 	
 	struct Editor {
 		
@@ -709,6 +1088,7 @@ namespace logic_sim {
 			
 			ChipInstanceID chip = {};
 
+			float2x3 chip2world = float2x3(0); // chip2world during hitbox test, used to draw the wire preview
 			float2x3 world2chip = float2x3(0); // world2chip during hitbox test
 
 			// wiring direction false: src->dst  true: dst->src
@@ -737,6 +1117,8 @@ namespace logic_sim {
 
 		float snapping_size = 0.125f;
 		bool snapping = true;
+
+		bool show_critical_path = false;
 	
 		float2 snap (float2 pos) {
 			return snapping ? round(pos / snapping_size) * snapping_size : pos;
@@ -767,7 +1149,7 @@ namespace logic_sim {
 		void saved_chip_imgui (LogicSim& sim, std::shared_ptr<Chip>& chip, bool can_place, bool is_viewed);
 		void saved_chips_imgui (LogicSim& sim, Camera2D& cam);
 		
-		void selection_imgui (PartSelection& sel);
+		void selection_imgui (LogicSim& sim, PartSelection& sel);
 
 		void imgui (LogicSim& sim, Camera2D& cam);
 		
@@ -2,14 +2,48 @@
 
 #include "game.hpp"
 #include "opengl/renderer.hpp"
+#include "autosave.hpp"
+#include "testbench.hpp"
+#include <fstream>
 
 struct App : IApp {
 	SERIALIZE(App, _window, game, renderer)
 
 	virtual ~App () {}
 	
-	virtual void json_load () { load("debug.json", this); }
-	virtual void json_save () { save("debug.json", *this); }
+	virtual void json_load () {
+		autosave.wait(game.sim.unsaved_changes);
+
+		// parsed here instead of with load(), so that a lazily loaded chip library can take over the json instead of copying it
+		std::ifstream file("debug.json");
+		if (!file)
+			return;
+		json j = json::parse(file, nullptr, false);
+		if (j.is_discarded()) {
+			fprintf(stderr, "debug.json is not valid json\n");
+			return;
+		}
+
+		json jsim;
+		if (game.lazy_loading && j.contains("game") && j["game"].contains("sim")) {
+			jsim = std::move(j["game"]["sim"]);
+			j["game"].erase("sim");
+		}
+
+		try {
+			from_json(j, *this);
+			if (!jsim.is_null())
+				from_json_lazy(std::move(jsim), game.sim);
+		}
+		catch (json::exception& ex) {
+			fprintf(stderr, "debug.json could not be loaded: %s\n", ex.what());
+		}
+	}
+	virtual void json_save () {
+		autosave.wait(game.sim.unsaved_changes); // don't race with a background save of the same file
+		save("debug.json", *this);
+		game.sim.unsaved_changes = false;
+	}
 
 	Window& _window; // for serialization even though window has to exists out of App instance (different lifetimes)
 	App (Window& w): _window{w} {}
@@ -17,6 +51,27 @@ struct App : IApp {
 	ogl::Renderer renderer;
 	Game game;
 
+	Autosave autosave;
+
+	// same file as json_save, but the chip library is only snapshotted here,
+	// converting it to json and writing the file happens on a background thread
+	void start_autosave () {
+		auto snapshot = std::make_shared<logic_sim::LibrarySnapshot>();
+
+		game.sim.deferred_snapshot = snapshot.get();
+		json j = *this;
+		game.sim.deferred_snapshot = nullptr;
+
+		game.sim.unsaved_changes = false;
+
+		autosave.start([j = std::move(j), snapshot] () mutable {
+			json& jsim = j.at("game").at("sim"); // where to_json(LogicSim) left the placeholder
+			assert(jsim.is_null());
+			jsim = snapshot->to_json();
+			return write_file_atomic("debug.json", j.dump(1, '\t'));
+		});
+	}
+
 	virtual ShouldClose close_confirmation () {
 		return game.close_confirmation(this);
 	}
@@ -24,15 +79,23 @@ struct App : IApp {
 	virtual void imgui (Window& window) {
 		renderer.imgui(window.input);
 		game.imgui(window.input);
+		autosave.imgui();
 	}
 	virtual void frame (Window& window) {
 		renderer.begin(window, game, window.input.window_size);
 		game.update(window, renderer);
+
+		if (autosave.update(window.input.dt, game.sim.unsaved_changes))
+			start_autosave();
 		renderer.end(window, game, window.input.window_size);
 	}
 };
 
 IApp* make_game (Window& window) { return new App( window ); };
-int main () {
+int main (int argc, char** argv) {
+	// headless test bench run, see testbench.hpp
+	if (argc >= 2 && strcmp(argv[1], "--test") == 0)
+		return logic_sim::testbench_main(argc, argv);
+
 	return run_game(make_game, "Logic Sim");
 }
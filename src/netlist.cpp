@@ -0,0 +1,434 @@
+#include "common.hpp"
+#include "logic_sim.hpp"
+#include "autosave.hpp"
+#include <filesystem>
+
+namespace logic_sim {
+
+////
+template <int INPUTS, typename FUNC>
+static void simulate_nodes (std::vector<Netlist::Node> const& nodes, uint8_t const* cur, uint8_t* next, FUNC func) {
+	for (auto& n : nodes) {
+		bool a =               n.src[0] >= 0 && cur[n.src[0]] != 0;
+		bool b = INPUTS >= 2 && n.src[1] >= 0 && cur[n.src[1]] != 0;
+		bool c = INPUTS >= 3 && n.src[2] >= 0 && cur[n.src[2]] != 0;
+
+		next[n.dst] = (uint8_t)func(a, b, c);
+	}
+}
+
+void Netlist::simulate (uint8_t const* cur, uint8_t* next) const {
+	ZoneScoped;
+
+	for (int sid : keep)
+		next[sid] = cur[sid] != 0;
+
+	simulate_nodes<1>(nodes[BUF_GATE  ], cur, next, [] (bool a, bool b, bool c) { return   a;              });
+	simulate_nodes<1>(nodes[NOT_GATE  ], cur, next, [] (bool a, bool b, bool c) { return  !a;              });
+
+	simulate_nodes<2>(nodes[AND_GATE  ], cur, next, [] (bool a, bool b, bool c) { return   a && b;         });
+	simulate_nodes<2>(nodes[NAND_GATE ], cur, next, [] (bool a, bool b, bool c) { return !(a && b);        });
+	simulate_nodes<2>(nodes[OR_GATE   ], cur, next, [] (bool a, bool b, bool c) { return   a || b;         });
+	simulate_nodes<2>(nodes[NOR_GATE  ], cur, next, [] (bool a, bool b, bool c) { return !(a || b);        });
+	simulate_nodes<2>(nodes[XOR_GATE  ], cur, next, [] (bool a, bool b, bool c) { return   a != b;         });
+
+	simulate_nodes<3>(nodes[AND3_GATE ], cur, next, [] (bool a, bool b, bool c) { return   a && b && c;    });
+	simulate_nodes<3>(nodes[NAND3_GATE], cur, next, [] (bool a, bool b, bool c) { return !(a && b && c);   });
+	simulate_nodes<3>(nodes[OR3_GATE  ], cur, next, [] (bool a, bool b, bool c) { return   a || b || c;    });
+	simulate_nodes<3>(nodes[NOR3_GATE ], cur, next, [] (bool a, bool b, bool c) { return !(a || b || c);   });
+}
+
+template <int INPUTS, typename FUNC>
+static void simulate_lane_nodes (std::vector<Netlist::Node> const& nodes, uint64_t const* cur, uint64_t* next, FUNC func) {
+	for (auto& n : nodes) {
+		uint64_t a =               n.src[0] >= 0 ? cur[n.src[0]] : 0;
+		uint64_t b = INPUTS >= 2 && n.src[1] >= 0 ? cur[n.src[1]] : 0;
+		uint64_t c = INPUTS >= 3 && n.src[2] >= 0 ? cur[n.src[2]] : 0;
+
+		next[n.dst] = func(a, b, c);
+	}
+}
+
+void Netlist::simulate_lanes (uint64_t const* cur, uint64_t* next) const {
+	for (int sid : keep)
+		next[sid] = cur[sid];
+
+	using u64 = uint64_t;
+	simulate_lane_nodes<1>(nodes[BUF_GATE  ], cur, next, [] (u64 a, u64 b, u64 c) { return   a;          });
+	simulate_lane_nodes<1>(nodes[NOT_GATE  ], cur, next, [] (u64 a, u64 b, u64 c) { return  ~a;          });
+
+	simulate_lane_nodes<2>(nodes[AND_GATE  ], cur, next, [] (u64 a, u64 b, u64 c) { return   a & b;      });
+	simulate_lane_nodes<2>(nodes[NAND_GATE ], cur, next, [] (u64 a, u64 b, u64 c) { return ~(a & b);     });
+	simulate_lane_nodes<2>(nodes[OR_GATE   ], cur, next, [] (u64 a, u64 b, u64 c) { return   a | b;      });
+	simulate_lane_nodes<2>(nodes[NOR_GATE  ], cur, next, [] (u64 a, u64 b, u64 c) { return ~(a | b);     });
+	simulate_lane_nodes<2>(nodes[XOR_GATE  ], cur, next, [] (u64 a, u64 b, u64 c) { return   a ^ b;      });
+
+	simulate_lane_nodes<3>(nodes[AND3_GATE ], cur, next, [] (u64 a, u64 b, u64 c) { return   a & b & c;  });
+	simulate_lane_nodes<3>(nodes[NAND3_GATE], cur, next, [] (u64 a, u64 b, u64 c) { return ~(a & b & c); });
+	simulate_lane_nodes<3>(nodes[OR3_GATE  ], cur, next, [] (u64 a, u64 b, u64 c) { return   a | b | c;  });
+	simulate_lane_nodes<3>(nodes[NOR3_GATE ], cur, next, [] (u64 a, u64 b, u64 c) { return ~(a | b | c); });
+}
+
+namespace {
+	// dual rail encoding of a ternary value: h = may be 1, l = may be 0, X has both set
+	struct Rail {
+		uint8_t h, l;
+	};
+	inline Rail r_not (Rail a)         { return { a.l, a.h }; }
+	inline Rail r_and (Rail a, Rail b) { return { (uint8_t)(a.h & b.h), (uint8_t)(a.l | b.l) }; }
+	inline Rail r_or  (Rail a, Rail b) { return { (uint8_t)(a.h | b.h), (uint8_t)(a.l & b.l) }; }
+	inline Rail r_xor (Rail a, Rail b) { return { (uint8_t)((a.h & b.l) | (a.l & b.h)), (uint8_t)((a.h & b.h) | (a.l & b.l)) }; }
+}
+
+template <int INPUTS, typename FUNC>
+static void simulate_ternary_nodes (std::vector<Netlist::Node> const& nodes, uint8_t const* cur, uint8_t const* cur_x,
+		uint8_t* next, uint8_t* next_x, FUNC func) {
+	auto read = [&] (int32_t sid) -> Rail {
+		if (sid < 0)
+			return { 0, 1 };
+		uint8_t v = cur[sid] != 0, x = cur_x[sid];
+		return { (uint8_t)(v | x), (uint8_t)((v ^ 1) | x) };
+	};
+
+	for (auto& n : nodes) {
+		Rail a =               read(n.src[0]);
+		Rail b = INPUTS >= 2 ? read(n.src[1]) : Rail{};
+		Rail c = INPUTS >= 3 ? read(n.src[2]) : Rail{};
+
+		Rail r = func(a, b, c);
+		next  [n.dst] = r.h & (r.l ^ 1);
+		next_x[n.dst] = r.h & r.l;
+	}
+}
+
+void Netlist::simulate_ternary (uint8_t const* cur, uint8_t const* cur_x, uint8_t* next, uint8_t* next_x) const {
+	ZoneScoped;
+
+	for (int sid : keep) {
+		next  [sid] = cur[sid] != 0;
+		next_x[sid] = cur_x[sid];
+	}
+
+	simulate_ternary_nodes<1>(nodes[BUF_GATE  ], cur, cur_x, next, next_x, [] (Rail a, Rail b, Rail c) { return a; });
+	simulate_ternary_nodes<1>(nodes[NOT_GATE  ], cur, cur_x, next, next_x, [] (Rail a, Rail b, Rail c) { return r_not(a); });
+
+	simulate_ternary_nodes<2>(nodes[AND_GATE  ], cur, cur_x, next, next_x, [] (Rail a, Rail b, Rail c) { return       r_and(a, b);  });
+	simulate_ternary_nodes<2>(nodes[NAND_GATE ], cur, cur_x, next, next_x, [] (Rail a, Rail b, Rail c) { return r_not(r_and(a, b)); });
+	simulate_ternary_nodes<2>(nodes[OR_GATE   ], cur, cur_x, next, next_x, [] (Rail a, Rail b, Rail c) { return       r_or (a, b);  });
+	simulate_ternary_nodes<2>(nodes[NOR_GATE  ], cur, cur_x, next, next_x, [] (Rail a, Rail b, Rail c) { return r_not(r_or (a, b)); });
+	simulate_ternary_nodes<2>(nodes[XOR_GATE  ], cur, cur_x, next, next_x, [] (Rail a, Rail b, Rail c) { return       r_xor(a, b);  });
+
+	simulate_ternary_nodes<3>(nodes[AND3_GATE ], cur, cur_x, next, next_x, [] (Rail a, Rail b, Rail c) { return       r_and(r_and(a, b), c);  });
+	simulate_ternary_nodes<3>(nodes[NAND3_GATE], cur, cur_x, next, next_x, [] (Rail a, Rail b, Rail c) { return r_not(r_and(r_and(a, b), c)); });
+	simulate_ternary_nodes<3>(nodes[OR3_GATE  ], cur, cur_x, next, next_x, [] (Rail a, Rail b, Rail c) { return       r_or (r_or (a, b), c);  });
+	simulate_ternary_nodes<3>(nodes[NOR3_GATE ], cur, cur_x, next, next_x, [] (Rail a, Rail b, Rail c) { return r_not(r_or (r_or (a, b), c)); });
+}
+
+////
+// mirrors the order of state indices (see LogicSim::update_state_indices)
+static void flatten (Chip& chip, int state_base, Netlist& n) {
+	auto src_sid = [&] (Part::InputWire const& inp) -> int32_t {
+		return inp.part ? state_base + inp.part->sid + inp.pin : -1;
+	};
+
+	int sid = state_base;
+
+	for (auto& part : chip.outputs) {
+		assert(part->chip == &gates[OUT_PIN]);
+
+		if (!part->inputs[0].part)
+			n.keep.push_back(sid);
+		else
+			n.nodes[BUF_GATE].push_back({ sid, { src_sid(part->inputs[0]), -1, -1 } });
+
+		sid += 1;
+	}
+
+	// inputs are written by caller
+	sid += (int)chip.inputs.size();
+
+	for (auto& part : chip.parts) {
+		int input_count = (int)part->chip->inputs.size();
+
+		if (!is_gate(part->chip)) {
+			int output_count = (int)part->chip->outputs.size();
+
+			for (int i=0; i<input_count; ++i) {
+				int dst = sid + output_count + i;
+
+				if (!part->inputs[i].part)
+					n.keep.push_back(dst);
+				else
+					n.nodes[BUF_GATE].push_back({ dst, { src_sid(part->inputs[i]), -1, -1 } });
+			}
+
+			flatten(*part->chip, sid, n);
+		}
+		else {
+			auto type = gate_type(part->chip);
+			assert(type != INP_PIN && type != OUT_PIN);
+
+			Netlist::Node node = { sid, { -1, -1, -1 } };
+			for (int i=0; i<input_count; ++i)
+				node.src[i] = src_sid(part->inputs[i]);
+
+			if (node.src[0] < 0 && node.src[1] < 0)
+				n.keep.push_back(sid);
+			else
+				n.nodes[type].push_back(node);
+		}
+
+		sid += part->chip->state_count;
+	}
+
+	assert(chip.state_count >= 0); // state_count stale!
+	assert(sid - state_base == chip.state_count); // state_count invalid!
+}
+
+Netlist flatten_chip (Chip& chip) {
+	ZoneScoped;
+
+	Netlist n;
+	n.hash = structural_hash(chip);
+	n.state_count = chip.state_count;
+
+	for (auto& part : chip.inputs)
+		n.keep.push_back(part->sid);
+
+	flatten(chip, 0, n);
+	return n;
+}
+
+NetlistOrder order_netlist (Netlist const& nl) {
+	ZoneScoped;
+
+	NetlistOrder res;
+
+	struct NodeRef {
+		int32_t type = -1;
+		int32_t node;
+	};
+	std::vector<NodeRef> node_of(nl.state_count);
+	for (int type=0; type<GATE_COUNT; ++type) {
+		for (int i=0; i<(int)nl.nodes[type].size(); ++i)
+			node_of[nl.nodes[type][i].dst] = { type, i };
+	}
+	auto is_node = [&] (int32_t sid) { return sid >= 0 && node_of[sid].type >= 0; };
+
+	// users of each state as compressed adjacency lists
+	std::vector<int32_t> first_user(nl.state_count + 1, 0);
+	std::vector<int32_t> indegree(nl.state_count, 0);
+	for (auto& nodes : nl.nodes) {
+		for (auto& n : nodes) {
+			for (int32_t src : n.src) {
+				if (is_node(src)) {
+					first_user[src + 1]++;
+					indegree[n.dst]++;
+				}
+			}
+		}
+	}
+	for (int i=0; i<nl.state_count; ++i)
+		first_user[i+1] += first_user[i];
+
+	std::vector<int32_t> users(first_user.back());
+	std::vector<int32_t> fill(first_user.begin(), first_user.end() - 1);
+	for (auto& nodes : nl.nodes) {
+		for (auto& n : nodes) {
+			for (int32_t src : n.src) {
+				if (is_node(src))
+					users[fill[src]++] = n.dst;
+			}
+		}
+	}
+
+	// kahn's algorithm, queue doubles as the order
+	std::vector<int32_t> queue;
+	queue.reserve(nl.node_count());
+	for (int sid=0; sid<nl.state_count; ++sid) {
+		if (is_node(sid) && indegree[sid] == 0)
+			queue.push_back(sid);
+	}
+
+	res.level.assign(nl.state_count, 0);
+	for (size_t i=0; i<queue.size(); ++i) {
+		int32_t sid = queue[i];
+		res.max_level = max(res.max_level, res.level[sid]);
+		res.order.push_back({ (GateType)node_of[sid].type, node_of[sid].node });
+
+		for (int32_t u = first_user[sid]; u < first_user[sid+1]; ++u) {
+			int32_t user = users[u];
+			res.level[user] = max(res.level[user], res.level[sid] + 1);
+			if (--indegree[user] == 0)
+				queue.push_back(user);
+		}
+	}
+
+	res.cyclic = (int)queue.size() < nl.node_count();
+	return res;
+}
+
+Netlist flatten_saved_chip (LogicSim& sim, Chip& chip) {
+	if (chip.lazy)
+		sim.materialize(chip);
+	LogicSim::update_state_indices(chip);
+
+	Netlist n;
+	if (sim.netlist_cache_dir.empty() || !load_netlist_cache(sim.netlist_cache_dir, structural_hash(chip), n) ||
+			n.state_count != chip.state_count)
+		n = flatten_chip(chip);
+	return n;
+}
+
+////
+struct Hasher {
+	uint64_t h = 14695981039346656037ull; // FNV-1a
+
+	void add (uint64_t val) {
+		for (int i=0; i<8; ++i) {
+			h ^= (val >> (i*8)) & 0xff;
+			h *= 1099511628211ull;
+		}
+	}
+};
+
+uint64_t structural_hash (Chip& chip) {
+	if (chip.struct_hash)
+		return chip.struct_hash;
+
+	assert(!chip.lazy && chip.state_count >= 0);
+
+	Hasher h;
+	h.add(chip.outputs.size());
+	h.add(chip.inputs.size());
+	h.add(chip.parts.size());
+
+	auto add_part = [&] (Part& part) {
+		if (is_gate(part.chip))
+			h.add(gate_type(part.chip));
+		else
+			h.add(structural_hash(*part.chip));
+
+		// wires by state index, which is unique per part and pin
+		for (int i=0; i<(int)part.chip->inputs.size(); ++i) {
+			auto& inp = part.inputs[i];
+			h.add(inp.part ? inp.part->sid : -1);
+			h.add(inp.pin);
+		}
+	};
+	for (auto& part : chip.outputs) add_part(*part);
+	for (auto& part : chip.inputs)  add_part(*part);
+	for (auto& part : chip.parts)   add_part(*part);
+
+	chip.struct_hash = h.h ? h.h : 1;
+	return chip.struct_hash;
+}
+
+////
+// <hash>.netlist: NetlistHeader, keep int32[keep_count], then Netlist::Node[node_counts[type]] for each type in order
+// integers are stored in host byte order
+namespace {
+	inline constexpr char     NETLIST_MAGIC[8] = { 'L','S','I','M','N','E','T','\0' };
+	inline constexpr uint32_t NETLIST_VERSION  = 1;
+
+	struct NetlistHeader {
+		char     magic[8];
+		uint32_t version;
+		int32_t  state_count;
+		uint64_t hash;
+		uint64_t keep_count;
+		uint64_t node_counts[GATE_COUNT];
+	};
+	static_assert(sizeof(Netlist::Node) == 16, "");
+}
+
+std::string netlist_cache_path (std::string const& dirpath, uint64_t hash) {
+	return prints("%s/%016llx.netlist", dirpath.c_str(), (unsigned long long)hash);
+}
+
+bool load_netlist_cache (std::string const& dirpath, uint64_t hash, Netlist& netlist) {
+	ZoneScoped;
+
+	FILE* f = fopen(netlist_cache_path(dirpath, hash).c_str(), "rb");
+	if (!f)
+		return false;
+
+	Netlist n;
+
+	NetlistHeader hdr;
+	bool ok = fread(&hdr, sizeof(hdr), 1, f) == 1 &&
+		memcmp(hdr.magic, NETLIST_MAGIC, sizeof(NETLIST_MAGIC)) == 0 &&
+		hdr.version == NETLIST_VERSION && hdr.hash == hash && hdr.state_count >= 0;
+
+	// every state is kept or driven by at most one node, so larger counts are corrupted and must not reach resize
+	uint64_t total = hdr.keep_count;
+	for (int type=0; ok && type<GATE_COUNT; ++type) {
+		ok = hdr.keep_count <= (uint64_t)hdr.state_count && hdr.node_counts[type] <= (uint64_t)hdr.state_count;
+		total += hdr.node_counts[type];
+	}
+	ok = ok && total <= (uint64_t)hdr.state_count;
+
+	if (ok) {
+		n.hash = hdr.hash;
+		n.state_count = hdr.state_count;
+
+		n.keep.resize(hdr.keep_count);
+		ok = fread(n.keep.data(), sizeof(int32_t), n.keep.size(), f) == n.keep.size();
+
+		for (int type=0; ok && type<GATE_COUNT; ++type) {
+			n.nodes[type].resize(hdr.node_counts[type]);
+			ok = fread(n.nodes[type].data(), sizeof(Netlist::Node), n.nodes[type].size(), f) == n.nodes[type].size();
+		}
+	}
+	fclose(f);
+
+	// never index out of bounds on a corrupted file
+	auto in_range = [&] (int32_t sid, bool optional) {
+		return (optional && sid == -1) || (sid >= 0 && sid < n.state_count);
+	};
+	for (int sid : n.keep)
+		ok = ok && in_range(sid, false);
+	for (auto& nodes : n.nodes) {
+		for (auto& node : nodes)
+			ok = ok && in_range(node.dst, false) && in_range(node.src[0], true) && in_range(node.src[1], true) && in_range(node.src[2], true);
+	}
+
+	if (!ok) {
+		fprintf(stderr, "Netlist cache entry %016llx invalid, flattening chip instead\n", (unsigned long long)hash);
+		return false;
+	}
+
+	netlist = std::move(n);
+	return true;
+}
+
+bool save_netlist_cache (std::string const& dirpath, Netlist const& netlist) {
+	ZoneScoped;
+
+	std::error_code ec;
+	std::filesystem::create_directories(dirpath, ec);
+	if (ec)
+		return false;
+
+	NetlistHeader hdr = {};
+	memcpy(hdr.magic, NETLIST_MAGIC, sizeof(NETLIST_MAGIC));
+	hdr.version     = NETLIST_VERSION;
+	hdr.state_count = netlist.state_count;
+	hdr.hash        = netlist.hash;
+	hdr.keep_count  = netlist.keep.size();
+	for (int type=0; type<GATE_COUNT; ++type)
+		hdr.node_counts[type] = netlist.nodes[type].size();
+
+	std::string data;
+	data.reserve(sizeof(hdr) + netlist.keep.size() * sizeof(int32_t) + netlist.node_count() * sizeof(Netlist::Node));
+
+	data.append((char const*)&hdr, sizeof(hdr));
+	data.append((char const*)netlist.keep.data(), netlist.keep.size() * sizeof(int32_t));
+	for (auto& nodes : netlist.nodes)
+		data.append((char const*)nodes.data(), nodes.size() * sizeof(Netlist::Node));
+
+	// atomic so a concurrently running instance never reads half written entries
+	return write_file_atomic(netlist_cache_path(dirpath, netlist.hash), data);
+}
+
+}
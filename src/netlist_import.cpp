@@ -0,0 +1,1129 @@
+#include "common.hpp"
+#include "netlist_import.hpp"
+#include <fstream>
+#include <unordered_set>
+
+namespace logic_sim {
+
+namespace {
+
+struct ImportError {
+	std::string msg;
+};
+[[noreturn]] void import_error (int line, std::string msg) {
+	throw ImportError{ prints("line %d: %s", line, msg.c_str()) };
+}
+
+////
+// Chip under construction, parts are connected via nets, which are resolved to wires once all modules are read
+struct ModuleBuilder {
+	std::shared_ptr<Chip> chip;
+	int line = 0; // where the module starts
+
+	std::vector<std::string> ports; // port order for positional instances
+	std::unordered_map<std::string, int> buses; // declared bus widths
+
+	struct Net {
+		int   parent; // union-find of aliased nets
+		Part* driver = nullptr;
+		int   pin = 0;
+		int   uses = 0;
+		bool  anonymous = false; // intermediate result of an expression or cover
+	};
+	std::vector<Net> nets;
+	std::unordered_map<std::string, int> net_ids;
+	std::unordered_map<int, int> inverted; // net -> shared NOT gate output
+	int const_nets[2] = { -1, -1 };
+
+	struct Sink {
+		Part* part;
+		int   input;
+		int   net;
+	};
+	std::vector<Sink> sinks;
+
+	struct Instance {
+		std::string model;
+		std::string name;
+		std::vector<std::pair<std::string, int>> conns; // formal port (empty if positional), net
+		int line;
+	};
+	std::vector<Instance> instances;
+
+	ModuleBuilder (std::string name, int line): chip{std::make_shared<Chip>()}, line{line} {
+		chip->name = std::move(name);
+	}
+
+	int net (std::string const& name) {
+		auto res = net_ids.try_emplace(name, (int)nets.size());
+		if (res.second)
+			nets.push_back({ (int)nets.size() });
+		return res.first->second;
+	}
+	int new_net () {
+		nets.push_back({ (int)nets.size(), nullptr, 0, 0, true });
+		return (int)nets.size() - 1;
+	}
+	int find (int n) {
+		while (nets[n].parent != n) {
+			nets[n].parent = nets[nets[n].parent].parent;
+			n = nets[n].parent;
+		}
+		return n;
+	}
+
+	void drive (int n, Part* part, int pin, int line) {
+		auto& net = nets[find(n)];
+		if (net.driver)
+			import_error(line, "net has multiple drivers");
+		net.driver = part;
+		net.pin = pin;
+	}
+	// a and b are the same net (assign a = b)
+	void alias (int a, int b, int line) {
+		a = find(a);
+		b = find(b);
+		if (a == b)
+			return;
+		if (nets[a].driver && nets[b].driver)
+			import_error(line, "net has multiple drivers");
+
+		if (!nets[a].driver) {
+			nets[a].driver = nets[b].driver;
+			nets[a].pin    = nets[b].pin;
+		}
+		nets[a].uses     += nets[b].uses;
+		nets[a].anonymous = nets[a].anonymous && nets[b].anonymous;
+		nets[b].parent = a;
+	}
+
+	Part* add_part (Chip* type, std::string name = {}) {
+		auto* ptr = new Part(type, std::move(name), {});
+		chip->parts.vec.emplace_back(ptr); // always a new part, skip the linear contains check of add()
+		return ptr;
+	}
+	void connect (Part* part, int input, int net) {
+		nets[find(net)].uses++;
+		sinks.push_back({ part, input, net });
+	}
+
+	void add_input (std::string const& name, int line) {
+		auto* ptr = new Part(&gates[INP_PIN], std::string(name), {});
+		chip->inputs.emplace_back(ptr);
+		drive(net(name), ptr, 0, line);
+	}
+	void add_output (std::string const& name) {
+		auto* ptr = new Part(&gates[OUT_PIN], std::string(name), {});
+		chip->outputs.emplace_back(ptr);
+		connect(ptr, 0, net(name));
+	}
+
+	int gate (GateType type, int const* ins, int count) {
+		assert(count == (int)gates[type].inputs.size());
+		Part* part = add_part(&gates[type]);
+		for (int i=0; i<count; ++i)
+			connect(part, i, ins[i]);
+
+		int out = new_net();
+		nets[out].driver = part;
+		return out;
+	}
+
+	// level sensitive latch, transparent while en is 1 (en_n is its complement)
+	// q = d&en | q&en_n | d&q, the consensus term d&q keeps q while en falls,
+	// since the and gates see en and en_n change in different ticks (q would glitch and then oscillate without it)
+	int latch (int d, int en, int en_n, int line) {
+		int q = new_net();
+		int pass[2] = { d, en };
+		int hold[2] = { q, en_n };
+		int keep[2] = { d, q };
+		int terms[3] = { gate(AND_GATE, pass, 2), gate(AND_GATE, hold, 2), gate(AND_GATE, keep, 2) };
+		alias(q, gate(OR3_GATE, terms, 3), line);
+		return q;
+	}
+
+	// gate whose input is its own output, so it never changes: AND -> 0, NAND -> 1
+	int const_net (bool val) {
+		if (const_nets[val] < 0) {
+			Part* part = add_part(&gates[val ? NAND_GATE : AND_GATE]);
+			int out = const_nets[val] = new_net();
+			nets[out].driver = part;
+			nets[out].anonymous = false;
+			connect(part, 0, out);
+		}
+		return const_nets[val];
+	}
+
+	int invert (int n) {
+		n = find(n);
+		auto& net = nets[n];
+
+		// result of a gate only used here, flip the gate instead of adding a NOT gate
+		if (net.anonymous && net.uses == 0 && net.driver && is_gate(net.driver->chip)) {
+			static constexpr GateType complement[GATE_COUNT] = {
+				GATE_COUNT, GATE_COUNT,
+				NOT_GATE, BUF_GATE, NAND_GATE, AND_GATE, NOR_GATE, OR_GATE, GATE_COUNT,
+				NAND3_GATE, AND3_GATE, NOR3_GATE, OR3_GATE,
+			};
+			GateType flipped = complement[gate_type(net.driver->chip)];
+			if (flipped != GATE_COUNT) {
+				net.driver->chip = &gates[flipped];
+				return n;
+			}
+		}
+
+		if (n == const_nets[0] || n == const_nets[1])
+			return const_net(n == const_nets[0]);
+
+		auto it = inverted.find(n);
+		if (it != inverted.end())
+			return it->second;
+
+		bool shared = !net.anonymous;
+		int out = gate(NOT_GATE, &n, 1); // invalidates net
+		if (shared) {
+			inverted[n] = out;
+			nets[out].anonymous = false; // shared, must not be flipped
+		}
+		return out;
+	}
+
+	// combine nets with a tree of AND (or OR) gates, using 3 input gates where possible
+	int reduce (GateType op, std::vector<int> ins, bool inv) {
+		assert(op == AND_GATE || op == OR_GATE);
+		GateType op3 = op == AND_GATE ? AND3_GATE : OR3_GATE;
+
+		if (ins.empty())
+			return const_net((op == AND_GATE) != inv);
+
+		while (ins.size() > 1) {
+			std::vector<int> next;
+			for (size_t i=0; i<ins.size(); i += 3) {
+				int n = (int)min(ins.size() - i, (size_t)3);
+				next.push_back(n == 1 ? ins[i] : gate(n == 3 ? op3 : op, &ins[i], n));
+			}
+			ins = std::move(next);
+		}
+		return inv ? invert(ins[0]) : ins[0];
+	}
+	int reduce_xor (std::vector<int> ins, bool inv) {
+		if (ins.empty())
+			return const_net(inv);
+
+		while (ins.size() > 1) {
+			std::vector<int> next;
+			for (size_t i=0; i<ins.size(); i += 2)
+				next.push_back(i+1 < ins.size() ? gate(XOR_GATE, &ins[i], 2) : ins[i]);
+			ins = std::move(next);
+		}
+		return inv ? invert(ins[0]) : ins[0];
+	}
+
+	// create instanced parts and turn nets into wires
+	void link (std::unordered_map<std::string, ModuleBuilder*> const& modules) {
+		for (auto& inst : instances) {
+			auto it = modules.find(inst.model);
+			if (it == modules.end())
+				import_error(inst.line, prints("unknown module \"%s\"", inst.model.c_str()));
+			auto& type = *it->second;
+
+			Part* part = add_part(type.chip.get(), std::move(inst.name));
+
+			for (int i=0; i<(int)inst.conns.size(); ++i) {
+				auto& [formal, n] = inst.conns[i];
+
+				std::string const* port = &formal;
+				if (formal.empty()) {
+					if (i >= (int)type.ports.size())
+						import_error(inst.line, prints("too many connections for \"%s\"", inst.model.c_str()));
+					port = &type.ports[i];
+				}
+
+				auto find_pin = [&] (std::vector<std::unique_ptr<Part>> const& pins) {
+					return indexof(pins, *port, [] (std::unique_ptr<Part> const& l, std::string const& r) { return l->name == r; });
+				};
+				int inp = find_pin(type.chip->inputs);
+				int out = find_pin(type.chip->outputs);
+
+				if      (inp >= 0) connect(part, inp, n);
+				else if (out >= 0) drive(n, part, out, inst.line);
+				else import_error(inst.line, prints("\"%s\" has no scalar port \"%s\"", inst.model.c_str(), port->c_str()));
+			}
+		}
+
+		// undriven nets stay unconnected, so they can be toggled like inputs
+		for (auto& s : sinks) {
+			auto& net = nets[find(s.net)];
+			s.part->inputs[s.input].part = net.driver;
+			s.part->inputs[s.input].pin  = net.pin;
+		}
+
+		// not needed anymore
+		nets = {};
+		net_ids = {};
+		inverted = {};
+		sinks = {};
+		instances = {};
+	}
+};
+
+////
+// place parts in columns by logic depth (longest path from the chip inputs), pins on the chip edges
+void layout_chip (Chip& chip) {
+	ZoneScoped;
+
+	constexpr float COL_GAP = 1.5f;
+	constexpr float ROW_GAP = 0.5f;
+	constexpr float PIN_SPACING = 1.0f;
+
+	int count = chip.parts.size();
+
+	std::unordered_map<Part*, int> part2idx;
+	part2idx.reserve(count);
+	for (int i=0; i<count; ++i)
+		part2idx.emplace(chip.parts[i].get(), i);
+
+	// fanout lists in one array (csr)
+	std::vector<int> fanout_offs(count+1, 0);
+	std::vector<int> indeg(count, 0);
+	auto for_each_src = [&] (int i, auto func) {
+		auto& part = *chip.parts[i];
+		for (int j=0; j<(int)part.chip->inputs.size(); ++j) {
+			auto it = part2idx.find(part.inputs[j].part);
+			if (it != part2idx.end())
+				func(it->second);
+		}
+	};
+	for (int i=0; i<count; ++i) {
+		for_each_src(i, [&] (int src) { fanout_offs[src+1]++; indeg[i]++; });
+	}
+	for (int i=0; i<count; ++i)
+		fanout_offs[i+1] += fanout_offs[i];
+
+	std::vector<int> fanout(fanout_offs[count]);
+	std::vector<int> fill(fanout_offs.begin(), fanout_offs.end()-1);
+	for (int i=0; i<count; ++i) {
+		for_each_src(i, [&] (int src) { fanout[fill[src]++] = i; });
+	}
+
+	// kahn's algorithm, parts in cycles (feedback) keep the level from their already placed inputs
+	std::vector<int> level(count, 0);
+	std::vector<int> queue;
+	queue.reserve(count);
+	for (int i=0; i<count; ++i) {
+		if (indeg[i] == 0)
+			queue.push_back(i);
+	}
+	for (size_t q=0; q<queue.size(); ++q) {
+		int i = queue[q];
+		for (int k=fanout_offs[i]; k<fanout_offs[i+1]; ++k) {
+			int dst = fanout[k];
+			level[dst] = max(level[dst], level[i] + 1);
+			if (--indeg[dst] == 0)
+				queue.push_back(dst);
+		}
+	}
+
+	int max_level = 0;
+	for (int l : level)
+		max_level = max(max_level, l);
+
+	std::vector<std::vector<int>> columns(max_level+1);
+	for (int i=0; i<count; ++i)
+		columns[level[i]].push_back(i);
+
+	// split wide levels into multiple columns to keep the chip roughly square
+	int max_rows = max(32, (int)std::sqrt((float)count));
+
+	float x = 0;
+	float height = max((float)chip.inputs.size(), (float)chip.outputs.size()) * PIN_SPACING;
+
+	std::vector<float> col_heights;
+	std::vector<int> part_col(count);
+	for (auto& col : columns) {
+		for (int first=0; first<(int)col.size(); first += max_rows) {
+			int last = min(first + max_rows, (int)col.size());
+
+			float width = 0, y = 0;
+			for (int k=first; k<last; ++k) {
+				auto& part = *chip.parts[col[k]];
+				width = max(width, part.chip->size.x);
+				part.pos.pos = float2(x, y + part.chip->size.y * 0.5f);
+				y += part.chip->size.y + ROW_GAP;
+				part_col[col[k]] = (int)col_heights.size();
+			}
+			for (int k=first; k<last; ++k) {
+				auto& part = *chip.parts[col[k]];
+				part.pos.pos.x += width * 0.5f;
+			}
+
+			col_heights.push_back(y - ROW_GAP);
+			height = max(height, y - ROW_GAP);
+			x += width + COL_GAP;
+		}
+	}
+
+	float width = x + COL_GAP;
+	chip.size = float2(width, height + 2*COL_GAP);
+
+	// center columns vertically and the whole layout on the chip origin
+	for (int i=0; i<count; ++i) {
+		auto& pos = chip.parts[i]->pos.pos;
+		pos.x += COL_GAP - width * 0.5f;
+		pos.y -= col_heights[part_col[i]] * 0.5f;
+	}
+
+	auto place_pins = [&] (std::vector<std::unique_ptr<Part>>& pins, float x) {
+		float y = ((float)pins.size() - 1) * PIN_SPACING * 0.5f;
+		for (auto& pin : pins) {
+			pin->pos.pos = float2(x, y);
+			y -= PIN_SPACING;
+		}
+	};
+	place_pins(chip.inputs,  -chip.size.x * 0.5f);
+	place_pins(chip.outputs, +chip.size.x * 0.5f);
+}
+
+////
+// Reads whole logical lines of a BLIF file: joins lines ending in \ and strips comments
+struct BlifReader {
+	std::ifstream file;
+	int line_no = 0;
+	int stmt_line = 0; // first line of the last logical line
+
+	std::string line, part;
+
+	bool next (std::vector<std::string>& toks) {
+		toks.clear();
+		while (toks.empty()) {
+			line.clear();
+			stmt_line = line_no + 1;
+
+			bool cont = true;
+			while (cont) {
+				if (!std::getline(file, part))
+					return !line.empty() && split(toks);
+				line_no++;
+
+				auto comment = part.find('#');
+				if (comment != std::string::npos)
+					part.resize(comment);
+				while (!part.empty() && isspace((unsigned char)part.back()))
+					part.pop_back();
+
+				cont = !part.empty() && part.back() == '\\';
+				if (cont)
+					part.pop_back();
+				line += part;
+				line += ' ';
+			}
+			split(toks);
+		}
+		return true;
+	}
+	bool split (std::vector<std::string>& toks) {
+		size_t i = 0;
+		while (i < line.size()) {
+			while (i < line.size() && isspace((unsigned char)line[i])) i++;
+			size_t start = i;
+			while (i < line.size() && !isspace((unsigned char)line[i])) i++;
+			if (i > start)
+				toks.emplace_back(line, start, i - start);
+		}
+		return !toks.empty();
+	}
+};
+
+void parse_blif (std::ifstream& file, std::vector<std::unique_ptr<ModuleBuilder>>& modules, std::vector<std::string>& warnings) {
+	BlifReader r = { std::move(file) };
+
+	ModuleBuilder* mod = nullptr;
+	auto get_mod = [&] () -> ModuleBuilder& {
+		if (!mod) // be lenient with files without .model
+			mod = modules.emplace_back(std::make_unique<ModuleBuilder>("top", r.stmt_line)).get();
+		return *mod;
+	};
+
+	// cover of the current .names, gates are created once the cover is complete
+	std::vector<int> cover_ins;
+	int cover_out = -1;
+	int cover_line = 0;
+	std::vector<std::string> cubes;
+	char out_val = 0;
+
+	auto finish_cover = [&] () {
+		if (cover_out < 0)
+			return;
+		auto& m = *mod;
+
+		int result;
+		if (cubes.empty()) {
+			result = m.const_net(false);
+		}
+		else {
+			// cubes of the on-set (output 1) are or-ed, if the off-set is given (output 0) the result is inverted
+			std::vector<int> terms, lits;
+			bool tautology = false;
+
+			for (auto& cube : cubes) {
+				lits.clear();
+				for (int i=0; i<(int)cube.size(); ++i) {
+					if      (cube[i] == '1') lits.push_back(cover_ins[i]);
+					else if (cube[i] == '0') lits.push_back(m.invert(cover_ins[i]));
+				}
+				if (lits.empty())
+					tautology = true;
+				else
+					terms.push_back(m.reduce(AND_GATE, lits, false));
+			}
+
+			result = tautology ?
+				m.const_net(out_val == '1') :
+				m.reduce(OR_GATE, std::move(terms), out_val == '0');
+		}
+		m.alias(cover_out, result, cover_line);
+
+		cover_out = -1;
+		cubes.clear();
+	};
+
+	std::vector<std::string> toks;
+	while (r.next(toks)) {
+		int line = r.stmt_line;
+		auto& cmd = toks[0];
+
+		if (cmd[0] != '.') {
+			// cover row
+			if (cover_out < 0)
+				import_error(line, "cover row outside of .names");
+
+			std::string cube = cover_ins.empty() ? "" : cmd;
+			std::string const& val = cover_ins.empty() ? cmd : (toks.size() >= 2 ? toks[1] : cmd);
+
+			if (toks.size() != (cover_ins.empty() ? 1u : 2u) || cube.size() != cover_ins.size() ||
+			    cube.find_first_not_of("01-") != std::string::npos || (val != "0" && val != "1"))
+				import_error(line, "invalid cover row");
+			if (!cubes.empty() && val[0] != out_val)
+				import_error(line, "cover mixes on-set and off-set rows");
+
+			out_val = val[0];
+			cubes.push_back(std::move(cube));
+			continue;
+		}
+
+		finish_cover();
+
+		if (cmd == ".model") {
+			mod = modules.emplace_back(std::make_unique<ModuleBuilder>(toks.size() > 1 ? toks[1] : "unnamed", line)).get();
+		}
+		else if (cmd == ".inputs") {
+			for (size_t i=1; i<toks.size(); ++i) {
+				get_mod().add_input(toks[i], line);
+				get_mod().ports.push_back(toks[i]);
+			}
+		}
+		else if (cmd == ".outputs") {
+			for (size_t i=1; i<toks.size(); ++i) {
+				get_mod().add_output(toks[i]);
+				get_mod().ports.push_back(toks[i]);
+			}
+		}
+		else if (cmd == ".names") {
+			if (toks.size() < 2)
+				import_error(line, ".names without output");
+			auto& m = get_mod();
+
+			cover_ins.clear();
+			for (size_t i=1; i<toks.size()-1; ++i)
+				cover_ins.push_back(m.net(toks[i]));
+			cover_out = m.net(toks.back());
+			cover_line = line;
+		}
+		else if (cmd == ".latch") {
+			// .latch input output [type control] [init]
+			if (toks.size() < 3 || toks.size() > 6)
+				import_error(line, "invalid .latch");
+			auto& m = get_mod();
+
+			bool clocked = toks.size() >= 5 && toks[4] != "NIL";
+			if (!clocked)
+				import_error(line, ".latch without clock is not supported (there is no global clock)");
+
+			std::string const& type = toks[3];
+			int d   = m.net(toks[1]);
+			int clk = m.net(toks[4]);
+			int q;
+			if      (type == "ah") q = m.latch(d, clk, m.invert(clk), line);
+			else if (type == "al") q = m.latch(d, m.invert(clk), clk, line);
+			// edge triggered as master-slave pair, the master is transparent while the clock is inactive
+			else if (type == "re") q = m.latch(m.latch(d, m.invert(clk), clk, line), clk, m.invert(clk), line);
+			else if (type == "fe") q = m.latch(m.latch(d, clk, m.invert(clk), line), m.invert(clk), clk, line);
+			else import_error(line, prints(".latch type \"%s\" is not supported", type.c_str()));
+			m.alias(m.net(toks[2]), q, line);
+
+			if (toks.size() == 6 && toks[5] == "1")
+				warnings.push_back(prints("line %d: initial value 1 of .latch ignored, latches start at 0", line));
+		}
+		else if (cmd == ".subckt") {
+			if (toks.size() < 2)
+				import_error(line, "invalid .subckt");
+			auto& m = get_mod();
+
+			auto& inst = m.instances.emplace_back();
+			inst.model = toks[1];
+			inst.line = line;
+			for (size_t i=2; i<toks.size(); ++i) {
+				auto eq = toks[i].find('=');
+				if (eq == std::string::npos)
+					import_error(line, "invalid .subckt connection");
+				inst.conns.emplace_back(toks[i].substr(0, eq), m.net(toks[i].substr(eq+1)));
+			}
+		}
+		else if (cmd == ".end") {
+			mod = nullptr;
+		}
+		else if (cmd == ".gate" || cmd == ".mlatch" || cmd == ".exdc") {
+			import_error(line, prints("%s is not supported", cmd.c_str()));
+		}
+		else {
+			// timing and clock annotations don't matter for a unit delay simulation
+			warnings.push_back(prints("line %d: ignoring %s", line, cmd.c_str()));
+		}
+	}
+	finish_cover();
+}
+
+////
+// Tokenizer for structural verilog, reading the file in blocks
+struct VerilogLexer {
+	FILE* file;
+	char  buf[1 << 16];
+	int   pos = 0, len = 0;
+	int   line = 1;
+
+	std::string tok; // current token, empty at end of file
+	bool tok_ident = false; // identifier or keyword
+	int tok_line = 1;
+
+	int peek () {
+		if (pos == len) {
+			len = (int)fread(buf, 1, sizeof(buf), file);
+			pos = 0;
+			if (len <= 0) {
+				len = 0;
+				return EOF;
+			}
+		}
+		return (unsigned char)buf[pos];
+	}
+	int get () {
+		int c = peek();
+		if (c != EOF) {
+			pos++;
+			if (c == '\n') line++;
+		}
+		return c;
+	}
+
+	static bool is_ident (int c) {
+		return isalnum(c) || c == '_' || c == '$';
+	}
+
+	void skip_until (const char* end) {
+		int matched = 0, n = (int)strlen(end);
+		for (int c; matched < n && (c = get()) != EOF; )
+			matched = c == end[matched] ? matched + 1 : (c == end[0] ? 1 : 0);
+	}
+
+	void next () {
+		tok.clear();
+		tok_ident = false;
+
+		for (;;) {
+			int c = peek();
+			if (c == EOF)
+				return;
+
+			if (isspace(c)) {
+				get();
+			}
+			else if (c == '`') { // compiler directive
+				skip_until("\n");
+			}
+			else if (c == '/') {
+				get();
+				if      (peek() == '/') skip_until("\n");
+				else if (peek() == '*') { get(); skip_until("*/"); }
+				else { tok_line = line; tok = "/"; return; }
+			}
+			else if (c == '(') {
+				get();
+				if (peek() == '*') { get(); skip_until("*)"); } // attribute
+				else { tok_line = line; tok = "("; return; }
+			}
+			else {
+				break;
+			}
+		}
+
+		tok_line = line;
+		int c = get();
+
+		if (c == '\\') { // escaped identifier
+			while (peek() != EOF && !isspace(peek()))
+				tok += (char)get();
+			tok_ident = true;
+		}
+		else if (isalpha(c) || c == '_') {
+			tok_ident = true;
+			tok += (char)c;
+			while (is_ident(peek()))
+				tok += (char)get();
+		}
+		else if (isdigit(c)) { // number, including sized literals like 1'b0
+			tok += (char)c;
+			while (isdigit(peek()) || peek() == '_')
+				tok += (char)get();
+			if (peek() == '\'') {
+				tok += (char)get();
+				while (isalnum(peek()) || peek() == '_')
+					tok += (char)get();
+			}
+		}
+		else {
+			tok += (char)c;
+		}
+	}
+};
+
+struct VerilogParser {
+	VerilogLexer& lex;
+	std::vector<std::unique_ptr<ModuleBuilder>>& modules;
+	ModuleBuilder* mod = nullptr;
+
+	std::string const& tok () { return lex.tok; }
+	int line () { return lex.tok_line; }
+
+	bool is (const char* str) { return lex.tok == str; }
+	bool accept (const char* str) {
+		if (!is(str))
+			return false;
+		lex.next();
+		return true;
+	}
+	void expect (const char* str) {
+		if (!accept(str))
+			import_error(line(), prints("expected \"%s\" but found \"%s\"", str, tok().c_str()));
+	}
+	std::string ident () {
+		if (!lex.tok_ident)
+			import_error(line(), prints("expected identifier but found \"%s\"", tok().c_str()));
+		std::string s = tok();
+		lex.next();
+		return s;
+	}
+	int number () {
+		if (tok().empty() || !isdigit((unsigned char)tok()[0]))
+			import_error(line(), prints("expected number but found \"%s\"", tok().c_str()));
+		int n = atoi(tok().c_str());
+		lex.next();
+		return n;
+	}
+
+	// optional [msb:lsb], returns bit indices in declaration order, or empty if scalar
+	std::vector<int> range () {
+		std::vector<int> bits;
+		if (accept("[")) {
+			int msb = number();
+			expect(":");
+			int lsb = number();
+			expect("]");
+			int step = msb >= lsb ? -1 : 1;
+			for (int i=msb; ; i += step) {
+				bits.push_back(i);
+				if (i == lsb) break;
+			}
+		}
+		return bits;
+	}
+
+	// declare names with direction ("input", "output" or "wire")
+	void declare (std::string const& dir, std::string const& name, std::vector<int> const& bits, int decl_line) {
+		auto declare_bit = [&] (std::string const& bit) {
+			if      (dir == "input")  mod->add_input(bit, decl_line);
+			else if (dir == "output") mod->add_output(bit);
+			else                      mod->net(bit);
+		};
+
+		if (bits.empty()) {
+			declare_bit(name);
+		}
+		else {
+			mod->buses[name] = (int)bits.size();
+			for (int b : bits)
+				declare_bit(prints("%s[%d]", name.c_str(), b));
+		}
+	}
+
+	// net reference: name, name[bit] or 1 bit constant
+	int net_ref () {
+		int l = line();
+		if (!tok().empty() && isdigit((unsigned char)tok()[0])) {
+			std::string lit = tok();
+			lex.next();
+			char last = lit.back();
+			if (lit == "0" || lit == "1" || (lit.size() >= 4 && lit.compare(0, 2, "1'") == 0 && (last == '0' || last == '1')))
+				return mod->const_net(last == '1');
+			import_error(l, prints("unsupported constant \"%s\"", lit.c_str()));
+		}
+
+		std::string name = ident();
+		if (accept("[")) {
+			int bit = number();
+			expect("]");
+			return mod->net(prints("%s[%d]", name.c_str(), bit));
+		}
+		if (mod->buses.find(name) != mod->buses.end())
+			import_error(l, prints("whole-bus reference to \"%s\" is not supported", name.c_str()));
+		return mod->net(name);
+	}
+
+	// expression with ~ ! & ^ | and parentheses, creating gates while parsing
+	int expr_or () {
+		std::vector<int> ops = { expr_xor() };
+		while (accept("|"))
+			ops.push_back(expr_xor());
+		return ops.size() == 1 ? ops[0] : mod->reduce(OR_GATE, std::move(ops), false);
+	}
+	int expr_xor () {
+		std::vector<int> ops = { expr_and() };
+		while (accept("^"))
+			ops.push_back(expr_and());
+		return ops.size() == 1 ? ops[0] : mod->reduce_xor(std::move(ops), false);
+	}
+	int expr_and () {
+		std::vector<int> ops = { expr_unary() };
+		while (accept("&"))
+			ops.push_back(expr_unary());
+		return ops.size() == 1 ? ops[0] : mod->reduce(AND_GATE, std::move(ops), false);
+	}
+	int expr_unary () {
+		if (accept("~") || accept("!"))
+			return mod->invert(expr_unary());
+		if (accept("(")) {
+			int n = expr_or();
+			expect(")");
+			return n;
+		}
+		return net_ref();
+	}
+
+	void parse_module () {
+		mod = modules.emplace_back(std::make_unique<ModuleBuilder>("", line())).get();
+		mod->chip->name = ident();
+
+		if (is("#"))
+			import_error(line(), "module parameters are not supported");
+
+		// port list, ANSI style declares directions inline
+		if (accept("(")) {
+			std::string dir;
+			std::vector<int> bits;
+			while (!is(")")) {
+				int l = line();
+				if (is("input") || is("output") || is("inout")) {
+					dir = tok();
+					lex.next();
+					if (dir == "inout")
+						import_error(l, "inout ports are not supported");
+					accept("wire");
+					bits = range(); // applies to following names until the next direction
+				}
+				else if (dir.empty()) {
+					bits = range();
+				}
+				std::string name = ident();
+				if (!dir.empty())
+					declare(dir, name, bits, l);
+				mod->ports.push_back(name);
+
+				if (!accept(","))
+					break;
+			}
+			expect(")");
+		}
+		expect(";");
+
+		while (!accept("endmodule")) {
+			if (tok().empty())
+				import_error(line(), "missing endmodule");
+			parse_item();
+		}
+		mod = nullptr;
+	}
+
+	void parse_item () {
+		int l = line();
+		std::string kw = ident();
+
+		if (kw == "input" || kw == "output" || kw == "wire") {
+			accept("wire");
+			auto bits = range();
+			do {
+				declare(kw, ident(), bits, l);
+			} while (accept(","));
+			expect(";");
+		}
+		else if (kw == "assign") {
+			do {
+				int al = line();
+				int lhs = net_ref();
+				expect("=");
+				mod->alias(lhs, expr_or(), al);
+			} while (accept(","));
+			expect(";");
+		}
+		else if (kw == "and" || kw == "nand" || kw == "or" || kw == "nor" ||
+		         kw == "xor" || kw == "xnor" || kw == "not" || kw == "buf") {
+			skip_delay();
+			do {
+				parse_primitive(kw);
+			} while (accept(","));
+			expect(";");
+		}
+		else if (kw == "reg" || kw == "always" || kw == "initial" || kw == "inout" || kw == "parameter" || kw == "function") {
+			import_error(l, prints("\"%s\" is not supported (only structural verilog)", kw.c_str()));
+		}
+		else {
+			// module instance
+			if (is("#"))
+				import_error(line(), "instance parameters are not supported");
+			do {
+				parse_instance(kw);
+			} while (accept(","));
+			expect(";");
+		}
+	}
+
+	void skip_delay () {
+		if (!accept("#"))
+			return;
+		if (accept("(")) {
+			while (!accept(")")) {
+				if (tok().empty()) import_error(line(), "unterminated delay");
+				lex.next();
+			}
+		}
+		else {
+			lex.next();
+		}
+	}
+
+	void parse_primitive (std::string const& kw) {
+		int l = line();
+		std::string name = is("(") ? "" : ident();
+
+		std::vector<int> terms;
+		expect("(");
+		do {
+			terms.push_back(net_ref());
+		} while (accept(","));
+		expect(")");
+
+		if (terms.size() < 2)
+			import_error(l, prints("%s needs an output and an input", kw.c_str()));
+
+		size_t parts_before = mod->chip->parts.vec.size();
+
+		if (kw == "not" || kw == "buf") {
+			// any number of outputs, input last
+			int in = terms.back();
+			int out = kw == "not" ? mod->invert(in) : in;
+			for (size_t i=0; i+1<terms.size(); ++i)
+				mod->alias(terms[i], out, l);
+		}
+		else {
+			std::vector<int> ins(terms.begin()+1, terms.end());
+			bool inv = kw == "nand" || kw == "nor" || kw == "xnor";
+
+			int out;
+			if      (kw == "and" || kw == "nand") out = mod->reduce(AND_GATE, std::move(ins), inv);
+			else if (kw == "or"  || kw == "nor" ) out = mod->reduce(OR_GATE,  std::move(ins), inv);
+			else                                  out = mod->reduce_xor(std::move(ins), inv);
+			mod->alias(terms[0], out, l);
+		}
+
+		// name the gate that drives the output
+		if (!name.empty() && mod->chip->parts.vec.size() > parts_before)
+			mod->chip->parts.vec.back()->name = std::move(name);
+	}
+
+	void parse_instance (std::string const& model) {
+		auto& inst = mod->instances.emplace_back();
+		inst.model = model;
+		inst.line = line();
+		inst.name = ident();
+
+		expect("(");
+		if (!is(")")) {
+			do {
+				if (accept(".")) {
+					std::string formal = ident();
+					expect("(");
+					if (!accept(")")) { // .a() is unconnected
+						inst.conns.emplace_back(std::move(formal), net_ref());
+						expect(")");
+					}
+				}
+				else {
+					inst.conns.emplace_back("", net_ref());
+				}
+			} while (accept(","));
+		}
+		expect(")");
+	}
+
+	void parse () {
+		lex.next();
+		while (!tok().empty()) {
+			if (!accept("module"))
+				import_error(line(), prints("expected module but found \"%s\"", tok().c_str()));
+			parse_module();
+		}
+	}
+};
+
+////
+// deps first, detects recursive instantiation
+void sort_modules (std::vector<std::unique_ptr<ModuleBuilder>>& modules, std::unordered_map<std::string, ModuleBuilder*> const& name2mod) {
+	std::vector<std::unique_ptr<ModuleBuilder>> sorted;
+	std::unordered_map<ModuleBuilder*, int> state; // 1: visiting, 2: done
+	std::unordered_map<ModuleBuilder*, std::unique_ptr<ModuleBuilder>*> owner;
+	for (auto& m : modules)
+		owner[m.get()] = &m;
+
+	auto visit = [&] (auto& visit, ModuleBuilder* m) -> void {
+		int& s = state[m];
+		if (s == 2) return;
+		if (s == 1)
+			import_error(m->line, prints("module \"%s\" instantiates itself", m->chip->name.c_str()));
+		s = 1;
+		for (auto& inst : m->instances) {
+			auto it = name2mod.find(inst.model);
+			if (it != name2mod.end())
+				visit(visit, it->second);
+		}
+		state[m] = 2;
+		sorted.push_back(std::move(*owner[m]));
+	};
+	for (auto& m : modules) {
+		if (m)
+			visit(visit, m.get());
+	}
+	modules = std::move(sorted);
+}
+
+}
+
+std::shared_ptr<Chip> import_netlist (LogicSim& sim, std::string const& filepath, std::string* error, std::vector<std::string>* warnings) {
+	ZoneScoped;
+
+	std::vector<std::string> warns;
+
+	std::vector<std::unique_ptr<ModuleBuilder>> modules;
+	ModuleBuilder* top = nullptr;
+
+	try {
+		bool blif = filepath.size() >= 5 && filepath.compare(filepath.size()-5, 5, ".blif") == 0;
+
+		if (blif) {
+			std::ifstream file(filepath);
+			if (!file)
+				throw ImportError{ prints("could not open \"%s\"", filepath.c_str()) };
+			parse_blif(file, modules, warns);
+
+			// by convention the first model is the top-level one
+			if (!modules.empty())
+				top = modules.front().get();
+		}
+		else {
+			FILE* file = fopen(filepath.c_str(), "rb");
+			if (!file)
+				throw ImportError{ prints("could not open \"%s\"", filepath.c_str()) };
+
+			auto lex = std::make_unique<VerilogLexer>();
+			lex->file = file;
+			VerilogParser p = { *lex, modules };
+			try {
+				p.parse();
+			}
+			catch (ImportError&) {
+				fclose(file);
+				throw;
+			}
+			fclose(file);
+
+			// top-level is the last module not instantiated by any other
+			std::unordered_set<std::string> instanced;
+			for (auto& m : modules) {
+				for (auto& inst : m->instances)
+					instanced.insert(inst.model);
+			}
+			for (auto& m : modules) {
+				if (!instanced.contains(m->chip->name))
+					top = m.get();
+			}
+		}
+
+		if (!top)
+			throw ImportError{ "no modules found" };
+
+		std::unordered_map<std::string, ModuleBuilder*> name2mod;
+		for (auto& m : modules) {
+			if (!name2mod.emplace(m->chip->name, m.get()).second)
+				import_error(m->line, prints("module \"%s\" defined twice", m->chip->name.c_str()));
+		}
+
+		sort_modules(modules, name2mod);
+
+		for (auto& m : modules) {
+			m->link(name2mod);
+			layout_chip(*m->chip);
+		}
+	}
+	catch (ImportError& e) {
+		if (error)
+			*error = std::move(e.msg);
+		return nullptr;
+	}
+
+	// chips are picked by name in the library, so don't add a second chip of the same name
+	std::unordered_set<std::string> names;
+	for (auto& c : sim.saved_chips)
+		names.insert(c->name);
+
+	for (auto& m : modules) {
+		std::string name = m->chip->name;
+		for (int i=2; names.contains(name); ++i)
+			name = prints("%s_%d", m->chip->name.c_str(), i);
+
+		if (name != m->chip->name) {
+			warns.push_back(prints("\"%s\" already exists, imported as \"%s\"", m->chip->name.c_str(), name.c_str()));
+			m->chip->name = name;
+		}
+		names.insert(name);
+	}
+
+	for (auto& m : modules)
+		sim.saved_chips.emplace_back(m->chip);
+
+	sim.recompute_chip_users();
+	sim.update_all_chip_state_indices();
+	sim.unsaved_changes = true;
+
+	if (warnings)
+		*warnings = std::move(warns);
+	return top->chip;
+}
+
+}
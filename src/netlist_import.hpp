@@ -0,0 +1,31 @@
+#pragma once
+#include "common.hpp"
+#include "logic_sim.hpp"
+
+namespace logic_sim {
+
+// Import of gate-level netlists from other tools (eg. the ISCAS and EPFL benchmark suites) as chips
+// files are parsed in a single streaming pass, gates are created as soon as they are read,
+// only module instances (whose module might be defined later in the file) are resolved at the end
+//
+// BLIF (.blif):
+//   .model .inputs .outputs .names (any single output cover) .latch .subckt .end
+//   covers become AND/OR trees with NOT gates for complemented literals
+//   latches need a clock net (there is no global clock) and are built from gates: ah/al as gated latches, re/fe as master-slave pairs,
+//   asynchronous latches and clockless ones are rejected, init values are ignored (latches start at 0)
+// Structural Verilog (.v):
+//   module/endmodule with ANSI or non-ANSI ports, input/output/wire declarations (buses are expanded to bits),
+//   primitive gates (and nand or nor xor xnor not buf), assign with ~ & | ^ expressions, module instances (named or positional)
+//   whole-bus references and behavioral code are not supported
+//
+// each model/module becomes a chip with levelized grid layout: parts are placed in columns by logic depth
+// nets that are only renamed (assign a = b) do not create buffers, so they don't add ticks of delay
+
+// appends the imported chips to saved_chips (dependencies first), returns the top-level chip
+// chips named like an existing saved chip get a _2, _3 ... suffix
+// returns nullptr and leaves sim untouched on error, error is set to a message with the line number
+// warnings (ignored directives, renamed chips) are set on success
+std::shared_ptr<Chip> import_netlist (LogicSim& sim, std::string const& filepath, std::string* error,
+                                      std::vector<std::string>* warnings=nullptr);
+
+}
@@ -1,19 +1,55 @@
 #include "renderer.hpp"
 #include "../game.hpp"
 #include "../logic_sim.hpp"
+#include "../parallel.hpp"
+#include "../activity.hpp"
 
 using namespace logic_sim;
 
 namespace ogl {
 
-void Renderer::build_line (float2x3 const& chip2world,
+void StateBuffer::update (LogicSim& sim, ToggleActivity& activity) {
+	ZoneScoped;
+
+	bool heatmap = activity.show_heatmap && !activity.toggles().empty();
+	if (heatmap && (sim.state_changed || heat_scale == 0)) {
+		activity.flush();
+		upload_ssbo(ssbo_activity, activity.toggles());
+		heat_scale = 1.0f / logf(1.0f + (float)max(activity.max_toggles(), 1u));
+		activity_valid = true;
+	}
+	else if (!heatmap) {
+		heat_scale = 0;
+		// never read with heat_scale 0, but should not be bound without storage
+		static constexpr uint32_t NO_ACTIVITY = 0;
+		if (!activity_valid)
+			upload_ssbo(ssbo_activity, &NO_ACTIVITY, sizeof(NO_ACTIVITY));
+		activity_valid = true;
+	}
+
+	if (!sim.state_changed)
+		return;
+
+	upload_ssbo(ssbo_prev, sim.state[sim.cur_state^1]);
+	upload_ssbo(ssbo_cur , sim.state[sim.cur_state  ]);
+	// empty ssbo would be uninitialized, so upload one zero word
+	static constexpr uint32_t NONE_UNKNOWN = 0;
+	if (sim.xstate[sim.cur_state].empty())
+		upload_ssbo(ssbo_unknown, &NONE_UNKNOWN, sizeof(NONE_UNKNOWN));
+	else
+		upload_ssbo(ssbo_unknown, sim.xstate[sim.cur_state]);
+
+	sim.state_changed = false;
+}
+
+void Renderer::build_line (ChipMesh& out_mesh, float2x3 const& chip2world,
 		float2 start0, float2 start1, std::vector<float2> const& points, float2 end0, float2 end1,
-		int states, lrgba col) {
+		int state_idx, lrgba col) {
 	float2 prev = chip2world * end1;
 	float dist = 0;
 		
 	size_t count = 3 + points.size();
-	auto* lines = push_back(line_renderer.lines, count);
+	auto* lines = push_back(out_mesh.lines, count);
 
 	auto* out = lines;
 
@@ -25,7 +61,7 @@ void Renderer::build_line (float2x3 const& chip2world,
 		float dist0 = dist;
 		dist += distance(prev, cur);
 
-		*out++ = { prev, cur, float2(dist0, dist), radius, states, col, wire_id };
+		*out++ = { prev, cur, float2(dist0, dist), radius, state_idx, col, out_mesh.wire_count };
 
 		prev = cur;
 	};
@@ -47,8 +83,8 @@ void Renderer::build_line (float2x3 const& chip2world,
 		lines[i].t = 1.0f - (lines[i].t * norm);
 	}
 }
-void Renderer::build_line (float2x3 const& chip2world, float2 a, float2 b, int states, lrgba col) {
-	auto* out = push_back(line_renderer.lines, 1);
+void Renderer::build_line (ChipMesh& out_mesh, float2x3 const& chip2world, float2 a, float2 b, int state_idx, lrgba col) {
+	auto* out = push_back(out_mesh.lines, 1);
 
 	float radius = abs(((float2x2)chip2world * float2(0.05f)).x);
 
@@ -56,172 +92,250 @@ void Renderer::build_line (float2x3 const& chip2world, float2 a, float2 b, int s
 		float2 p0 = chip2world * a;
 		float2 p1 = chip2world * b;
 
-		*out++ = { p0, p1, float2(0, 1), radius, states, col, wire_id };
+		*out++ = { p0, p1, float2(0, 1), radius, state_idx, col, out_mesh.wire_count };
 	}
 }
 
-void Renderer::draw_gate (float2x3 const& mat, float2 size, int type, int state, lrgba col) {
+void Renderer::draw_gate (ChipMesh& out, float2x3 const& mat, float2 size, int type, int state_idx, lrgba col) {
 	//if (type < 2)
 	//	return; // TEST: don't draw INP/OUT_PINs
 
 	if (type >= AND3_GATE)
 		type = type - AND3_GATE + AND_GATE;
 
-	uint16_t idx = (uint16_t)tri_renderer.verticies.size();
+	auto& gate = out.gates.emplace_back();
+	gate.pos       = mat * float2(0);
+	gate.axis_x    = (float2x2)mat * float2(1,0);
+	gate.axis_y    = (float2x2)mat * float2(0,1);
+	gate.size      = size;
+	gate.gate_type = type;
+	gate.state_idx = state_idx;
+	gate.col       = col;
+}
+
+// build gates and wires of chip in chip space, subchips are drawn as seperate instances by draw_chip
+void Renderer::build_chip_mesh (Chip& chip) {
+	ZoneScoped;
+
+	auto& mesh = chip.mesh;
+	mesh.clear();
+	
+	auto draw_part = [&] (Part* part) {
+		auto part2chip = part->pos.calc_matrix();
 		
-	constexpr float2 verts[] = {
-		float2(-0.5f, -0.5f),
-		float2(+0.5f, -0.5f),
-		float2(+0.5f, +0.5f),
-		float2(-0.5f, +0.5f),
+		if (is_gate(part->chip)) {
+			draw_gate(mesh, part2chip, part->chip->size, gate_type(part->chip), part->sid, lrgba(part->chip->col, 1));
+		}
+	
+		constexpr lrgba line_col = lrgba(0.8f, 0.01f, 0.025f, 1);
+			
+		for (int i=0; i<(int)part->chip->inputs.size(); ++i) {
+			auto& inp = part->chip->inputs[i];
+				
+			// center position input
+			float2 dst0 = part2chip * get_inp_pos(*inp);
+			float2 dst1 = part2chip * inp->pos.pos;
+
+			auto& inp_wire = part->inputs[i];
+			if (!inp_wire.part) {
+				build_line(mesh, float2x3::identity(), dst0, dst1, STATE_IDX_OFF, line_col);
+			}
+			else {
+				// get connected part
+				auto& src_part = *inp_wire.part;
+				
+				// center position of connected output
+				auto smat = src_part.pos.calc_matrix();
+				auto& spart = *src_part.chip->outputs[inp_wire.pin];
+				float2 src0 = smat * spart.pos.pos;
+				float2 src1 = smat * get_out_pos(spart);
+				
+				build_line(mesh, float2x3::identity(),
+					src0, src1, inp_wire.wire_points, dst0, dst1,
+					src_part.sid + inp_wire.pin, line_col);
+			}
+
+			mesh.wire_count++;
+		}
 	};
 
-	auto* pv = push_back(tri_renderer.verticies, 4);
-	pv[0] = { mat * (verts[0] * size), (verts[0] * size) + 0.5f, type, state, col };
-	pv[1] = { mat * (verts[1] * size), (verts[1] * size) + 0.5f, type, state, col };
-	pv[2] = { mat * (verts[2] * size), (verts[2] * size) + 0.5f, type, state, col };
-	pv[3] = { mat * (verts[3] * size), (verts[3] * size) + 0.5f, type, state, col };
-		
-	auto* pi = push_back(tri_renderer.indices, 6);
-	ogl::push_quad(pi, idx+0, idx+1, idx+2, idx+3);
+	for (auto& part : chip.inputs) {
+		draw_part(part.get());
+	}
+	for (auto& part : chip.outputs) {
+		draw_part(part.get());
+	}
+	for (auto& part : chip.parts) {
+		draw_part(part.get());
+	}
+
+	mesh.valid = true;
 }
 
-void Renderer::draw_chip (Game& g, Chip* chip, float2x3 const& chip2world, int chip_state, lrgba col) {
-	auto& editor = g.editor;
+// build all stale meshes of chips used (recursively) by root in parallel, each mesh only depends on its own chip
+void Renderer::build_stale_meshes (Chip* root) {
+	ZoneScoped;
+
+	std::vector<Chip*> stale;
+	std::unordered_set<Chip*> visited;
+
+	auto collect = [&] (Chip* chip, auto& collect) -> void {
+		if (!visited.insert(chip).second)
+			return;
+		if (!chip->mesh.valid)
+			stale.push_back(chip);
 
-	uint8_t* prev = g.sim.state[g.sim.cur_state^1].data();
-	uint8_t* cur  = g.sim.state[g.sim.cur_state  ].data();
+		for (auto& part : chip->parts) {
+			if (!is_gate(part->chip))
+				collect(part->chip, collect);
+		}
+	};
+	collect(root, collect);
 
-	//auto chip_id = ChipInstanceID{ chip, chip_state };
+	worker_pool().parallel_for((int)stale.size(), [&] (int i) {
+		build_chip_mesh(*stale[i]);
+	});
+}
+
+// add an instance of a custom chip and recursively its subchips
+// chip_state < 0 draws the chip without sim state (always on), used for previews
+// builds stale meshes on the fly, only call on multiple threads after build_stale_meshes()
+void Renderer::draw_chip (DrawChunk& out, Chip* chip, float2x3 const& chip2world, int chip_state, lrgba col) {
+	assert(!is_gate(chip));
+
+	if (!chip->mesh.valid)
+		build_chip_mesh(*chip);
+
+	out.add_instance(&chip->mesh, chip2world, chip_state, col);
 	
-	if (is_gate(chip)) {
-		auto type = gate_type(chip);
-		uint8_t state = chip_state >= 0 ? cur[chip_state] : 1;
-			
-		draw_gate(chip2world, chip->size, type, state, lrgba(chip->col, 1) * col);
+	{ // TODO: make this look nicer, rounded thick outline? color the background inside chip differently?
+		float2 center = chip2world * float2(0);
+		float2 size = abs( (float2x2)chip2world * chip->size );
+		out.chip_outlines.push_back({ center, size });
 	}
-	else {
-		{ // TODO: make this look nicer, rounded thick outline? color the background inside chip differently?
-			float2 center = chip2world * float2(0);
-			float2 size = abs( (float2x2)chip2world * chip->size );
-			dbgdraw.wire_quad(float3(center - size*0.5f, 0.0f), size, lrgba(0.001f, 0.001f, 0.001f, 1));
+
+	for (auto& part : chip->parts) {
+		if (!is_gate(part->chip)) {
+			auto part2world = chip2world * part->pos.calc_matrix();
+			draw_chip(out, part->chip, part2world, chip_state >= 0 ? chip_state + part->sid : -1, col);
 		}
+	}
+}
+
+void Renderer::build_scene (Game& g) {
+	if (!g.sim.layout_changed)
+		return;
+	ZoneScoped;
+
+	auto* root = g.sim.viewed_chip.get();
+	
+	build_stale_meshes(root);
+
+	scene.clear();
+	
+	// root instance itself, then traverse the subchips of the root in contiguous ranges on the worker threads
+	// chunks are appended in order, so wire ids (and thus wire depth order) are the same as when traversing on one thread
+	scene.add_instance(&root->mesh, float2x3::identity(), 0, lrgba(1));
+	{
+		float2 size = abs(root->size);
+		scene.chip_outlines.push_back({ float2(0), size });
+	}
+
+	std::vector<Part*> subchips;
+	for (auto& part : root->parts) {
+		if (!is_gate(part->chip))
+			subchips.push_back(part.get());
+	}
+
+	auto& pool = worker_pool();
+	int chunk_count = min((int)subchips.size(), pool.concurrency() * 4);
+	std::vector<DrawChunk> chunks(chunk_count);
+
+	pool.parallel_for(chunk_count, [&] (int i) {
+		size_t begin = subchips.size() *  i    / chunk_count;
+		size_t end   = subchips.size() * (i+1) / chunk_count;
+
+		for (size_t j=begin; j<end; ++j) {
+			auto* part = subchips[j];
+			draw_chip(chunks[i], part->chip, part->pos.calc_matrix(), part->sid, lrgba(1));
+		}
+	});
+
+	for (auto& chunk : chunks)
+		scene.append(chunk);
+
+	scene.upload();
+
+	g.sim.layout_changed = false;
+}
+
+void Renderer::build_overlay (Game& g) {
+	ZoneScoped;
+
+	overlay.clear(scene.wire_count);
+	overlay_mesh.clear();
+
+	if (g.editor.in_mode<Editor::WireMode>()) { // Wire preview
+		auto& w = std::get<Editor::WireMode>(g.editor.mode);
 		
-		auto draw_part = [&] (Part* part) {
-			uint8_t* prev = g.sim.state[g.sim.cur_state^1].data();
-			uint8_t* cur  = g.sim.state[g.sim.cur_state  ].data();
-		
-			auto part2chip = part->pos.calc_matrix();
-			auto part2world = chip2world * part2chip;
+		if (w.dst.part || w.src.part) {
+			auto& out = w.dir ? w.dst : w.src;
+			auto& inp = w.dir ? w.src : w.dst;
 
-			auto* sel = g.editor.in_mode<Editor::EditMode>() ?
-				&std::get<Editor::EditMode>(g.editor.mode).sel : nullptr;
+			float2 out0 = w.unconn_pos, out1 = w.unconn_pos;
+			float2 inp0 = w.unconn_pos, inp1 = w.unconn_pos;
 		
-			draw_chip(g, part->chip, part2world, chip_state >= 0 ? chip_state + part->sid : -1, col);
+			if (out.part) {
+				auto  mat  = out.part->pos.calc_matrix();
+				auto& part = *out.part->chip->outputs[out.pin];
+				out0 = mat * part.pos.pos;
+				out1 = mat * get_out_pos(part);
+			}
+			if (inp.part) {
+				auto  mat  = inp.part->pos.calc_matrix();
+				auto& part = *inp.part->chip->inputs[inp.pin];
+				inp0 = mat * get_inp_pos(part);
+				inp1 = mat * part.pos.pos;
+			}
 		
-			constexpr lrgba line_col = lrgba(0.8f, 0.01f, 0.025f, 1);
+			build_line(overlay_mesh, w.chip2world, out0, out1, w.points, inp0, inp1, STATE_IDX_ON, lrgba(0.8f, 0.01f, 0.025f, 0.75f));
+			
+			overlay_mesh.wire_count++;
+		}
+	}
+
+	if (g.editor.in_mode<Editor::PlaceMode>() && g.editor._cursor_valid) { // Gate preview
+		auto& preview = std::get<Editor::PlaceMode>(g.editor.mode).preview_part;
+
+		assert(preview.chip);
+		auto part2chip = preview.pos.calc_matrix();
+
+		constexpr lrgba preview_col = lrgba(1,1,1,0.5f);
+
+		if (is_gate(preview.chip))
+			draw_gate(overlay_mesh, part2chip, preview.chip->size, gate_type(preview.chip), STATE_IDX_ON, lrgba(preview.chip->col, 1) * preview_col);
+		else
+			draw_chip(overlay, preview.chip, part2chip, -1, preview_col);
 				
-			for (int i=0; i<(int)part->chip->inputs.size(); ++i) {
-				auto& inp = part->chip->inputs[i];
-					
-				// center position input
-				float2 dst0 = part2chip * get_inp_pos(*inp);
-				float2 dst1 = part2chip * inp->pos.pos;
-
-				auto& inp_wire = part->inputs[i];
-				if (!inp_wire.part) {
-					build_line(chip2world, dst0, dst1, 0, line_col);
-				}
-				else {
-					// get connected part
-					auto& src_part = *inp_wire.part;
-					
-					// center position of connected output
-					auto smat = src_part.pos.calc_matrix();
-					auto& spart = *src_part.chip->outputs[inp_wire.pin];
-					float2 src0 = smat * spart.pos.pos;
-					float2 src1 = smat * get_out_pos(spart);
-
-					uint8_t prev_state = chip_state >= 0 ? prev[chip_state + src_part.sid + inp_wire.pin] : 1;
-					uint8_t  cur_state = chip_state >= 0 ? cur [chip_state + src_part.sid + inp_wire.pin] : 1;
-					int state = (prev_state << 1) | cur_state;
-					
-					build_line(chip2world,
-						src0, src1, inp_wire.wire_points, dst0, dst1,
-						state, line_col);
-				}
-
-				wire_id++;
-			}
+		constexpr lrgba col = lrgba(0.8f, 0.01f, 0.025f, 0.5f);
 				
-			//for (int i=0; i<(int)part.chip->outputs.size(); ++i) {
-			//	{ // TODO: always draw output wire for now
-			//		// center position output
-			//		auto& spart = part.chip->get_output(i);
-			//		float2 dst0 = part2chip * spart.pos.pos;
-			//		float2 dst1 = part2chip * get_out_pos(spart);
-			//	
-			//		uint8_t prev_state = chip_state >= 0 ? prev[chip_state + part.state_idx + i] : 1;
-			//		uint8_t  cur_state = chip_state >= 0 ? cur [chip_state + part.state_idx + i] : 1;
-			//		int state = (prev_state << 1) | cur_state;
-			//	
-			//		build_line(chip2world, dst0, dst1, state, col);
-			//	}
-			//}
-		};
-
-		for (auto& part : chip->inputs) {
-			draw_part(part.get());
-		}
-		for (auto& part : chip->outputs) {
-			draw_part(part.get());
-		}
-		for (auto& part : chip->parts) {
-			draw_part(part.get());
-		}
+		for (auto& inp : preview.chip->inputs) {
+			float2 dst0 = part2chip * get_inp_pos(*inp);
+			float2 dst1 = part2chip * inp->pos.pos;
 
-		if (g.editor.in_mode<Editor::WireMode>()) { // Wire preview
-			auto& w = std::get<Editor::WireMode>(g.editor.mode);
-			
-			if ((w.dst.part || w.src.part) && w.chip.ptr == chip) {
-				ZoneScopedN("push wire_preview");
-					
-				auto& out = w.dir ? w.dst : w.src;
-				auto& inp = w.dir ? w.src : w.dst;
-
-				float2 out0 = w.unconn_pos, out1 = w.unconn_pos;
-				float2 inp0 = w.unconn_pos, inp1 = w.unconn_pos;
-			
-				if (out.part) {
-					auto  mat  = out.part->pos.calc_matrix();
-					auto& part = *out.part->chip->outputs[out.pin];
-					out0 = mat * part.pos.pos;
-					out1 = mat * get_out_pos(part);
-				}
-				if (inp.part) {
-					auto  mat  = inp.part->pos.calc_matrix();
-					auto& part = *inp.part->chip->inputs[inp.pin];
-					inp0 = mat * get_inp_pos(part);
-					inp1 = mat * part.pos.pos;
-				}
-			
-				build_line(chip2world, out0, out1, w.points, inp0, inp1, 3, lrgba(0.8f, 0.01f, 0.025f, 0.75f));
+			build_line(overlay_mesh, float2x3::identity(), dst0, dst1, STATE_IDX_OFF, col);
 				
-				wire_id++;
-			}
+			overlay_mesh.wire_count++;
 		}
 	}
 
+	overlay.add_instance(&overlay_mesh, float2x3::identity(), -1, lrgba(1));
+	overlay.upload();
 }
 	
 void Renderer::begin (Window& window, Game& g, int2 window_size) {
 	dbgdraw.clear();
 	text_renderer.begin();
-
-	tri_renderer.update(window.input);
-	line_renderer.update(window.input);
-
-	wire_id = 0;
 }
 
 void Renderer::end (Window& window, Game& g, int2 window_size) {
@@ -262,35 +376,20 @@ void Renderer::end (Window& window, Game& g, int2 window_size) {
 
 
 	{ // Gates and wires
-		ZoneScopedN("push gates");
-			
-		draw_chip(g, g.sim.viewed_chip.get(), float2x3::identity(), 0, lrgba(1));
-	}
-		
-	{ // Gate preview
-		if (g.editor.in_mode<Editor::PlaceMode>() && g.editor._cursor_valid) {
-			auto& preview = std::get<Editor::PlaceMode>(g.editor.mode).preview_part;
-
-			assert(preview.chip);
-			auto part2chip = preview.pos.calc_matrix();
-
-			draw_chip(g, preview.chip, part2chip, -1, lrgba(1,1,1,0.5f));
-					
-			constexpr lrgba col = lrgba(0.8f, 0.01f, 0.025f, 0.5f);
-					
-			for (auto& inp : preview.chip->inputs) {
-				float2 dst0 = part2chip * get_inp_pos(*inp);
-				float2 dst1 = part2chip * inp->pos.pos;
-
-				build_line(float2x3::identity(), dst0, dst1, 0, col);
-					
-				wire_id++;
-			}
+		build_scene(g);
+		build_overlay(g);
+
+		for (auto* list : { &scene, &overlay }) {
+			for (auto& o : list->chip_outlines)
+				dbgdraw.wire_quad(float3(o.center - o.size*0.5f, 0.0f), o.size, lrgba(0.001f, 0.001f, 0.001f, 1));
 		}
+
+		state_buffer.update(g.sim, g.activity);
+		state_buffer.bind();
 	}
 		
-	line_renderer.render(state, g.sim_t, wire_id);
-	tri_renderer.render(state);
+	line_renderer.render(state, { &scene, &overlay }, g.sim_t, overlay.wire_count, state_buffer.heat_scale);
+	gate_renderer.render(state, { &scene, &overlay }, state_buffer.heat_scale);
 
 	gl_dbgdraw.render(state, dbgdraw);
 	
@@ -7,122 +7,296 @@
 struct Game;
 namespace logic_sim {
 	struct Chip;
+	struct LogicSim;
+	struct ToggleActivity;
 }
 
 namespace ogl {
 
-struct TriRenderer {
-	Shader* shad  = g_shaders.compile("gates");
+// special state indices for gates and wires that are not backed by a sim state (see sim_state.glsl)
+inline constexpr int STATE_IDX_ON  = -1; // always on  (previews)
+inline constexpr int STATE_IDX_OFF = -2; // always off (unconnected wires)
 
-	struct Vertex {
-		float2 pos;
-		float2 uv;
-		int    gate_type;
-		int    gate_state;
-		float4 col;
+// (re)allocate ssbo and upload data, size padded to multiple of 4 (also avoids zero-sized buffers)
+inline void upload_ssbo (Vbo& ssbo, void const* data, size_t size) {
+	size_t alloc = max((size + 3) & ~(size_t)3, (size_t)4);
 
-		ATTRIBUTES {
-			ATTRIB( idx++, GL_FLOAT,2, Vertex, pos);
-			ATTRIB( idx++, GL_FLOAT,2, Vertex, uv);
-			ATTRIBI(idx++, GL_INT,  1, Vertex, gate_type);
-			ATTRIBI(idx++, GL_INT,  1, Vertex, gate_state);
-			ATTRIB( idx++, GL_FLOAT,4, Vertex, col);
-		}
-	};
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, alloc, nullptr, GL_STREAM_DRAW);
+	if (size > 0)
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, size, data);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+template <typename T>
+inline void upload_ssbo (Vbo& ssbo, std::vector<T> const& vec) {
+	upload_ssbo(ssbo, vec.data(), vec.size() * sizeof(T));
+}
+
+// prev and cur sim state as SSBOs, so that gates and wires can stay in retained buffers and just index their state by sid
+// only reuploaded when the state actually changed (sim tick or gate toggle), not every frame
+// the x plane of the cur state is uploaded as well in ternary mode (empty otherwise), so unknown gates and wires can be highlighted
+// while the activity heatmap is shown the toggle counts are uploaded too, so gates and wires can be colored by them
+// (bindings 4 to 6 are the mesh and instance buffers of GateRenderer and LineRenderer, 1 is the indirect buffer of gl_dbgdraw)
+struct StateBuffer {
+	static constexpr int PREV_BINDING     = 2;
+	static constexpr int CUR_BINDING      = 3;
+	static constexpr int UNKNOWN_BINDING  = 7;
+	static constexpr int ACTIVITY_BINDING = 8;
+
+	Vbo ssbo_prev     = {"StateBuffer.prev"};
+	Vbo ssbo_cur      = {"StateBuffer.cur"};
+	Vbo ssbo_unknown  = {"StateBuffer.unknown"};
+	Vbo ssbo_activity = {"StateBuffer.activity"};
+
+	// 1 / log(1 + max toggles) for the shaders, 0 if the heatmap is off
+	float heat_scale = 0;
+	bool  activity_valid = false;
+
+	void update (logic_sim::LogicSim& sim, logic_sim::ToggleActivity& activity);
+
+	void bind () {
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PREV_BINDING,     ssbo_prev);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CUR_BINDING,      ssbo_cur);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, UNKNOWN_BINDING,  ssbo_unknown);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ACTIVITY_BINDING, ssbo_activity);
+	}
+};
 
-	VertexBufferI vbo_tris = vertex_bufferI<Vertex>("TriRenderer.Vertex");
+// These are read from SSBOs, so layouts need to match std430 in gates.glsl, wires.glsl and chip_instances.glsl
+
+// A gate in chip space, the quad is expanded in gates.glsl
+struct GateInstance {
+	float2 pos;    // gate center
+	float2 axis_x; // gate2chip matrix columns
+	float2 axis_y;
+	float2 size;
+	int    gate_type;
+	int    state_idx; // relative to chip instance state_base
+	int    _pad[2];
+	float4 col;
+};
+// A wire segment in chip space
+struct LineInstance {
+	float2 pos0;
+	float2 pos1;
+	float2 t; // t0 t1
+	float  radius;
+	int    state_idx; // relative to chip instance state_base
+	float4 col;
+	int    wire_id;   // relative to chip instance wire_base
+	int    _pad[3];
+};
+// A placed (custom) chip, every gate and wire of its mesh gets drawn once per instance
+struct ChipInstance {
+	float2 pos;    // chip2world matrix columns
+	float2 axis_x;
+	float2 axis_y;
+	int    state_base; // < 0 for previews
+	int    wire_base;
+	float4 col;
+};
 
-	std::vector<Vertex>   verticies;
-	std::vector<uint16_t> indices;
+// Gates and wires of a single chip in chip space (subchips are not included, they are drawn as their own instances)
+// cached in Chip::mesh, so that a chip placed many times is only built and uploaded once
+struct ChipMesh {
+	std::vector<GateInstance> gates;
+	std::vector<LineInstance> lines;
+
+	int wire_count = 0;
 
-	void update (Input& I) {
-		verticies.clear();
-		verticies.shrink_to_fit();
-		indices  .clear();
-		indices  .shrink_to_fit();
+	bool valid = false;
+
+	void clear () {
+		gates.clear();
+		lines.clear();
+		wire_count = 0;
 	}
+};
 
-	void render (StateManager& state) {
-		ZoneScoped;
+// Chip meshes to draw, grouped by mesh so that all instances of a chip are drawn in one instanced draw call
+// cpu side only, so that chunks can be built on worker threads and appended afterwards
+struct DrawChunk {
+	struct Outline {
+		float2 center;
+		float2 size;
+	};
+	struct Batch {
+		ChipMesh* mesh;
+		std::vector<ChipInstance> instances;
+
+		// offsets into the uploaded buffers
+		int first_gate     = 0;
+		int first_line     = 0;
+		int first_instance = 0;
+	};
 
-		if (shad->prog) {
-			OGL_TRACE("TriRenderer");
+	std::vector<Batch> batches;
+	std::unordered_map<ChipMesh*, int> mesh2batch;
+
+	std::vector<Outline> chip_outlines;
+
+	// wires are depth sorted by wire_id, the overlay continues counting where the scene left off
+	int wire_count = 0;
+
+	void clear (int first_wire_id=0) {
+		batches.clear();
+		mesh2batch.clear();
+		chip_outlines.clear();
+		wire_count = first_wire_id;
+	}
 
-			vbo_tris.stream(verticies, indices);
+	Batch& get_batch (ChipMesh* mesh) {
+		auto res = mesh2batch.try_emplace(mesh, (int)batches.size());
+		if (res.second)
+			batches.push_back({ mesh });
+		return batches[res.first->second];
+	}
 
-			if (indices.size() > 0) {
-				glUseProgram(shad->prog);
+	void add_instance (ChipMesh* mesh, float2x3 const& chip2world, int state_base, lrgba col) {
+		auto& inst = get_batch(mesh).instances.emplace_back();
+		inst.pos        = chip2world * float2(0);
+		inst.axis_x     = (float2x2)chip2world * float2(1,0);
+		inst.axis_y     = (float2x2)chip2world * float2(0,1);
+		inst.state_base = state_base;
+		inst.wire_base  = wire_count;
+		inst.col        = col;
 
-				PipelineState s;
-				s.depth_test = false;
-				s.depth_write = false;
-				s.blend_enable = true;
-				s.cull_face = false;
-				state.set(s);
+		wire_count += mesh->wire_count;
+	}
 
-				glBindVertexArray(vbo_tris.vao);
-				glDrawElements(GL_TRIANGLES, (GLsizei)indices.size(), GL_UNSIGNED_SHORT, (void*)0);
+	// append a chunk that was built starting from wire id 0, its wire ids continue after ours
+	// appending chunks in traversal order gives the same wire ids as a single threaded traversal
+	void append (DrawChunk const& chunk) {
+		for (auto& b : chunk.batches) {
+			auto& batch = get_batch(b.mesh);
+			for (auto inst : b.instances) {
+				inst.wire_base += wire_count;
+				batch.instances.push_back(inst);
 			}
 		}
+		chip_outlines.insert(chip_outlines.end(), chunk.chip_outlines.begin(), chunk.chip_outlines.end());
 
-		glBindVertexArray(0);
+		wire_count += chunk.wire_count;
 	}
 };
-struct LineRenderer {
-	Shader* shad  = g_shaders.compile("wires");
 
-	struct LineInstance {
-		float2 pos0;
-		float2 pos1;
-		float2 t; // t0 t1
-		float  radius;
-		int    states;
-		float4 col;
-		int    wire_id;
+// DrawChunk with gpu buffers
+struct DrawList : DrawChunk {
+	Vbo ssbo_gates     = {"DrawList.gates"};
+	Vbo ssbo_lines     = {"DrawList.lines"};
+	Vbo ssbo_instances = {"DrawList.instances"};
 
-		ATTRIBUTES {
-			ATTRIB_INSTANCED( idx++, GL_FLOAT,2, LineInstance, pos0);
-			ATTRIB_INSTANCED( idx++, GL_FLOAT,2, LineInstance, pos1);
-			ATTRIB_INSTANCED( idx++, GL_FLOAT,2, LineInstance, t);
-			ATTRIB_INSTANCED( idx++, GL_FLOAT,1, LineInstance, radius);
-			ATTRIBI_INSTANCED(idx++, GL_INT  ,1, LineInstance, states);
-			ATTRIB_INSTANCED( idx++, GL_FLOAT,4, LineInstance, col);
-			ATTRIBI_INSTANCED(idx++, GL_INT  ,1, LineInstance, wire_id);
+	void upload () {
+		ZoneScoped;
+
+		std::vector<GateInstance> gates;
+		std::vector<LineInstance> lines;
+		std::vector<ChipInstance> instances;
+
+		for (auto& b : batches) {
+			b.first_gate     = (int)gates.size();
+			b.first_line     = (int)lines.size();
+			b.first_instance = (int)instances.size();
+
+			gates    .insert(gates    .end(), b.mesh->gates.begin(), b.mesh->gates.end());
+			lines    .insert(lines    .end(), b.mesh->lines.begin(), b.mesh->lines.end());
+			instances.insert(instances.end(), b.instances  .begin(), b.instances  .end());
 		}
-	};
 
-	VertexBuffer vbo_lines = vertex_buffer<LineInstance>("LineRenderer.LineInstance");
+		upload_ssbo(ssbo_gates,     gates);
+		upload_ssbo(ssbo_lines,     lines);
+		upload_ssbo(ssbo_instances, instances);
+	}
+};
 
-	std::vector<LineInstance> lines;
+struct GateRenderer {
+	static constexpr int GATES_BINDING     = 4;
+	static constexpr int INSTANCES_BINDING = 6;
 
-	void update (Input& I) {
-		lines.clear();
-		lines.shrink_to_fit();
+	Shader* shad  = g_shaders.compile("gates");
+
+	Vao dummy_vao = {"GateRenderer.dummy_vao"};
+
+	void render (StateManager& state, std::initializer_list<DrawList*> lists, float heat_scale) {
+		ZoneScoped;
+
+		if (shad->prog) {
+			OGL_TRACE("GateRenderer");
+
+			glUseProgram(shad->prog);
+
+			shad->set_uniform("heat_scale", heat_scale);
+
+			PipelineState s;
+			s.depth_test = false;
+			s.depth_write = false;
+			s.blend_enable = true;
+			s.cull_face = false;
+			state.set(s);
+
+			glBindVertexArray(dummy_vao);
+
+			for (auto* list : lists) {
+				glBindBufferBase(GL_SHADER_STORAGE_BUFFER, GATES_BINDING,     list->ssbo_gates);
+				glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCES_BINDING, list->ssbo_instances);
+
+				for (auto& b : list->batches) {
+					if (b.mesh->gates.empty()) continue;
+
+					shad->set_uniform("mesh_offset",     b.first_gate);
+					shad->set_uniform("instance_offset", b.first_instance);
+
+					// 6 vertices per gate quad, one instance per placed chip
+					glDrawArraysInstanced(GL_TRIANGLES, 0, 6 * (GLsizei)b.mesh->gates.size(), (GLsizei)b.instances.size());
+				}
+			}
+		}
+
+		glBindVertexArray(0);
 	}
+};
+struct LineRenderer {
+	static constexpr int LINES_BINDING     = 5;
+	static constexpr int INSTANCES_BINDING = 6;
 
-	void render (StateManager& state, float sim_t, int num_wires) {
+	Shader* shad  = g_shaders.compile("wires");
+
+	Vao dummy_vao = {"LineRenderer.dummy_vao"};
+
+	void render (StateManager& state, std::initializer_list<DrawList*> lists, float sim_t, int num_wires, float heat_scale) {
 		ZoneScoped;
 
 		if (shad->prog) {
 			OGL_TRACE("LineRenderer");
 
-			vbo_lines.stream(lines);
+			glUseProgram(shad->prog);
+
+			shad->set_uniform("sim_t", sim_t);
+			shad->set_uniform("num_wires", (float)num_wires);
+			shad->set_uniform("heat_scale", heat_scale);
+
+			PipelineState s;
+			s.depth_test = true;
+			s.depth_write = true;
+			s.blend_enable = true;
+			s.cull_face = false;
+			state.set(s);
 
-			if (lines.size() > 0) {
-				glUseProgram(shad->prog);
+			glBindVertexArray(dummy_vao);
 
-				shad->set_uniform("sim_t", sim_t);
-				shad->set_uniform("num_wires", (float)num_wires);
+			for (auto* list : lists) {
+				glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LINES_BINDING,     list->ssbo_lines);
+				glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCES_BINDING, list->ssbo_instances);
 
-				PipelineState s;
-				s.depth_test = true;
-				s.depth_write = true;
-				s.blend_enable = true;
-				s.cull_face = false;
-				state.set(s);
+				for (auto& b : list->batches) {
+					if (b.mesh->lines.empty()) continue;
 
-				glBindVertexArray(vbo_lines.vao);
-				glDrawArraysInstanced(GL_TRIANGLES, 0, 6*2, (GLsizei)lines.size());
+					shad->set_uniform("mesh_offset",     b.first_line);
+					shad->set_uniform("instance_offset", b.first_instance);
+
+					// 6 vertices for outline and 6 for wire per line segment, one instance per placed chip
+					glDrawArraysInstanced(GL_TRIANGLES, 0, 6*2 * (GLsizei)b.mesh->lines.size(), (GLsizei)b.instances.size());
+				}
 			}
 		}
 
@@ -214,8 +388,16 @@ struct Renderer {
 
 	TextRenderer text_renderer = TextRenderer("fonts/AsimovExtraWide-veG4.ttf", 64, true);
 	
-	TriRenderer tri_renderer;
+	GateRenderer gate_renderer;
 	LineRenderer line_renderer;
+	StateBuffer state_buffer;
+
+	// chip instances of the viewed chip, rebuilt only if a chip was edited or the view switched
+	DrawList scene;
+	// previews that are rebuilt every frame
+	DrawList overlay;
+	// loose gates and wires of the previews in world space
+	ChipMesh overlay_mesh;
 
 	Vao dummy_vao = {"dummy_vao"};
 
@@ -287,17 +469,20 @@ struct Renderer {
 		draw_text(name, center + size*(align - 0.5f), font_size, col, align);
 	}
 
-	int wire_id;
-
-	void build_line (float2x3 const& chip2world,
+	void build_line (ChipMesh& out, float2x3 const& chip2world,
 			float2 start0, float2 start1, std::vector<float2> const& points, float2 end0, float2 end1,
-			int states, lrgba col);
-	void build_line (float2x3 const& chip2world, float2 a, float2 b, int states, lrgba col);
+			int state_idx, lrgba col);
+	void build_line (ChipMesh& out, float2x3 const& chip2world, float2 a, float2 b, int state_idx, lrgba col);
 
-	void draw_gate (float2x3 const& mat, float2 size, int type, int state, lrgba col);
+	void draw_gate (ChipMesh& out, float2x3 const& mat, float2 size, int type, int state_idx, lrgba col);
 	
-	void draw_chip (Game& g, logic_sim::Chip* chip, float2x3 const& chip2world, int chip_state, lrgba col);
+	void build_chip_mesh (logic_sim::Chip& chip);
+	void build_stale_meshes (logic_sim::Chip* root);
+	void draw_chip (DrawChunk& out, logic_sim::Chip* chip, float2x3 const& chip2world, int chip_state, lrgba col);
 	
+	void build_scene (Game& g);
+	void build_overlay (Game& g);
+
 	void begin (Window& window, Game& g, int2 window_size);
 	void end (Window& window, Game& g, int2 window_size);
 };
@@ -0,0 +1,164 @@
+#pragma once
+#include "common.hpp"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+// Persistent worker threads for fork-join style loops, so that we don't pay for thread creation on every parallel loop
+// parallel_for blocks until all iterations are done, the calling thread works on iterations as well
+// calls from multiple threads are serialized, calling parallel_for from inside a parallel_for job deadlocks
+struct WorkerPool {
+
+	static int default_thread_count () {
+		return max((int)std::thread::hardware_concurrency() - 1, 1);
+	}
+
+	WorkerPool (int thread_count = default_thread_count()) {
+		for (int i=0; i<thread_count; ++i)
+			threads.emplace_back([this] () { worker(); });
+	}
+	~WorkerPool () {
+		{
+			std::unique_lock lock(mtx);
+			shutdown = true;
+		}
+		cv_work.notify_all();
+		for (auto& t : threads)
+			t.join();
+	}
+
+	WorkerPool (WorkerPool const&) = delete;
+	WorkerPool& operator= (WorkerPool const&) = delete;
+
+	// number of threads working on a loop (workers + caller)
+	int concurrency () const { return (int)threads.size() + 1; }
+
+	// call func(i) for i in [0, count), in no particular order
+	template <typename FUNC>
+	void parallel_for (int count, FUNC&& func) {
+		if (count <= 0)
+			return;
+		if (count == 1 || threads.empty()) {
+			for (int i=0; i<count; ++i)
+				func(i);
+			return;
+		}
+
+		std::unique_lock call_lock(call_mtx);
+
+		std::function<void(int)> f = std::ref(func);
+		{
+			std::unique_lock lock(mtx);
+			job       = &f;
+			job_count = count;
+			next      = 0;
+			pending   = (int)threads.size();
+			generation++;
+		}
+		cv_work.notify_all();
+
+		run_job();
+
+		std::unique_lock lock(mtx);
+		cv_done.wait(lock, [&] () { return pending == 0; });
+		job = nullptr;
+	}
+
+private:
+	std::vector<std::thread> threads;
+
+	std::mutex              call_mtx;
+	std::mutex              mtx;
+	std::condition_variable cv_work;
+	std::condition_variable cv_done;
+
+	std::function<void(int)>* job = nullptr;
+	int                       job_count = 0;
+	std::atomic<int>          next = 0;
+	int                       pending = 0;
+	uint64_t                  generation = 0;
+	bool                      shutdown = false;
+
+	void run_job () {
+		for (int i; (i = next.fetch_add(1, std::memory_order_relaxed)) < job_count; )
+			(*job)(i);
+	}
+
+	void worker () {
+		uint64_t seen = 0;
+		for (;;) {
+			{
+				std::unique_lock lock(mtx);
+				cv_work.wait(lock, [&] () { return shutdown || generation != seen; });
+				if (shutdown)
+					return;
+				seen = generation;
+			}
+
+			run_job();
+
+			{
+				std::unique_lock lock(mtx);
+				if (--pending == 0)
+					cv_done.notify_one();
+			}
+		}
+	}
+};
+
+// shared pool, started on first use
+inline WorkerPool& worker_pool () {
+	static WorkerPool pool;
+	return pool;
+}
+
+// Lock-free ring buffer for exactly one producer thread and one consumer thread
+// capacity is rounded up to a power of two, push fails (partially) instead of blocking when full
+template <typename T>
+struct SpscRing {
+	SpscRing (size_t capacity) {
+		size_t cap = 1;
+		while (cap < capacity)
+			cap <<= 1;
+		buf  = std::make_unique<T[]>(cap);
+		mask = cap - 1;
+	}
+
+	size_t capacity () const { return mask + 1; }
+
+	// producer: push up to count values, returns how many were pushed
+	size_t push (T const* vals, size_t count) {
+		size_t h = head.load(std::memory_order_relaxed);
+		size_t t = tail.load(std::memory_order_acquire);
+		size_t n = min(count, capacity() - (h - t));
+
+		for (size_t i=0; i<n; ++i)
+			buf[(h + i) & mask] = vals[i];
+
+		head.store(h + n, std::memory_order_release);
+		return n;
+	}
+
+	// consumer: pop up to max_count values into out, returns how many were popped
+	size_t pop (T* out, size_t max_count) {
+		size_t t = tail.load(std::memory_order_relaxed);
+		size_t h = head.load(std::memory_order_acquire);
+		size_t n = min(max_count, h - t);
+
+		for (size_t i=0; i<n; ++i)
+			out[i] = buf[(t + i) & mask];
+
+		tail.store(t + n, std::memory_order_release);
+		return n;
+	}
+
+private:
+	std::unique_ptr<T[]> buf;
+	size_t mask;
+
+	// on seperate cache lines so producer and consumer don't contend
+	alignas(64) std::atomic<size_t> head = 0; // written by producer
+	alignas(64) std::atomic<size_t> tail = 0; // written by consumer
+};
@@ -0,0 +1,214 @@
+#include "common.hpp"
+#include "logic_sim.hpp"
+
+namespace logic_sim {
+
+namespace {
+	struct IndexBuilder {
+		std::string& names;
+		std::vector<uint32_t>& offsets;
+		std::vector<std::pair<uint32_t, int32_t>> aliases; // end of part path in names, sid of its output
+
+		std::string path;
+
+		void add (std::string_view name) {
+			size_t len = path.size();
+			path += name;
+			names += path;
+			offsets.push_back((uint32_t)names.size());
+			path.resize(len);
+		}
+
+		// mirrors the order of state indices (see LogicSim::update_state_indices), so every sid is added once and in order
+		void add_chip (Chip& chip, int state_base) {
+			for (int i=0; i<(int)chip.outputs.size(); ++i) {
+				auto& pin = *chip.outputs[i];
+				add(pin.name.empty() ? prints("out%d", i) : pin.name);
+			}
+			for (int i=0; i<(int)chip.inputs.size(); ++i) {
+				auto& pin = *chip.inputs[i];
+				add(pin.name.empty() ? prints("in%d", i) : pin.name);
+			}
+
+			for (auto& part : chip.parts) {
+				int sid = state_base + part->sid;
+				assert(offsets.size() - 1 == (size_t)sid); // state indices stale!
+
+				std::string name = part->name.empty() ? prints("%s_%d", part->chip->name.c_str(), part->sid) : part->name;
+				if (is_gate(part->chip)) {
+					add(name);
+					continue;
+				}
+
+				size_t len = path.size();
+				path += name;
+				// the first state of the part is its first output, so the part path is a prefix of that output path in names
+				if (part->chip->outputs.size() == 1)
+					aliases.push_back({ (uint32_t)(names.size() + path.size()), sid });
+				path += '.';
+
+				add_chip(*part->chip, sid);
+
+				path.resize(len);
+			}
+		}
+	};
+
+	std::string normalize_path (std::string_view path) {
+		std::string res(path);
+		for (char& c : res) {
+			if (c == '/') c = '.';
+		}
+		return res;
+	}
+
+	// * matches any characters, ? one character
+	bool match_wildcard (std::string_view str, std::string_view pat) {
+		size_t s = 0, p = 0;
+		size_t star = std::string_view::npos, star_s = 0;
+		while (s < str.size()) {
+			if (p < pat.size() && (pat[p] == '?' || pat[p] == str[s])) {
+				s++; p++;
+			}
+			else if (p < pat.size() && pat[p] == '*') {
+				star = p++;
+				star_s = s;
+			}
+			else if (star != std::string_view::npos) {
+				// let the last * take one more character
+				p = star + 1;
+				s = ++star_s;
+			}
+			else {
+				return false;
+			}
+		}
+		while (p < pat.size() && pat[p] == '*')
+			p++;
+		return p == pat.size();
+	}
+}
+
+void SignalIndex::update (LogicSim& sim) {
+	if (valid && chip == sim.viewed_chip.get() && version == sim.names_version)
+		return;
+	ZoneScoped;
+
+	chip = sim.viewed_chip.get();
+	version = sim.names_version;
+	valid = true;
+
+	names.clear();
+	offsets.assign(1, 0);
+	sid_of.clear();
+	duplicates = 0;
+
+	IndexBuilder b = { names, offsets };
+	b.add_chip(*chip, 0);
+	assert((int)offsets.size() - 1 == chip->state_count);
+
+	// views into names, which is not modified anymore
+	int32_t count = (int32_t)offsets.size() - 1;
+	sid_of.reserve(count + b.aliases.size());
+	for (int32_t sid=0; sid<count; ++sid) {
+		if (!sid_of.emplace(get(sid), sid).second)
+			duplicates++;
+	}
+	for (auto& [end, sid] : b.aliases) {
+		// path of the part is its output path without the pin name
+		std::string_view part_path = std::string_view(names).substr(offsets[sid], end - offsets[sid]);
+		sid_of.emplace(part_path, sid);
+	}
+
+	sorted.resize(count);
+	for (int32_t sid=0; sid<count; ++sid)
+		sorted[sid] = sid;
+	std::sort(sorted.begin(), sorted.end(), [&] (int32_t l, int32_t r) {
+		return get(l) < get(r);
+	});
+
+	results.clear();
+	more_results = false;
+}
+
+int32_t SignalIndex::find (LogicSim& sim, std::string_view path) {
+	update(sim);
+
+	auto it = path.find('/') == std::string_view::npos ? sid_of.find(path) : sid_of.find(normalize_path(path));
+	return it != sid_of.end() ? it->second : -1;
+}
+
+std::string_view SignalIndex::path (LogicSim& sim, int32_t sid) {
+	update(sim);
+
+	if (sid < 0 || sid + 1 >= (int32_t)offsets.size())
+		return {};
+	return get(sid);
+}
+
+bool SignalIndex::search (LogicSim& sim, std::string_view pattern, std::vector<int32_t>& sids, int max_results) {
+	update(sim);
+
+	std::string pat = normalize_path(pattern);
+
+	// only the literal prefix can be found by binary search, the rest is matched against every path in its range
+	size_t wild = pat.find_first_of("*?");
+	std::string_view prefix = std::string_view(pat).substr(0, wild);
+
+	auto it = std::lower_bound(sorted.begin(), sorted.end(), prefix, [&] (int32_t sid, std::string_view prefix) {
+		return get(sid) < prefix;
+	});
+	for (; it != sorted.end(); ++it) {
+		std::string_view path = get(*it);
+		if (path.substr(0, prefix.size()) != prefix)
+			break;
+
+		if (wild != std::string::npos && !match_wildcard(path.substr(prefix.size()), std::string_view(pat).substr(prefix.size())))
+			continue;
+
+		if ((int)sids.size() >= max_results)
+			return false;
+		sids.push_back(*it);
+	}
+	return true;
+}
+
+////
+void SignalIndex::imgui (LogicSim& sim) {
+	if (ImGui::TreeNodeEx("Signal Paths")) {
+		update(sim);
+
+		ImGui::Text("%d paths", (int)offsets.size() - 1);
+		if (duplicates > 0) {
+			ImGui::SameLine();
+			ImGui::TextColored(ImVec4(1.00f, 0.80f, 0.20f, 1), "%d duplicates (parts with the same name)", duplicates);
+		}
+
+		if (ImGui::InputText("search##signal_paths", &pattern) || (results.empty() && !pattern.empty())) {
+			results.clear();
+			more_results = !search(sim, pattern, results, 1000);
+		}
+		if (ImGui::IsItemHovered())
+			ImGui::SetTooltip("Prefix of a path like cpu.alu (or cpu/alu), or a pattern with * and ?, like *.cout");
+
+		if (!pattern.empty()) {
+			ImGui::Text(more_results ? "first %d matches" : "%d matches", (int)results.size());
+
+			ImGui::BeginChild("signal_paths", ImVec2(0, 150), true);
+			ImGuiListClipper clip;
+			clip.Begin((int)results.size());
+			while (clip.Step()) {
+				for (int i=clip.DisplayStart; i<clip.DisplayEnd; ++i) {
+					int32_t sid = results[i];
+					std::string_view p = get(sid);
+					ImGui::Text("%6d  %.*s = %d", sid, (int)p.size(), p.data(), (int)sim.state[sim.cur_state][sid]);
+				}
+			}
+			ImGui::EndChild();
+		}
+
+		ImGui::TreePop();
+	}
+}
+
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include "common.hpp"
+#include <bit>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define SOA_KERNELS_SSE2 1
+#else
+	#define SOA_KERNELS_SSE2 0
+#endif
+
+// Batched math kernels on structure-of-arrays data (seperate x and y arrays),
+// processing 4 elements per iteration with sse2 (scalar fallback otherwise)
+// arrays are padded to a multiple of 4, so kernels don't need a scalar tail
+
+inline constexpr int SOA_WIDTH = 4;
+
+inline int soa_padded (int count) {
+	return (count + SOA_WIDTH-1) & ~(SOA_WIDTH-1);
+}
+
+// Axis aligned boxes as lo/hi corners, padding boxes are empty and never hit
+struct SoABoxes {
+	std::vector<float> lo_x, lo_y, hi_x, hi_y;
+	int count = 0;
+
+	void clear () {
+		lo_x.clear(); lo_y.clear();
+		hi_x.clear(); hi_y.clear();
+		count = 0;
+	}
+	void add (float2 center, float2 half_size) {
+		// overwrite padding
+		lo_x.resize(count); lo_y.resize(count);
+		hi_x.resize(count); hi_y.resize(count);
+
+		lo_x.push_back(center.x - half_size.x); lo_y.push_back(center.y - half_size.y);
+		hi_x.push_back(center.x + half_size.x); hi_y.push_back(center.y + half_size.y);
+		count++;
+
+		int padded = soa_padded(count);
+		lo_x.resize(padded, +INF); lo_y.resize(padded, +INF);
+		hi_x.resize(padded, -INF); hi_y.resize(padded, -INF);
+	}
+};
+
+// out = mat * (x,y) for count points, out arrays may alias the inputs
+// all arrays need to be padded to soa_padded(count)
+inline void transform_points (float2x3 const& mat, float const* x, float const* y, float* out_x, float* out_y, int count) {
+	float2 t  = mat * float2(0);
+	float2 ax = (float2x2)mat * float2(1,0);
+	float2 ay = (float2x2)mat * float2(0,1);
+
+#if SOA_KERNELS_SSE2
+	__m128 tx  = _mm_set1_ps(t.x),  ty  = _mm_set1_ps(t.y);
+	__m128 axx = _mm_set1_ps(ax.x), axy = _mm_set1_ps(ax.y);
+	__m128 ayx = _mm_set1_ps(ay.x), ayy = _mm_set1_ps(ay.y);
+
+	for (int i=0; i<count; i += SOA_WIDTH) {
+		__m128 px = _mm_loadu_ps(x + i);
+		__m128 py = _mm_loadu_ps(y + i);
+
+		__m128 rx = _mm_add_ps(tx, _mm_add_ps(_mm_mul_ps(axx, px), _mm_mul_ps(ayx, py)));
+		__m128 ry = _mm_add_ps(ty, _mm_add_ps(_mm_mul_ps(axy, px), _mm_mul_ps(ayy, py)));
+
+		_mm_storeu_ps(out_x + i, rx);
+		_mm_storeu_ps(out_y + i, ry);
+	}
+#else
+	for (int i=0; i<count; ++i) {
+		float px = x[i], py = y[i];
+		out_x[i] = t.x + ax.x * px + ay.x * py;
+		out_y[i] = t.y + ax.y * px + ay.y * py;
+	}
+#endif
+}
+
+// hit test point against all boxes (half-open like AABB::is_inside)
+// hits[i] = 1 if point is inside box i, hits needs to be padded to soa_padded(count)
+// returns number of boxes hit
+inline int hit_test_boxes (SoABoxes const& boxes, float2 p, uint8_t* hits) {
+	int total = 0;
+
+#if SOA_KERNELS_SSE2
+	__m128 px = _mm_set1_ps(p.x);
+	__m128 py = _mm_set1_ps(p.y);
+
+	for (int i=0; i<boxes.count; i += SOA_WIDTH) {
+		__m128 in_x = _mm_and_ps(_mm_cmpge_ps(px, _mm_loadu_ps(&boxes.lo_x[i])), _mm_cmplt_ps(px, _mm_loadu_ps(&boxes.hi_x[i])));
+		__m128 in_y = _mm_and_ps(_mm_cmpge_ps(py, _mm_loadu_ps(&boxes.lo_y[i])), _mm_cmplt_ps(py, _mm_loadu_ps(&boxes.hi_y[i])));
+
+		unsigned mask = (unsigned)_mm_movemask_ps(_mm_and_ps(in_x, in_y));
+		for (int j=0; j<SOA_WIDTH; ++j)
+			hits[i+j] = (uint8_t)((mask >> j) & 1u);
+
+		total += std::popcount(mask);
+	}
+#else
+	for (int i=0; i<boxes.count; ++i) {
+		bool hit = p.x >= boxes.lo_x[i] && p.x < boxes.hi_x[i] &&
+		           p.y >= boxes.lo_y[i] && p.y < boxes.hi_y[i];
+		hits[i] = (uint8_t)hit;
+		total += hit;
+	}
+#endif
+
+	return total;
+}
@@ -0,0 +1,439 @@
+#include "common.hpp"
+#include "testbench.hpp"
+#include "chip_library.hpp"
+#include "parallel.hpp"
+#include <filesystem>
+#include <fstream>
+
+namespace logic_sim {
+
+static constexpr int MAX_REPORTED_MISMATCHES = 32;
+
+////
+namespace {
+	// everything a test bench run needs, prepared on the main thread so the jobs never touch the chip library
+	struct TestJob {
+		std::string chip;
+		std::string filepath;
+		std::string error;
+
+		std::shared_ptr<Netlist const> netlist;
+		TestPins pins;
+	};
+
+	struct TestError {
+		std::string msg;
+	};
+}
+
+TestPins::TestPins (Chip& chip) {
+	for (int i=0; i<(int)chip.inputs.size(); ++i) {
+		auto& pin = *chip.inputs[i];
+		inputs.emplace(pin.name.empty() ? prints("in%d", i) : pin.name, pin.sid);
+	}
+	for (int i=0; i<(int)chip.outputs.size(); ++i) {
+		auto& pin = *chip.outputs[i];
+		outputs.emplace(pin.name.empty() ? prints("out%d", i) : pin.name, pin.sid);
+	}
+}
+
+static TestBench::Column find_column (std::unordered_map<std::string, int32_t> const& pins, std::string const& name) {
+	TestBench::Column col;
+	col.name = name;
+
+	auto it = pins.find(name);
+	if (it != pins.end()) {
+		col.sids.push_back(it->second);
+		return col;
+	}
+
+	// bus of name[i] or namei
+	for (int i=0; ; ++i) {
+		auto bit = pins.find(prints("%s[%d]", name.c_str(), i));
+		if (bit == pins.end())
+			bit = pins.find(prints("%s%d", name.c_str(), i));
+		if (bit == pins.end())
+			break;
+		col.sids.push_back(bit->second);
+	}
+	if (col.sids.empty())
+		throw TestError{ prints("no pin named \"%s\"", name.c_str()) };
+	if (col.sids.size() > 64)
+		throw TestError{ prints("bus \"%s\" wider than 64 bits", name.c_str()) };
+	return col;
+}
+
+// value and mask of the bits that are not don't cares
+static void parse_value (std::string const& tok, int width, bool allow_x, uint64_t& val, uint64_t& care) {
+	uint64_t width_mask = width >= 64 ? ~0ull : (1ull << width) - 1;
+	val = 0;
+	care = width_mask;
+
+	auto is_bits = [&] () {
+		if ((int)tok.size() != width)
+			return false;
+		for (char c : tok) {
+			if (c != '0' && c != '1' && c != 'x' && c != 'X' && c != '-')
+				return false;
+		}
+		return true;
+	};
+
+	if (is_bits()) {
+		for (int i=0; i<width; ++i) {
+			char c = tok[width-1 - i]; // msb first
+			if (c == '1')
+				val |= 1ull << i;
+			else if (c != '0') {
+				if (!allow_x)
+					throw TestError{ prints("don't care \"%s\" not allowed for inputs", tok.c_str()) };
+				care &= ~(1ull << i);
+			}
+		}
+		return;
+	}
+
+	int base = 10;
+	size_t start = 0;
+	if      (tok.size() > 2 && tok[0] == '0' && (tok[1] == 'x' || tok[1] == 'X')) { base = 16; start = 2; }
+	else if (tok.size() > 2 && tok[0] == '0' && (tok[1] == 'b' || tok[1] == 'B')) { base =  2; start = 2; }
+
+	size_t end = 0;
+	try {
+		val = std::stoull(tok.substr(start), &end, base);
+	}
+	catch (std::exception&) {
+		end = std::string::npos;
+	}
+	if (end != tok.size() - start)
+		throw TestError{ prints("invalid value \"%s\"", tok.c_str()) };
+	if (val & ~width_mask)
+		throw TestError{ prints("value \"%s\" does not fit into %d bits", tok.c_str(), width) };
+}
+
+static uint64_t read_column (TestBench::Column const& col, uint8_t const* state) {
+	uint64_t v = 0;
+	for (size_t bit=0; bit<col.sids.size(); ++bit)
+		v |= (uint64_t)(state[col.sids[bit]] != 0) << bit;
+	return v;
+}
+static void write_column (TestBench::Column const& col, uint8_t* state, uint64_t val) {
+	for (size_t bit=0; bit<col.sids.size(); ++bit)
+		state[col.sids[bit]] = (uint8_t)((val >> bit) & 1);
+}
+
+bool parse_testbench (std::string const& filepath, TestPins const& pins, TestBench& bench, std::string* error) {
+	ZoneScoped;
+
+	bench = {};
+
+	std::ifstream file(filepath);
+	if (!file) {
+		if (error) *error = "could not open file";
+		return false;
+	}
+
+	std::vector<int> inputs, outputs; // current columns
+	int ticks_per_vector = 1;
+
+	std::string line;
+	std::vector<std::string> toks;
+	int line_no = 0;
+	try {
+		while (std::getline(file, line)) {
+			line_no++;
+
+			auto comment = line.find('#');
+			if (comment != std::string::npos)
+				line.resize(comment);
+
+			toks.clear();
+			for (size_t i=0; i<line.size(); ) {
+				if (isspace((unsigned char)line[i]) || line[i] == '|') { i++; continue; }
+				size_t start = i;
+				while (i < line.size() && !isspace((unsigned char)line[i]) && line[i] != '|')
+					i++;
+				toks.emplace_back(line.substr(start, i - start));
+			}
+			if (toks.empty())
+				continue;
+
+			if (toks[0] == "inputs" || toks[0] == "outputs") {
+				auto& map  = toks[0] == "inputs" ? pins.inputs : pins.outputs;
+				auto& cols = toks[0] == "inputs" ? inputs : outputs;
+				cols.clear();
+				for (size_t i=1; i<toks.size(); ++i) {
+					cols.push_back((int)bench.columns.size());
+					bench.columns.push_back(find_column(map, toks[i]));
+				}
+				continue;
+			}
+			if (toks[0] == "ticks") {
+				if (toks.size() != 2 || (ticks_per_vector = atoi(toks[1].c_str())) < 1)
+					throw TestError{ "expected ticks <count>" };
+				continue;
+			}
+
+			if (toks.size() != inputs.size() + outputs.size())
+				throw TestError{ prints("expected %d values, got %d", (int)(inputs.size() + outputs.size()), (int)toks.size()) };
+
+			TestBench::Vector vec;
+			vec.line = line_no;
+			vec.ticks = ticks_per_vector;
+			for (size_t i=0; i<toks.size(); ++i) {
+				bool is_input = i < inputs.size();
+				TestBench::Value v;
+				v.column = is_input ? inputs[i] : outputs[i - inputs.size()];
+				v.text = toks[i];
+				parse_value(toks[i], (int)bench.columns[v.column].sids.size(), !is_input, v.val, v.care);
+				(is_input ? vec.inputs : vec.outputs).push_back(std::move(v));
+			}
+			bench.vectors.push_back(std::move(vec));
+		}
+	}
+	catch (TestError& err) {
+		if (error) *error = prints("line %d: %s", line_no, err.msg.c_str());
+		return false;
+	}
+	return true;
+}
+
+static TestResult run_job (TestJob const& job) {
+	ZoneScoped;
+
+	TestResult res;
+	res.chip = job.chip;
+	res.filepath = job.filepath;
+	if (!job.error.empty()) {
+		res.error = job.error;
+		return res;
+	}
+
+	TestBench bench;
+	if (!parse_testbench(job.filepath, job.pins, bench, &res.error))
+		return res;
+
+	auto& netlist = *job.netlist;
+	std::vector<uint8_t> state[2];
+	state[0].assign(netlist.state_count, 0);
+	state[1].assign(netlist.state_count, 0);
+	int cur = 0;
+
+	for (auto& vec : bench.vectors) {
+		for (auto& in : vec.inputs) {
+			// both buffers, so the inputs are held no matter which one is current
+			write_column(bench.columns[in.column], state[0].data(), in.val);
+			write_column(bench.columns[in.column], state[1].data(), in.val);
+		}
+
+		for (int t=0; t<vec.ticks; ++t) {
+			netlist.simulate(state[cur].data(), state[cur^1].data());
+			cur ^= 1;
+		}
+		res.ticks += vec.ticks;
+		res.vectors++;
+
+		for (auto& out : vec.outputs) {
+			auto& col = bench.columns[out.column];
+			uint64_t got = read_column(col, state[cur].data());
+			if ((got ^ out.val) & out.care) {
+				if (res.mismatch_count++ < MAX_REPORTED_MISMATCHES)
+					res.mismatches.push_back({ vec.line, res.ticks, col.name, out.text, got });
+			}
+		}
+	}
+	return res;
+}
+
+// <chip name>.tv or <chip name>.<anything>.tv, the longest chip name wins if several match
+static Chip* chip_for_file (std::unordered_map<std::string, Chip*> const& chips, std::string const& stem) {
+	for (size_t len = stem.size(); ; ) {
+		auto it = chips.find(stem.substr(0, len));
+		if (it != chips.end())
+			return it->second;
+
+		len = stem.rfind('.', len-1);
+		if (len == std::string::npos || len == 0)
+			return nullptr;
+	}
+}
+
+static std::vector<TestJob> prepare_jobs (LogicSim& sim, std::string const& dir) {
+	ZoneScoped;
+
+	std::vector<std::string> files;
+	std::error_code ec;
+	for (auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+		if (entry.is_regular_file() && entry.path().extension() == ".tv")
+			files.push_back(entry.path().string());
+	}
+	std::sort(files.begin(), files.end());
+
+	std::unordered_map<std::string, Chip*> chips;
+	for (auto& chip : sim.saved_chips)
+		chips.emplace(chip->name, chip.get());
+
+	std::unordered_map<Chip*, std::shared_ptr<Netlist const>> netlists;
+
+	std::vector<TestJob> jobs;
+	for (auto& filepath : files) {
+		TestJob job;
+		job.filepath = filepath;
+
+		std::string stem = std::filesystem::path(filepath).stem().string();
+		Chip* chip = chip_for_file(chips, stem);
+		if (!chip) {
+			job.chip = stem;
+			job.error = prints("no saved chip named \"%s\"", stem.c_str());
+			jobs.push_back(std::move(job));
+			continue;
+		}
+		job.chip = chip->name;
+
+		auto& netlist = netlists[chip];
+		if (!netlist)
+			netlist = std::make_shared<Netlist const>(flatten_saved_chip(sim, *chip));
+		job.netlist = netlist;
+		job.pins = TestPins(*chip);
+
+		jobs.push_back(std::move(job));
+	}
+	return jobs;
+}
+
+static std::vector<TestResult> run_jobs (std::vector<TestJob> const& jobs, WorkerPool& pool) {
+	std::vector<TestResult> results(jobs.size());
+	pool.parallel_for((int)jobs.size(), [&] (int i) {
+		results[i] = run_job(jobs[i]);
+	});
+	return results;
+}
+
+std::vector<TestResult> run_testbenches (LogicSim& sim, std::string const& dir) {
+	auto jobs = prepare_jobs(sim, dir);
+	return run_jobs(jobs, worker_pool());
+}
+
+////
+void TestRunner::run (LogicSim& sim) {
+	if (busy())
+		return;
+
+	started = std::chrono::steady_clock::now();
+
+	// own pool, since parallel_for on the shared pool would block the main thread while the tests run
+	pending = std::async(std::launch::async, [jobs = prepare_jobs(sim, dir)] () {
+		WorkerPool pool;
+		return run_jobs(jobs, pool);
+	});
+}
+
+void TestRunner::imgui (LogicSim& sim) {
+	if (pending.valid() && !busy()) {
+		results = pending.get();
+		last_run_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - started).count();
+	}
+
+	if (ImGui::TreeNodeEx("Test Benches")) {
+		ImGui::InputText("directory##tests", &dir);
+
+		ImGui::BeginDisabled(busy());
+		if (ImGui::Button("Run All"))
+			run(sim);
+		ImGui::EndDisabled();
+
+		ImGui::SameLine();
+		if (busy()) {
+			ImGui::Text("Running...");
+		}
+		else if (!results.empty()) {
+			int passed = 0;
+			for (auto& r : results)
+				passed += r.passed() ? 1 : 0;
+
+			ImVec4 col = passed == (int)results.size() ? ImVec4(0.20f, 1.00f, 0.20f, 1) : ImVec4(1.00f, 0.20f, 0.20f, 1);
+			ImGui::TextColored(col, "%d / %d passed in %.1f ms", passed, (int)results.size(), last_run_ms);
+		}
+
+		for (int i=0; i<(int)results.size(); ++i) {
+			auto& r = results[i];
+			ImGui::PushID(i);
+
+			if (r.passed()) {
+				ImGui::Text("PASS %s (%s) %d vectors", r.chip.c_str(), r.filepath.c_str(), r.vectors);
+			}
+			else if (ImGui::TreeNodeEx("##result", ImGuiTreeNodeFlags_DefaultOpen, "FAIL %s (%s)", r.chip.c_str(), r.filepath.c_str())) {
+				if (!r.error.empty())
+					ImGui::TextColored(ImVec4(1.00f, 0.20f, 0.20f, 1), "%s", r.error.c_str());
+				for (auto& m : r.mismatches)
+					ImGui::Text("line %d tick %d: %s expected %s got 0x%llx", m.line, m.tick, m.pin.c_str(), m.expected.c_str(), (unsigned long long)m.got);
+				if (r.mismatch_count > (int)r.mismatches.size())
+					ImGui::Text("... %d more mismatches", r.mismatch_count - (int)r.mismatches.size());
+				ImGui::TreePop();
+			}
+
+			ImGui::PopID();
+		}
+
+		ImGui::TreePop();
+	}
+}
+
+////
+int testbench_main (int argc, char** argv) {
+	if (argc < 3) {
+		fprintf(stderr, "usage: %s --test <library.lslib | library dir | library.json> [test dir]\n", argv[0]);
+		return 2;
+	}
+	std::string library = argv[2];
+	std::string dir = argc > 3 ? argv[3] : "tests";
+
+	LogicSim sim;
+	bool loaded;
+	if (std::filesystem::is_directory(library)) {
+		loaded = load_library_split(library, sim);
+	}
+	else if (std::filesystem::path(library).extension() == ".lslib") {
+		loaded = load_library_binary(library.c_str(), sim);
+	}
+	else {
+		std::ifstream file(library);
+		json j = json::parse(file, nullptr, false);
+		loaded = !j.is_discarded();
+		if (loaded) {
+			// debug.json stores the library under game.sim
+			if (j.contains("game")) j = j["game"]["sim"];
+			from_json(j, sim);
+		}
+	}
+	if (!loaded) {
+		fprintf(stderr, "could not load library \"%s\"\n", library.c_str());
+		return 2;
+	}
+
+	auto t0 = std::chrono::steady_clock::now();
+	auto results = run_testbenches(sim, dir);
+	float ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+	int passed = 0;
+	for (auto& r : results) {
+		if (r.passed()) {
+			passed++;
+			printf("PASS %s (%s) %d vectors\n", r.chip.c_str(), r.filepath.c_str(), r.vectors);
+			continue;
+		}
+
+		printf("FAIL %s (%s)\n", r.chip.c_str(), r.filepath.c_str());
+		if (!r.error.empty())
+			printf("  %s\n", r.error.c_str());
+		for (auto& m : r.mismatches)
+			printf("  %s:%d tick %d: %s expected %s got 0x%llx\n", r.filepath.c_str(), m.line, m.tick, m.pin.c_str(), m.expected.c_str(), (unsigned long long)m.got);
+		if (r.mismatch_count > (int)r.mismatches.size())
+			printf("  ... %d more mismatches\n", r.mismatch_count - (int)r.mismatches.size());
+	}
+	printf("%d / %d test benches passed in %.1f ms\n", passed, (int)results.size(), ms);
+
+	return passed == (int)results.size() ? 0 : 1;
+}
+
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include "common.hpp"
+#include "logic_sim.hpp"
+#include <future>
+
+namespace logic_sim {
+
+// Test benches: text files of input vectors and expected outputs for saved chips
+// attached to a chip by file name: <dir>/<chip name>.tv and <dir>/<chip name>.<anything>.tv
+//
+//   # comment
+//   inputs  a b cin          input pins in column order
+//   outputs s cout           output pins in column order
+//   ticks   4                ticks each vector is held, outputs are checked on its last tick (default 1)
+//   0 0 0   0 0              one vector per line: input values then expected output values
+//   1 1 0 | 0 1              '|' is ignored and can be used to seperate inputs from outputs
+//   1 1 1   1 x              x or - is a don't care for outputs
+//
+// a column name that is not a pin by itself is a bus of pins name[0], name[1] ... (or name0, name1 ...), bit 0 as lsb
+// bus values are written as binary digits of the exact bus width (msb first, x allowed for outputs), 0x hex, 0b binary or decimal
+// ticks can be changed between vectors, the sim starts from all zero state like a freshly viewed chip
+struct TestMismatch {
+	int line;
+	int tick;
+	std::string pin;
+	std::string expected;
+	uint64_t    got;
+};
+struct TestResult {
+	std::string chip;
+	std::string filepath;
+
+	int vectors = 0;
+	int ticks = 0;
+	int mismatch_count = 0;
+	std::vector<TestMismatch> mismatches; // only the first few
+
+	std::string error; // file could not be read or parsed
+
+	bool passed () const { return error.empty() && mismatch_count == 0; }
+};
+
+// A test bench file parsed against the pins of a chip, so other tools can replay its vectors
+struct TestBench {
+	struct Column {
+		std::string name;
+		std::vector<int32_t> sids; // lsb first
+	};
+	struct Value {
+		int         column;
+		uint64_t    val;
+		uint64_t    care; // bits that are not don't cares
+		std::string text;
+	};
+	struct Vector {
+		int line;
+		int ticks; // ticks the inputs are held, outputs are checked on the last one
+		std::vector<Value> inputs;
+		std::vector<Value> outputs;
+	};
+	std::vector<Column> columns;
+	std::vector<Vector> vectors;
+};
+// pin name -> sid, prepared on the main thread
+struct TestPins {
+	std::unordered_map<std::string, int32_t> inputs;
+	std::unordered_map<std::string, int32_t> outputs;
+
+	TestPins () {}
+	TestPins (Chip& chip);
+};
+// error is prefixed with the line number
+bool parse_testbench (std::string const& filepath, TestPins const& pins, TestBench& bench, std::string* error);
+
+// runs all test benches in dir for all saved chips, blocks until done
+std::vector<TestResult> run_testbenches (LogicSim& sim, std::string const& dir);
+
+// "Test Benches" ui, runs in the background so the ui stays responsive
+struct TestRunner {
+	std::string dir = "tests";
+
+	std::vector<TestResult> results;
+	float last_run_ms = 0;
+
+	bool busy () const {
+		return pending.valid() && pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready;
+	}
+
+	void run (LogicSim& sim);
+	void imgui (LogicSim& sim);
+
+	~TestRunner () {
+		if (pending.valid())
+			pending.wait();
+	}
+private:
+	std::future<std::vector<TestResult>> pending;
+	std::chrono::steady_clock::time_point started;
+};
+
+// headless test run: logic_sim --test <library (.lslib, split library directory or json)> [test dir]
+// prints mismatches, returns process exit code
+int testbench_main (int argc, char** argv);
+
+}
@@ -0,0 +1,241 @@
+#include "common.hpp"
+#include "time_travel.hpp"
+
+namespace logic_sim {
+
+////
+void TimeTravel::reset () {
+	segments.clear();
+	prev.clear();
+	xprev.clear();
+	last = 0;
+	pos = 0;
+	total_bytes = 0;
+	chip = nullptr;
+}
+
+void TimeTravel::start (LogicSim& sim) {
+	reset();
+
+	chip = sim.viewed_chip.get();
+	state_count = sim.state[0].size();
+	hash = structural_hash(*sim.viewed_chip);
+
+	ternary = sim.ternary && sim.xstate[sim.cur_state].size() == state_count;
+
+	prev = sim.state[sim.cur_state];
+	if (ternary)
+		xprev = sim.xstate[sim.cur_state];
+	add_snapshot(0);
+}
+
+static void pack (std::vector<uint64_t>& bits, std::vector<uint8_t> const& state) {
+	bits.assign((state.size() + 63) / 64, 0);
+	for (size_t sid=0; sid<state.size(); ++sid)
+		bits[sid >> 6] |= (uint64_t)(state[sid] != 0) << (sid & 63);
+}
+static void unpack (std::vector<uint64_t> const& bits, std::vector<uint8_t>& state, size_t count) {
+	state.resize(count);
+	for (size_t sid=0; sid<count; ++sid)
+		state[sid] = (uint8_t)((bits[sid >> 6] >> (sid & 63)) & 1);
+}
+
+void TimeTravel::add_snapshot (int64_t tick) {
+	Segment seg;
+	seg.first = tick;
+	pack(seg.snapshot, prev);
+	if (ternary)
+		pack(seg.xsnapshot, xprev);
+
+	total_bytes += seg.bytes();
+	segments.push_back(std::move(seg));
+}
+
+void TimeTravel::truncate (int64_t tick) {
+	while (segments.size() > 1 && segments.back().first >= tick)
+		segments.pop_back();
+
+	auto& seg = segments.back();
+	seg.ends.resize((size_t)(tick - seg.first));
+	seg.flips.resize(seg.ends.empty() ? 0 : seg.ends.back());
+
+	total_bytes = 0;
+	for (auto& s : segments)
+		total_bytes += s.bytes();
+	last = tick;
+}
+
+void TimeTravel::trim_to_budget () {
+	// never drop the segment being recorded into
+	while (total_bytes > budget && segments.size() > 1) {
+		total_bytes -= segments.front().bytes();
+		segments.pop_front();
+	}
+}
+
+void TimeTravel::record (LogicSim& sim) {
+	if (!enabled)
+		return;
+	ZoneScoped;
+
+	bool sim_ternary = sim.ternary && sim.xstate[sim.cur_state].size() == sim.state[0].size();
+	if (segments.empty() || sim.viewed_chip.get() != chip || sim.state[0].size() != state_count ||
+			sim_ternary != ternary || structural_hash(*sim.viewed_chip) != hash) {
+		start(sim);
+		return;
+	}
+
+	if (pos < last)
+		truncate(pos); // continuing from the past, the old future is gone
+
+	auto& seg = segments.back();
+	size_t size_before = seg.bytes();
+
+	// compare 8 states at a time, since most of them usually don't change
+	auto diff = [&] (uint8_t const* cur, std::vector<uint8_t>& old, int32_t flip_mask) {
+		size_t count = old.size();
+		size_t sid = 0;
+		for (; sid + 8 <= count; sid += 8) {
+			uint64_t a, b;
+			memcpy(&a, cur + sid, 8);
+			memcpy(&b, old.data() + sid, 8);
+			if (a == b)
+				continue;
+			for (size_t i=sid; i<sid+8; ++i) {
+				if (cur[i] != old[i])
+					seg.flips.push_back((int32_t)i ^ flip_mask);
+			}
+		}
+		for (; sid < count; ++sid) {
+			if (cur[sid] != old[sid])
+				seg.flips.push_back((int32_t)sid ^ flip_mask);
+		}
+		memcpy(old.data(), cur, count);
+	};
+	diff(sim.state[sim.cur_state].data(), prev, 0);
+	if (ternary)
+		diff(sim.xstate[sim.cur_state].data(), xprev, ~0); // ~sid
+
+	seg.ends.push_back((uint32_t)seg.flips.size());
+	total_bytes += seg.bytes() - size_before;
+
+	last++;
+	pos = last;
+
+	// once the flips cost as much as a snapshot, a new snapshot keeps the replay cost bounded
+	if (!seg.flips.empty() && seg.flips.size() * sizeof(int32_t) >= seg.snapshot.size() * sizeof(uint64_t))
+		add_snapshot(last);
+
+	trim_to_budget();
+}
+
+void TimeTravel::rebuild (int64_t tick, Planes& at, Planes* before) const {
+	// last segment that starts before tick, so the tick before it can be rebuilt from the same segment
+	auto it = std::lower_bound(segments.begin(), segments.end(), tick,
+		[] (Segment const& s, int64_t t) { return s.first < t; });
+	if (it != segments.begin())
+		--it;
+	auto& seg = *it;
+	assert(seg.first <= tick && tick <= seg.last());
+
+	unpack(seg.snapshot, at.state, state_count);
+	if (ternary)
+		unpack(seg.xsnapshot, at.xstate, state_count);
+
+	int64_t n = tick - seg.first;
+	if (before && n == 0)
+		*before = at; // oldest recorded tick
+
+	uint32_t begin = 0;
+	for (int64_t i=0; i<n; ++i) {
+		if (before && i == n-1)
+			*before = at;
+
+		uint32_t end = seg.ends[i];
+		for (uint32_t j=begin; j<end; ++j) {
+			int32_t f = seg.flips[j];
+			if (f >= 0) at.state[f] ^= 1;
+			else        at.xstate[~f] ^= 1;
+		}
+		begin = end;
+	}
+}
+
+bool TimeTravel::seek (LogicSim& sim, int64_t tick, int& tick_counter) {
+	ZoneScoped;
+
+	if (segments.empty() || tick < first_tick() || tick > last ||
+			sim.viewed_chip.get() != chip || sim.state[0].size() != state_count || sim.ternary != ternary)
+		return false;
+
+	Planes at, before;
+	rebuild(tick, at, &before);
+
+	prev = at.state;
+	sim.state[sim.cur_state  ] = std::move(at.state);
+	sim.state[sim.cur_state^1] = std::move(before.state);
+	if (ternary) {
+		xprev = at.xstate;
+		sim.xstate[sim.cur_state  ] = std::move(at.xstate);
+		sim.xstate[sim.cur_state^1] = std::move(before.xstate);
+	}
+	sim.state_generation++;
+	sim.state_changed = true;
+
+	tick_counter += (int)(tick - pos);
+	pos = tick;
+	return true;
+}
+
+////
+void TimeTravel::imgui (LogicSim& sim, int& tick_counter, bool& sim_paused) {
+	if (ImGui::TreeNodeEx("Time Travel")) {
+		if (ImGui::Checkbox("Record History", &enabled) && !enabled)
+			reset();
+
+		int budget_mb = (int)(budget >> 20);
+		if (ImGui::DragInt("Memory Budget##time_travel", &budget_mb, 1, 1, 16384, "%d MB"))
+			budget = (size_t)max(budget_mb, 1) << 20;
+
+		if (!empty()) {
+			ImGui::Text("ticks %lld - %lld, %d snapshots, %.2f MB", (long long)first_tick(), (long long)last,
+				(int)segments.size(), (float)total_bytes / (1024*1024));
+
+			int64_t lo = first_tick(), hi = last;
+			int64_t t = pos;
+			if (ImGui::SliderScalar("Tick##time_travel", ImGuiDataType_S64, &t, &lo, &hi)) {
+				sim_paused = true;
+				seek(sim, t, tick_counter);
+			}
+
+			if (ImGui::Button("<< Oldest")) {
+				sim_paused = true;
+				seek(sim, lo, tick_counter);
+			}
+			ImGui::SameLine();
+			if (ImGui::Button("< Back [B]")) {
+				sim_paused = true;
+				step_back(sim, tick_counter);
+			}
+			ImGui::SameLine();
+			ImGui::BeginDisabled(pos >= last);
+			if (ImGui::Button("Forward >")) {
+				sim_paused = true;
+				seek(sim, pos + 1, tick_counter);
+			}
+			ImGui::SameLine();
+			if (ImGui::Button("Latest >>")) {
+				sim_paused = true;
+				seek(sim, hi, tick_counter);
+			}
+			ImGui::EndDisabled();
+
+			if (pos < last)
+				ImGui::TextColored(ImVec4(1.00f, 0.80f, 0.20f, 1), "Viewing the past, resuming discards %lld later ticks", (long long)(last - pos));
+		}
+
+		ImGui::TreePop();
+	}
+}
+
+}
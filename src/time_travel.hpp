@@ -0,0 +1,83 @@
+#pragma once
+#include "common.hpp"
+#include "logic_sim.hpp"
+#include <deque>
+
+namespace logic_sim {
+
+// Records the state history of the viewed chip so the sim can be stepped backwards or scrubbed to any recorded tick
+// history is split into segments of a full bit-packed snapshot followed by the sids that flipped on each tick,
+// a new snapshot is only taken once the flips since the last one take as much memory as a snapshot,
+// so memory grows with activity instead of design size times ticks, while rebuilding a tick never replays more than one snapshot worth of flips
+// oldest segments are dropped to stay within the memory budget
+// ticks are counted since the history was (re)started, the game tick counter is moved along relatively when seeking
+// history is cleared when the viewed chip or its structure changes, since that invalidates the state indices
+// in ternary mode the x plane is recorded the same way (flips of x are stored as ~sid), history restarts when the mode is toggled
+struct TimeTravel {
+	bool   enabled = true;
+	size_t budget = 256 << 20; // bytes
+
+	bool empty () const { return segments.empty(); }
+	int64_t first_tick () const { return segments.empty() ? 0 : segments.front().first; }
+	int64_t last_tick () const { return last; }
+	// tick the sim state currently corresponds to, < last_tick() after seeking backwards
+	int64_t current_tick () const { return pos; }
+
+	void reset ();
+
+	// call after every sim tick, if the sim was seeked backwards the history after that tick is discarded
+	void record (LogicSim& sim);
+
+	// restore the state of a recorded tick (and the tick before it as previous state for the wire animation)
+	// tick_counter is moved by the same number of ticks
+	bool seek (LogicSim& sim, int64_t tick, int& tick_counter);
+	bool step_back (LogicSim& sim, int& tick_counter) {
+		return seek(sim, pos - 1, tick_counter);
+	}
+
+	// seeking pauses the sim, so it does not immediately continue from the restored tick
+	void imgui (LogicSim& sim, int& tick_counter, bool& sim_paused);
+
+	size_t bytes () const { return total_bytes; }
+
+private:
+	struct Segment {
+		int64_t first; // tick of snapshot
+		std::vector<uint64_t> snapshot;
+		std::vector<uint64_t> xsnapshot; // only in ternary mode
+		// flips[ends[i-1] : ends[i]] are the sids flipped from tick first+i to first+i+1, ~sid for flips of the x plane
+		std::vector<uint32_t> ends;
+		std::vector<int32_t>  flips;
+
+		int64_t last () const { return first + (int64_t)ends.size(); }
+		size_t bytes () const {
+			return (snapshot.size() + xsnapshot.size()) * sizeof(uint64_t) + ends.size() * sizeof(uint32_t) + flips.size() * sizeof(int32_t);
+		}
+	};
+	std::deque<Segment> segments;
+
+	int64_t last = 0;
+	int64_t pos = 0;
+	size_t  total_bytes = 0;
+
+	// state at pos, to diff the next tick against
+	std::vector<uint8_t> prev;
+	std::vector<uint8_t> xprev; // only in ternary mode
+	bool ternary = false;
+
+	Chip*    chip = nullptr;
+	size_t   state_count = 0;
+	uint64_t hash = 0;
+
+	void start (LogicSim& sim);
+	void truncate (int64_t tick);
+	void add_snapshot (int64_t tick);
+	void trim_to_budget ();
+	// state (and x plane) at tick, before is the tick before it
+	struct Planes {
+		std::vector<uint8_t> state, xstate;
+	};
+	void rebuild (int64_t tick, Planes& at, Planes* before) const;
+};
+
+}
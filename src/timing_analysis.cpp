@@ -0,0 +1,398 @@
+#include "common.hpp"
+#include "timing_analysis.hpp"
+
+namespace logic_sim {
+
+namespace {
+	struct InEdge {
+		int32_t   src;
+		PathDelay d;
+	};
+
+	// one node per output pin of every part of a chip (its own input and output pins are parts with one output)
+	struct TimingGraph {
+		std::vector<Part*>   node_part;
+		std::vector<int32_t> node_pin;
+		std::vector<int32_t> first_in; // compressed in-edge lists
+		std::vector<InEdge>  in_edges;
+
+		std::vector<uint8_t> is_state;
+		std::vector<int32_t> order; // sources first
+
+		std::unordered_map<Part*, int32_t> first_node;
+
+		int32_t src_node (Part::InputWire const& inp) const {
+			return inp.part ? first_node.at(inp.part) + inp.pin : -1;
+		}
+	};
+}
+
+static int output_count (Part& part) {
+	return is_gate(part.chip) ? 1 : (int)part.chip->outputs.size();
+}
+
+static void build_graph (Chip& chip, std::unordered_map<Chip*, ChipTiming const*> const& subchips, TimingGraph& g) {
+	auto add_part = [&] (Part* part) {
+		g.first_node.emplace(part, (int32_t)g.node_part.size());
+		for (int o=0; o<output_count(*part); ++o) {
+			g.node_part.push_back(part);
+			g.node_pin.push_back(o);
+		}
+	};
+	for (auto& part : chip.outputs) add_part(part.get());
+	for (auto& part : chip.inputs)  add_part(part.get());
+	for (auto& part : chip.parts)   add_part(part.get());
+
+	int32_t count = (int32_t)g.node_part.size();
+
+	g.first_in.assign(count + 1, 0);
+	for (int32_t v=0; v<count; ++v) {
+		Part& part = *g.node_part[v];
+
+		if (part.chip == &gates[INP_PIN]) {
+			// written by the user of the chip
+		}
+		else if (is_gate(part.chip)) {
+			for (int i=0; i<(int)part.chip->inputs.size(); ++i) {
+				int32_t src = g.src_node(part.inputs[i]);
+				if (src >= 0) g.in_edges.push_back({ src, {1, 1} });
+			}
+		}
+		else {
+			// input pin buffer of the subchip, then its path to this output
+			auto& sub = *subchips.at(part.chip);
+			for (int i=0; i<sub.inputs; ++i) {
+				int32_t src = g.src_node(part.inputs[i]);
+				auto& d = sub.delay(g.node_pin[v], i);
+				if (src >= 0 && d.valid()) g.in_edges.push_back({ src, {1 + d.min, 1 + d.max} });
+			}
+		}
+
+		g.first_in[v+1] = (int32_t)g.in_edges.size();
+	}
+}
+
+// tarjan's scc, iterative since flat imported chips can have long chains of gates
+// on the graph of in-edges it finds every scc only after all of its sources, so the sccs come out in topological order
+static void find_state_elements (TimingGraph& g) {
+	int32_t count = (int32_t)g.node_part.size();
+
+	std::vector<int32_t> index(count, -1), low(count);
+	std::vector<uint8_t> on_stack(count, 0);
+	std::vector<int32_t> stack;
+
+	struct Frame {
+		int32_t v;
+		int32_t e; // next in-edge to visit
+	};
+	std::vector<Frame> calls;
+	int32_t counter = 0;
+
+	g.is_state.assign(count, 0);
+	g.order.clear();
+	g.order.reserve(count);
+
+	auto visit = [&] (int32_t v) {
+		index[v] = low[v] = counter++;
+		stack.push_back(v);
+		on_stack[v] = 1;
+		calls.push_back({ v, g.first_in[v] });
+	};
+
+	for (int32_t root=0; root<count; ++root) {
+		if (index[root] >= 0) continue;
+		visit(root);
+
+		while (!calls.empty()) {
+			int32_t v = calls.back().v;
+
+			if (calls.back().e < g.first_in[v+1]) {
+				int32_t u = g.in_edges[calls.back().e++].src;
+				if (index[u] < 0)
+					visit(u);
+				else if (on_stack[u])
+					low[v] = min(low[v], index[u]);
+				continue;
+			}
+
+			calls.pop_back();
+			if (!calls.empty())
+				low[calls.back().v] = min(low[calls.back().v], low[v]);
+
+			if (low[v] != index[v])
+				continue;
+
+			size_t first = g.order.size();
+			int32_t u;
+			do {
+				u = stack.back();
+				stack.pop_back();
+				on_stack[u] = 0;
+				g.order.push_back(u);
+			} while (u != v);
+
+			bool loop = g.order.size() - first > 1;
+			for (int32_t e = g.first_in[v]; e < g.first_in[v+1] && !loop; ++e)
+				loop = g.in_edges[e].src == v;
+
+			if (loop) {
+				for (size_t i=first; i<g.order.size(); ++i)
+					g.is_state[g.order[i]] = 1;
+			}
+		}
+	}
+}
+
+static void analyse_chip (Chip& chip, std::unordered_map<Chip*, ChipTiming const*> const& subchips, ChipTiming& t) {
+	ZoneScoped;
+
+	TimingGraph g;
+	build_graph(chip, subchips, g);
+	find_state_elements(g);
+
+	int32_t count = (int32_t)g.node_part.size();
+
+	t.inputs  = (int)chip.inputs.size();
+	t.outputs = (int)chip.outputs.size();
+	t.delays.assign(t.outputs * t.sources(), {});
+	t.to_state.assign(t.sources(), {});
+
+	for (int32_t v=0; v<count; ++v)
+		t.state_elements += g.is_state[v];
+
+	auto sub_timing = [&] (Part& part) -> ChipTiming const* {
+		return is_gate(part.chip) ? nullptr : subchips.at(part.chip);
+	};
+
+	// one source at a time, so memory stays O(nodes) for chips with many inputs
+	std::vector<PathDelay> arr(count);
+	for (int s=0; s<t.sources(); ++s) {
+		bool from_state = s == t.inputs;
+		int32_t input_node = from_state ? -1 : g.first_node.at(chip.inputs[s].get());
+
+		for (int32_t v : g.order) {
+			Part& part = *g.node_part[v];
+			PathDelay a;
+
+			if (g.is_state[v]) {
+				if (from_state) a = {0, 0};
+			}
+			else if (part.chip == &gates[INP_PIN]) {
+				if (v == input_node) a = {0, 0};
+			}
+			else {
+				for (int32_t e = g.first_in[v]; e < g.first_in[v+1]; ++e)
+					a.merge(arr[g.in_edges[e].src], g.in_edges[e].d);
+
+				auto* sub = sub_timing(part);
+				if (sub && from_state)
+					a.merge({0, 0}, sub->delay(g.node_pin[v], sub->inputs));
+			}
+			arr[v] = a;
+		}
+
+		for (int o=0; o<t.outputs; ++o)
+			t.delays[o * t.sources() + s] = arr[g.first_node.at(chip.outputs[o].get())];
+
+		// paths into state elements end at their inputs
+		auto& to_state = t.to_state[s];
+		for (int32_t v=0; v<count; ++v) {
+			if (!g.is_state[v]) continue;
+			for (int32_t e = g.first_in[v]; e < g.first_in[v+1]; ++e)
+				to_state.merge(arr[g.in_edges[e].src], g.in_edges[e].d);
+		}
+		for (auto& part : chip.parts) {
+			auto* sub = sub_timing(*part);
+			if (!sub) continue;
+			for (int i=0; i<sub->inputs; ++i) {
+				int32_t src = g.src_node(part->inputs[i]);
+				if (src >= 0) to_state.merge(arr[src], { 1 + sub->to_state[i].min, 1 + sub->to_state[i].max });
+			}
+			if (from_state)
+				to_state.merge({0, 0}, sub->to_state[sub->inputs]);
+		}
+	}
+
+	t.output_delays.assign(t.outputs, {});
+	for (int o=0; o<t.outputs; ++o) {
+		for (int s=0; s<t.sources(); ++s)
+			t.output_delays[o].merge({0, 0}, t.delay(o, s));
+	}
+
+	{ // longest path over all sources at once, remembering where each arrival came from
+		std::vector<int32_t> longest(count, -1), pred(count, -1);
+
+		for (int32_t v : g.order) {
+			Part& part = *g.node_part[v];
+
+			if (g.is_state[v] || part.chip == &gates[INP_PIN]) {
+				longest[v] = 0;
+				continue;
+			}
+			for (int32_t e = g.first_in[v]; e < g.first_in[v+1]; ++e) {
+				auto& edge = g.in_edges[e];
+				if (longest[edge.src] >= 0 && longest[edge.src] + edge.d.max > longest[v]) {
+					longest[v] = longest[edge.src] + edge.d.max;
+					pred[v] = edge.src;
+				}
+			}
+			auto* sub = sub_timing(part);
+			if (sub && sub->delay(g.node_pin[v], sub->inputs).max > longest[v]) {
+				longest[v] = sub->delay(g.node_pin[v], sub->inputs).max;
+				pred[v] = -1;
+			}
+		}
+
+		// the path ends in end_part, coming from end_pred
+		Part* end_part = nullptr;
+		int32_t end_pred = -1;
+		int end_len = -1;
+		auto end_candidate = [&] (Part* part, int32_t pred, int len) {
+			if (len > end_len) {
+				end_part = part;
+				end_pred = pred;
+				end_len = len;
+			}
+		};
+
+		for (auto& part : chip.outputs) {
+			int32_t v = g.first_node.at(part.get());
+			end_candidate(part.get(), pred[v], longest[v]);
+		}
+		for (int32_t v=0; v<count; ++v) {
+			if (!g.is_state[v]) continue;
+			for (int32_t e = g.first_in[v]; e < g.first_in[v+1]; ++e) {
+				auto& edge = g.in_edges[e];
+				if (longest[edge.src] >= 0)
+					end_candidate(g.node_part[v], edge.src, longest[edge.src] + edge.d.max);
+			}
+		}
+		for (auto& part : chip.parts) {
+			auto* sub = sub_timing(*part);
+			if (!sub) continue;
+			for (int i=0; i<sub->inputs; ++i) {
+				int32_t src = g.src_node(part->inputs[i]);
+				if (src >= 0 && longest[src] >= 0 && sub->to_state[i].valid())
+					end_candidate(part.get(), src, longest[src] + 1 + sub->to_state[i].max);
+			}
+			end_candidate(part.get(), -1, sub->to_state[sub->inputs].max);
+		}
+
+		t.depth = max(end_len, 0);
+		if (end_part && end_len > 0) {
+			for (int32_t v = end_pred; v >= 0; v = pred[v]) {
+				if (t.critical_path.empty() || t.critical_path.back() != g.node_part[v])
+					t.critical_path.push_back(g.node_part[v]);
+			}
+			std::reverse(t.critical_path.begin(), t.critical_path.end());
+			if (t.critical_path.empty() || t.critical_path.back() != end_part)
+				t.critical_path.push_back(end_part);
+
+			t.critical_output = end_part->chip == &gates[OUT_PIN] ? indexof(chip.outputs, end_part, Partptr_equal()) : -1;
+		}
+	}
+}
+
+// subchips first, each chip that is not cached yet once
+static ChipTiming const& analyse_cached (Chip& chip) {
+	if (chip.timing)
+		return *chip.timing;
+
+	auto start = std::chrono::steady_clock::now();
+
+	std::unordered_map<Chip*, ChipTiming const*> subchips;
+	for (auto& part : chip.parts) {
+		if (!is_gate(part->chip) && !subchips.contains(part->chip))
+			subchips.emplace(part->chip, &analyse_cached(*part->chip));
+	}
+
+	auto t = std::make_shared<ChipTiming>();
+	analyse_chip(chip, subchips, *t);
+	t->analysis_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+	chip.timing = std::move(t);
+	return *chip.timing;
+}
+
+ChipTiming const& chip_timing (LogicSim& sim, Chip& chip) {
+	if (chip.timing)
+		return *chip.timing;
+
+	ZoneScoped;
+
+	// materialized chips always have materialized dependencies
+	if (chip.lazy)
+		sim.materialize(chip);
+	return analyse_cached(chip);
+}
+
+////
+static std::string pin_name (std::vector<std::unique_ptr<Part>> const& pins, int i) {
+	return pins[i]->name.empty() ? prints("#%d", i) : pins[i]->name;
+}
+
+static void imgui_delay (PathDelay const& d) {
+	if (d.valid()) ImGui::Text("%d .. %d", d.min, d.max);
+	else           ImGui::TextDisabled("-");
+}
+
+void chip_timing_imgui (LogicSim& sim, Chip& chip, bool& show_critical_path) {
+	auto& t = chip_timing(sim, chip);
+
+	ImGui::Text("depth %d ticks", t.depth);
+	if (ImGui::IsItemHovered())
+		ImGui::SetTooltip("Longest path from any input pin or state element to any output pin or state element,\n"
+			"counting one tick per gate and pin like the simulation.");
+	ImGui::SameLine();
+	ImGui::TextDisabled("(%d state elements, %.2f ms)", t.state_elements, t.analysis_ms);
+
+	ImGui::Checkbox("Highlight Critical Path", &show_critical_path);
+	if (!t.critical_path.empty()) {
+		ImGui::SameLine();
+		if (t.critical_output >= 0) ImGui::Text("to output %s", pin_name(chip.outputs, t.critical_output).c_str());
+		else                        ImGui::Text("to state element");
+	}
+
+	if (t.outputs > 0 && ImGui::BeginTable("OutputDelays", 4, ImGuiTableFlags_Borders|ImGuiTableFlags_ScrollY,
+			ImVec2(0, ImGui::GetTextLineHeightWithSpacing() * (min(t.outputs, 10) + 1.5f)))) {
+		ImGui::TableSetupScrollFreeze(0, 1);
+		ImGui::TableSetupColumn("Output");
+		ImGui::TableSetupColumn("Any Source");
+		ImGui::TableSetupColumn("Inputs");
+		ImGui::TableSetupColumn("State");
+		ImGui::TableHeadersRow();
+
+		ImGuiListClipper clip;
+		clip.Begin(t.outputs);
+		while (clip.Step()) {
+			for (int o=clip.DisplayStart; o<clip.DisplayEnd; ++o) {
+				ImGui::TableNextColumn();
+				ImGui::TextUnformatted(pin_name(chip.outputs, o).c_str());
+
+				ImGui::TableNextColumn();
+				imgui_delay(t.output_delays[o]);
+
+				PathDelay from_inputs;
+				for (int i=0; i<t.inputs; ++i)
+					from_inputs.merge({0, 0}, t.delay(o, i));
+
+				ImGui::TableNextColumn();
+				imgui_delay(from_inputs);
+				if (from_inputs.valid() && ImGui::IsItemHovered()) {
+					ImGui::BeginTooltip();
+					for (int i=0; i<t.inputs; ++i) {
+						auto& d = t.delay(o, i);
+						if (d.valid())
+							ImGui::Text("%s: %d .. %d", pin_name(chip.inputs, i).c_str(), d.min, d.max);
+					}
+					ImGui::EndTooltip();
+				}
+
+				ImGui::TableNextColumn();
+				imgui_delay(t.delay(o, t.inputs));
+			}
+		}
+		ImGui::EndTable();
+	}
+}
+
+}
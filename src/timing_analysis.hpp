@@ -0,0 +1,57 @@
+#pragma once
+#include "common.hpp"
+#include "logic_sim.hpp"
+
+namespace logic_sim {
+
+// Static path delays in ticks of the unit delay sim, every gate and every pin delays by one tick (like the BUF_GATE nodes of flattening)
+// paths start at input pins or state elements and end at output pins or state elements,
+// state elements are gates and subchip outputs on feedback loops (latches, importer constants), which cut every path through them
+struct PathDelay {
+	int32_t min = INT32_MAX;
+	int32_t max = -1; // -1 if there is no path
+
+	bool valid () const { return max >= 0; }
+
+	// path through this one, extended by d
+	void merge (PathDelay const& src, PathDelay const& d) {
+		if (!src.valid() || !d.valid()) return;
+		min = std::min(min, src.min + d.min);
+		max = std::max(max, src.max + d.max);
+	}
+};
+
+// Path delays of a chip as seen from its pins, so users can compose them without flattening the chip
+// subchips are used as one node with a delay per (output, input) pair from their own ChipTiming,
+// so analysing a chip only walks its own parts, every chip is analysed once and cached in Chip::timing until it or a dependency is edited
+struct ChipTiming {
+	int inputs  = 0;
+	int outputs = 0;
+
+	// [output * sources() + source], source inputs is the path from any state element
+	std::vector<PathDelay> delays;
+	// [source], from a source to any state element
+	std::vector<PathDelay> to_state;
+
+	std::vector<PathDelay> output_delays; // over all sources
+
+	int depth = 0; // longest path to any output or state element, ticks needed to settle after inputs or states change
+	int state_elements = 0; // in this chip, not counting the ones in subchips
+
+	// parts of this chip along the longest path, source first, the last part is the output pin or the part containing the state element
+	std::vector<Part*> critical_path;
+	int critical_output = -1; // output pin the critical path ends in, -1 if it ends in a state element
+
+	float analysis_ms = 0; // including subchips that were not cached yet
+
+	int sources () const { return inputs + 1; }
+	PathDelay const& delay (int output, int source) const { return delays[output * sources() + source]; }
+};
+
+// cached, materializes chip if needed
+ChipTiming const& chip_timing (LogicSim& sim, Chip& chip);
+
+// for the viewed chip panel
+void chip_timing_imgui (LogicSim& sim, Chip& chip, bool& show_critical_path);
+
+}
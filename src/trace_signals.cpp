@@ -0,0 +1,158 @@
+#include "common.hpp"
+#include "trace_signals.hpp"
+#include <unordered_set>
+
+namespace logic_sim {
+
+////
+static void add_unique (std::vector<TraceSignal>& signals, std::vector<TraceSignal>&& add) {
+	std::unordered_set<int> existing;
+	for (auto& s : signals)
+		existing.insert(s.sid);
+
+	for (auto& s : add) {
+		if (existing.insert(s.sid).second)
+			signals.push_back(std::move(s));
+	}
+}
+
+// one signal per output of part, part states start at sid
+static void part_signals (Part& part, int sid, std::string const& name, std::vector<TraceSignal>& out) {
+	auto& outputs = part.chip->outputs;
+	if (outputs.size() == 1 || is_gate(part.chip)) {
+		out.push_back({ name, sid });
+		return;
+	}
+	for (int i=0; i<(int)outputs.size(); ++i) {
+		auto& pin = outputs[i]->name;
+		out.push_back({ name + "." + (pin.empty() ? prints("out%d", i) : pin), sid + i });
+	}
+}
+
+void add_pin_signals (LogicSim& sim, std::vector<TraceSignal>& signals) {
+	std::vector<TraceSignal> add;
+
+	auto& chip = *sim.viewed_chip;
+	for (int i=0; i<(int)chip.inputs.size(); ++i) {
+		auto& pin = *chip.inputs[i];
+		add.push_back({ pin.name.empty() ? prints("in%d", i) : pin.name, pin.sid });
+	}
+	for (int i=0; i<(int)chip.outputs.size(); ++i) {
+		auto& pin = *chip.outputs[i];
+		add.push_back({ pin.name.empty() ? prints("out%d", i) : pin.name, pin.sid });
+	}
+
+	add_unique(signals, std::move(add));
+}
+
+static void named_parts (Chip& chip, int state_base, std::string const& prefix, std::vector<TraceSignal>& out) {
+	for (auto& part : chip.parts) {
+		int sid = state_base + part->sid;
+
+		if (!part->name.empty())
+			part_signals(*part, sid, prefix + part->name, out);
+
+		if (!is_gate(part->chip)) {
+			std::string scope = part->name.empty() ? prints("%s_%d", part->chip->name.c_str(), part->sid) : part->name;
+			named_parts(*part->chip, sid, prefix + scope + ".", out);
+		}
+	}
+}
+void add_named_part_signals (LogicSim& sim, std::vector<TraceSignal>& signals) {
+	std::vector<TraceSignal> add;
+	named_parts(*sim.viewed_chip, 0, "", add);
+	add_unique(signals, std::move(add));
+}
+
+void add_selected_signals (LogicSim& sim, Editor& editor, std::vector<TraceSignal>& signals) {
+	auto* e = std::get_if<Editor::EditMode>(&editor.mode);
+	if (!e || !e->sel)
+		return;
+
+	std::vector<TraceSignal> add;
+	for (auto& item : e->sel.items) {
+		auto& part = *item.part;
+		int sid = e->sel.chip.sid + part.sid;
+
+		// the outputs are the first states of the part
+		int outputs = is_gate(part.chip) ? 1 : (int)part.chip->outputs.size();
+		for (int i=0; i<outputs; ++i)
+			add.push_back({ std::string(sim.signals.path(sim, sid + i)), sid + i });
+	}
+	add_unique(signals, std::move(add));
+}
+
+////
+void TraceSignalList::update (LogicSim& sim, bool recording) {
+	if (recording)
+		return;
+
+	if (chip != sim.viewed_chip.get()) {
+		signals.clear();
+		chip = sim.viewed_chip.get();
+		names_version = sim.names_version;
+	}
+	else if (names_version != sim.names_version) {
+		// state indices might have moved
+		std::vector<TraceSignal> resolved;
+		for (auto& s : signals) {
+			int32_t sid = sim.signals.find(sim, s.name);
+			if (sid >= 0)
+				resolved.push_back({ std::move(s.name), sid });
+		}
+		signals.clear();
+		add_unique(signals, std::move(resolved));
+		names_version = sim.names_version;
+	}
+}
+
+void TraceSignalList::imgui (LogicSim& sim, Editor& editor, bool editable) {
+	if (editable) {
+		if (ImGui::Button("Add Pins"))
+			add_pin_signals(sim, signals);
+		ImGui::SameLine();
+		if (ImGui::Button("Add Named Parts"))
+			add_named_part_signals(sim, signals);
+		ImGui::SameLine();
+		if (ImGui::Button("Add Selected"))
+			add_selected_signals(sim, editor, signals);
+
+		ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x * 0.5f);
+		ImGui::InputInt("##add_sid", &add_sid);
+		ImGui::SameLine();
+		if (ImGui::Button("Add State Index") && add_sid >= 0 && add_sid < (int)sim.state[0].size())
+			add_unique(signals, { TraceSignal{ std::string(sim.signals.path(sim, add_sid)), add_sid } });
+		ImGui::SameLine();
+		if (ImGui::Button("Clear"))
+			signals.clear();
+
+		ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x * 0.5f);
+		ImGui::InputText("##add_pattern", &add_pattern);
+		if (ImGui::IsItemHovered())
+			ImGui::SetTooltip("Path prefix like cpu.alu, or a pattern with * and ?, like *.cout");
+		ImGui::SameLine();
+		if (ImGui::Button("Add Matching") && !add_pattern.empty()) {
+			std::vector<int32_t> sids;
+			sim.signals.search(sim, add_pattern, sids);
+
+			std::vector<TraceSignal> add;
+			for (int32_t sid : sids)
+				add.push_back({ std::string(sim.signals.path(sim, sid)), sid });
+			add_unique(signals, std::move(add));
+		}
+	}
+
+	ImGui::Text("%d signals", (int)signals.size());
+	if (!signals.empty()) {
+		ImGui::BeginChild("signals", ImVec2(0, 120), true);
+		ImGuiListClipper clip;
+		clip.Begin((int)signals.size());
+		while (clip.Step()) {
+			for (int i=clip.DisplayStart; i<clip.DisplayEnd; ++i)
+				ImGui::Text("%6d  %s", signals[i].sid, signals[i].name.c_str());
+		}
+		ImGui::EndChild();
+	}
+}
+
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include "common.hpp"
+#include "logic_sim.hpp"
+
+namespace logic_sim {
+
+// A recorded signal: a state index of the viewed chip with a hierarchical name (scopes seperated by '.')
+struct TraceSignal {
+	std::string name;
+	int sid;
+};
+
+// add signals that are not in the list yet
+void add_pin_signals (LogicSim& sim, std::vector<TraceSignal>& signals); // inputs and outputs of the viewed chip
+void add_named_part_signals (LogicSim& sim, std::vector<TraceSignal>& signals); // outputs of named parts at any depth
+void add_selected_signals (LogicSim& sim, Editor& editor, std::vector<TraceSignal>& signals); // outputs of selected parts
+
+// Signals picked for recording (VCD export, waveform capture), only valid for the viewed chip they were picked in
+struct TraceSignalList {
+	std::vector<TraceSignal> signals;
+	Chip* chip = nullptr;
+	uint64_t names_version = 0; // of sim when the sids were last resolved
+
+	int add_sid = 0;
+	std::string add_pattern; // see SignalIndex::search
+
+	// forget signals when the viewed chip changed and look up their sids by name again after edits (dropping the ones that are gone),
+	// unless they are still being recorded
+	void update (LogicSim& sim, bool recording);
+
+	// buttons to add signals (if editable) and the list of signals
+	void imgui (LogicSim& sim, Editor& editor, bool editable);
+};
+
+}
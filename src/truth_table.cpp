@@ -0,0 +1,497 @@
+#include "common.hpp"
+#include "truth_table.hpp"
+#include <bit>
+
+namespace logic_sim {
+
+// lane patterns of the low 6 inputs, so lane i of a word gets combination (word * 64 + i)
+static constexpr uint64_t LANE_PATTERNS[6] = {
+	0xAAAAAAAAAAAAAAAAull, 0xCCCCCCCCCCCCCCCCull, 0xF0F0F0F0F0F0F0F0ull,
+	0xFF00FF00FF00FF00ull, 0xFFFF0000FFFF0000ull, 0xFFFFFFFF00000000ull,
+};
+
+static uint64_t input_lanes (int input, size_t word) {
+	if (input < 6)
+		return LANE_PATTERNS[input];
+	return (word >> (input - 6)) & 1 ? ~0ull : 0;
+}
+static uint64_t valid_lanes (int input_count) {
+	return input_count >= 6 ? ~0ull : (1ull << (1 << input_count)) - 1;
+}
+
+////
+bool prepare_truth_table (LogicSim& sim, Chip& chip, TruthTableJob& job, std::string* error) {
+	ZoneScoped;
+
+	if ((int)chip.inputs.size() > TRUTH_TABLE_MAX_INPUTS) {
+		if (error) *error = prints("\"%s\" has %d inputs, at most %d are supported", chip.name.c_str(), (int)chip.inputs.size(), TRUTH_TABLE_MAX_INPUTS);
+		return false;
+	}
+
+	job = {};
+	job.netlist = std::make_shared<Netlist const>(flatten_saved_chip(sim, chip));
+
+	auto& t = job.table;
+	t.chip = chip.name;
+	t.input_count = (int)chip.inputs.size();
+	for (int i=0; i<(int)chip.inputs.size(); ++i) {
+		auto& pin = *chip.inputs[i];
+		t.input_names.push_back(pin.name.empty() ? prints("in%d", i) : pin.name);
+		job.input_sids.push_back(pin.sid);
+	}
+	for (int i=0; i<(int)chip.outputs.size(); ++i) {
+		auto& pin = *chip.outputs[i];
+		t.output_names.push_back(pin.name.empty() ? prints("out%d", i) : pin.name);
+		job.output_sids.push_back(pin.sid);
+	}
+	return true;
+}
+
+// ticks after which every state of an acyclic netlist is settled (longest path + 1),
+// netlists with cycles (latches) get a fixed limit after their acyclic part
+static int settle_ticks (Netlist const& nl) {
+	constexpr int CYCLE_TICKS = 256;
+
+	auto order = order_netlist(nl);
+	return order.max_level + 1 + (order.cyclic ? CYCLE_TICKS : 0);
+}
+
+TruthTable extract_truth_table (TruthTableJob const& job, WorkerPool& pool) {
+	ZoneScoped;
+
+	TruthTable t = job.table;
+	auto& nl = *job.netlist;
+
+	size_t words = t.words();
+	t.outputs.assign(job.output_sids.size(), std::vector<uint64_t>(words, 0));
+
+	int ticks = settle_ticks(nl);
+	uint64_t valid = valid_lanes(t.input_count);
+
+	constexpr size_t CHUNK = 64; // words per job
+	int chunks = (int)((words + CHUNK-1) / CHUNK);
+
+	std::atomic<uint64_t> unsettled = 0;
+
+	pool.parallel_for(chunks, [&] (int chunk) {
+		std::vector<uint64_t> state[2];
+		state[0].resize(nl.state_count);
+		state[1].resize(nl.state_count);
+
+		size_t end = min(words, (size_t)(chunk+1) * CHUNK);
+		for (size_t w = (size_t)chunk * CHUNK; w < end; ++w) {
+			std::fill(state[0].begin(), state[0].end(), 0);
+			std::fill(state[1].begin(), state[1].end(), 0);
+			for (int i=0; i<t.input_count; ++i) {
+				uint64_t lanes = input_lanes(i, w);
+				state[0][job.input_sids[i]] = lanes;
+				state[1][job.input_sids[i]] = lanes;
+			}
+
+			int cur = 0;
+			bool settled = false;
+			for (int tick=0; tick<ticks && !settled; ++tick) {
+				nl.simulate_lanes(state[cur].data(), state[cur^1].data());
+				settled = memcmp(state[0].data(), state[1].data(), nl.state_count * sizeof(uint64_t)) == 0;
+				cur ^= 1;
+			}
+			if (!settled) {
+				// lanes still changing
+				uint64_t changing = 0;
+				nl.simulate_lanes(state[cur].data(), state[cur^1].data());
+				for (int sid=0; sid<nl.state_count; ++sid)
+					changing |= state[0][sid] ^ state[1][sid];
+				cur ^= 1;
+				unsettled += std::popcount(changing & valid);
+			}
+
+			for (size_t o=0; o<job.output_sids.size(); ++o)
+				t.outputs[o][w] = state[cur][job.output_sids[o]] & valid;
+		}
+	});
+
+	t.unsettled = unsettled;
+	return t;
+}
+
+////
+namespace {
+	struct ExprError {
+		std::string msg;
+	};
+
+	// bitwise expression over input lanes, compiled to postfix
+	struct BitExpr {
+		enum Op : uint8_t { INPUT, CONST0, CONST1, NOT, AND, OR, XOR };
+		struct Instr {
+			Op op;
+			int input;
+		};
+		std::vector<Instr> code;
+
+		uint64_t eval (size_t word, std::vector<uint64_t>& stack) const {
+			stack.clear();
+			for (auto& in : code) {
+				switch (in.op) {
+					case INPUT:  stack.push_back(input_lanes(in.input, word)); break;
+					case CONST0: stack.push_back(0); break;
+					case CONST1: stack.push_back(~0ull); break;
+					case NOT:    stack.back() = ~stack.back(); break;
+					default: {
+						uint64_t r = stack.back();
+						stack.pop_back();
+						uint64_t& l = stack.back();
+						if      (in.op == AND) l &= r;
+						else if (in.op == OR ) l |= r;
+						else                   l ^= r;
+					}
+				}
+			}
+			return stack.back();
+		}
+	};
+
+	struct BitExprParser {
+		std::string_view src;
+		size_t pos = 0;
+		std::vector<std::string> const* inputs;
+		BitExpr expr;
+
+		void skip_space () {
+			while (pos < src.size() && isspace((unsigned char)src[pos]))
+				pos++;
+		}
+		bool accept (char c) {
+			skip_space();
+			if (pos < src.size() && src[pos] == c) {
+				pos++;
+				return true;
+			}
+			return false;
+		}
+
+		static bool is_name_char (char c) {
+			return isalnum((unsigned char)c) || c == '_' || c == '.' || c == '[' || c == ']';
+		}
+
+		void primary () {
+			skip_space();
+			if (accept('(')) {
+				or_();
+				if (!accept(')'))
+					throw ExprError{ "expected ')'" };
+				return;
+			}
+
+			size_t start = pos;
+			while (pos < src.size() && is_name_char(src[pos]))
+				pos++;
+			std::string name(src.substr(start, pos - start));
+
+			if      (name == "0") expr.code.push_back({ BitExpr::CONST0, 0 });
+			else if (name == "1") expr.code.push_back({ BitExpr::CONST1, 0 });
+			else if (name.empty())
+				throw ExprError{ prints("unexpected '%.*s'", pos < src.size() ? 1 : 3, pos < src.size() ? &src[pos] : "end") };
+			else {
+				int idx = indexof(*inputs, name);
+				if (idx < 0)
+					throw ExprError{ prints("unknown input \"%s\"", name.c_str()) };
+				expr.code.push_back({ BitExpr::INPUT, idx });
+			}
+		}
+		void unary () {
+			if (accept('~') || accept('!')) {
+				unary();
+				expr.code.push_back({ BitExpr::NOT, 0 });
+				return;
+			}
+			primary();
+		}
+		void and_ () {
+			unary();
+			while (accept('&')) {
+				unary();
+				expr.code.push_back({ BitExpr::AND, 0 });
+			}
+		}
+		void xor_ () {
+			and_();
+			while (accept('^')) {
+				and_();
+				expr.code.push_back({ BitExpr::XOR, 0 });
+			}
+		}
+		void or_ () {
+			xor_();
+			while (accept('|')) {
+				xor_();
+				expr.code.push_back({ BitExpr::OR, 0 });
+			}
+		}
+	};
+}
+
+static void diff_output (TruthTableDiff& d, uint64_t got, uint64_t expected, size_t word) {
+	uint64_t diff = got ^ expected;
+	if (!diff)
+		return;
+
+	if (d.mismatches == 0) {
+		int lane = std::countr_zero(diff);
+		d.first_combo = word * 64 + lane;
+		d.expected = (expected >> lane) & 1;
+		d.got      = (got >> lane) & 1;
+	}
+	d.mismatches += std::popcount(diff);
+}
+
+bool compare_with_expressions (TruthTable const& table, std::string const& reference, std::vector<TruthTableDiff>& diffs, std::string* error) {
+	ZoneScoped;
+
+	diffs.clear();
+
+	// parse all lines first, so errors are reported before doing any work
+	std::vector<std::pair<int, BitExpr>> exprs;
+	int line_no = 0;
+	for (size_t pos = 0; pos < reference.size(); ) {
+		size_t end = reference.find_first_of(";\n", pos);
+		if (end == std::string::npos)
+			end = reference.size();
+		std::string_view line = std::string_view(reference).substr(pos, end - pos);
+		pos = end + 1;
+		line_no++;
+
+		while (!line.empty() && isspace((unsigned char)line.front())) line.remove_prefix(1);
+		while (!line.empty() && isspace((unsigned char)line.back()))  line.remove_suffix(1);
+		if (line.empty())
+			continue;
+
+		try {
+			size_t eq = line.find('=');
+			if (eq == std::string_view::npos)
+				throw ExprError{ "expected <output> = <expression>" };
+
+			std::string_view name = line.substr(0, eq);
+			while (!name.empty() && isspace((unsigned char)name.back()))
+				name.remove_suffix(1);
+
+			int output = indexof(table.output_names, std::string(name));
+			if (output < 0)
+				throw ExprError{ prints("unknown output \"%.*s\"", (int)name.size(), name.data()) };
+
+			BitExprParser p;
+			p.src = line.substr(eq + 1);
+			p.inputs = &table.input_names;
+			p.or_();
+			p.skip_space();
+			if (p.pos != p.src.size())
+				throw ExprError{ prints("unexpected '%c'", p.src[p.pos]) };
+
+			exprs.emplace_back(output, std::move(p.expr));
+		}
+		catch (ExprError& err) {
+			if (error) *error = prints("line %d: %s", line_no, err.msg.c_str());
+			return false;
+		}
+	}
+
+	uint64_t valid = valid_lanes(table.input_count);
+	std::vector<uint64_t> stack;
+	for (auto& [output, expr] : exprs) {
+		TruthTableDiff d;
+		d.output = table.output_names[output];
+
+		for (size_t w=0; w<table.words(); ++w)
+			diff_output(d, table.outputs[output][w], expr.eval(w, stack) & valid, w);
+
+		diffs.push_back(d);
+	}
+	return true;
+}
+
+bool compare_truth_tables (TruthTable const& table, TruthTable const& reference, std::vector<TruthTableDiff>& diffs, std::string* error) {
+	ZoneScoped;
+
+	diffs.clear();
+
+	if (table.input_count != reference.input_count || table.output_names.size() != reference.output_names.size()) {
+		if (error) *error = prints("pin counts differ: %d/%d inputs, %d/%d outputs", table.input_count, reference.input_count,
+			(int)table.output_names.size(), (int)reference.output_names.size());
+		return false;
+	}
+
+	// reference pin for each pin of table, by name if every name has a match
+	auto match = [] (std::vector<std::string> const& a, std::vector<std::string> const& b) {
+		std::vector<int> map(a.size());
+		for (size_t i=0; i<a.size(); ++i) {
+			map[i] = indexof(b, a[i]);
+			if (map[i] < 0 || std::count(a.begin(), a.end(), a[i]) > 1) {
+				for (size_t j=0; j<a.size(); ++j)
+					map[j] = (int)j;
+				break;
+			}
+		}
+		return map;
+	};
+	auto in_map  = match(table.input_names, reference.input_names);
+	auto out_map = match(table.output_names, reference.output_names);
+
+	bool same_order = true;
+	for (int i=0; i<(int)in_map.size(); ++i)
+		same_order = same_order && in_map[i] == i;
+
+	for (int o=0; o<(int)out_map.size(); ++o) {
+		TruthTableDiff d;
+		d.output = table.output_names[o];
+		auto& got = table.outputs[o];
+		auto& exp = reference.outputs[out_map[o]];
+
+		if (same_order) {
+			for (size_t w=0; w<table.words(); ++w)
+				diff_output(d, got[w], exp[w], w);
+		}
+		else {
+			// inputs in different order, look up every combination
+			for (uint64_t c=0; c<table.combinations(); ++c) {
+				uint64_t rc = 0;
+				for (int i=0; i<table.input_count; ++i)
+					rc |= ((c >> i) & 1) << in_map[i];
+
+				bool g = table.get(o, c), e = reference.get(out_map[o], rc);
+				if (g != e && d.mismatches++ == 0) {
+					d.first_combo = c;
+					d.expected = e;
+					d.got = g;
+				}
+			}
+		}
+		diffs.push_back(d);
+	}
+	return true;
+}
+
+////
+void TruthTableTool::run (LogicSim& sim, bool compare_other) {
+	if (busy())
+		return;
+	error.clear();
+
+	std::vector<TruthTableJob> jobs(compare_other ? 2 : 1);
+	for (int i=0; i<(int)jobs.size(); ++i) {
+		auto& name = i == 0 ? chip_name : other_chip_name;
+		Chip* chip = sim.find_saved_chip(name);
+		if (!chip) {
+			error = prints("no saved chip named \"%s\"", name.c_str());
+			return;
+		}
+		if (!prepare_truth_table(sim, *chip, jobs[i], &error))
+			return;
+	}
+
+	pending_compare = compare_other;
+	started = std::chrono::steady_clock::now();
+
+	// own pool, since parallel_for on the shared pool would block the main thread meanwhile
+	pending = std::async(std::launch::async, [jobs = std::move(jobs)] () {
+		WorkerPool pool;
+		std::vector<TruthTable> tables;
+		for (auto& job : jobs)
+			tables.push_back(extract_truth_table(job, pool));
+		return tables;
+	});
+}
+
+void TruthTableTool::imgui (LogicSim& sim) {
+	if (pending.valid() && !busy()) {
+		auto tables = pending.get();
+		last_run_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - started).count();
+
+		table = std::move(tables[0]);
+		has_table = true;
+		compared = false;
+		if (pending_compare)
+			compared = compare_truth_tables(table, tables[1], diffs, &error);
+	}
+
+	if (ImGui::TreeNodeEx("Truth Table")) {
+		if (chip_name.empty() && indexof_chip(sim.saved_chips, sim.viewed_chip.get()) >= 0)
+			chip_name = sim.viewed_chip->name;
+		saved_chip_combo("chip##truth_table", sim, chip_name);
+
+		ImGui::BeginDisabled(busy());
+		if (ImGui::Button("Extract"))
+			run(sim, false);
+		ImGui::EndDisabled();
+		ImGui::SameLine();
+		if (busy())
+			ImGui::Text("Running...");
+		else if (has_table)
+			ImGui::Text("%s: %llu combinations in %.1f ms", table.chip.c_str(), (unsigned long long)table.combinations(), last_run_ms);
+
+		if (has_table && table.unsettled)
+			ImGui::TextColored(ImVec4(1.00f, 0.80f, 0.20f, 1), "%llu combinations did not settle", (unsigned long long)table.unsettled);
+
+		if (has_table) {
+			// inputs msb first like a binary number
+			std::string header;
+			for (int i=table.input_count-1; i>=0; --i)
+				header += table.input_names[i] + " ";
+			header += "| ";
+			for (auto& name : table.output_names)
+				header += name + " ";
+			ImGui::TextUnformatted(header.c_str());
+
+			ImGui::BeginChild("truth_table", ImVec2(0, 200), true);
+			ImGuiListClipper clip;
+			clip.Begin((int)min(table.combinations(), (uint64_t)INT_MAX));
+			std::string row;
+			while (clip.Step()) {
+				for (int c=clip.DisplayStart; c<clip.DisplayEnd; ++c) {
+					row.clear();
+					for (int i=table.input_count-1; i>=0; --i)
+						row += (c >> i) & 1 ? "1 " : "0 ";
+					row += "| ";
+					for (int o=0; o<(int)table.output_names.size(); ++o)
+						row += table.get(o, c) ? "1 " : "0 ";
+					ImGui::TextUnformatted(row.c_str());
+				}
+			}
+			ImGui::EndChild();
+
+			ImGui::Text("Reference (output = expression per line)");
+			ImGui::InputTextMultiline("##reference", &reference, ImVec2(-1, 60));
+			if (ImGui::Button("Compare with Expressions")) {
+				error.clear();
+				compared = compare_with_expressions(table, reference, diffs, &error);
+			}
+		}
+
+		saved_chip_combo("other chip##truth_table", sim, other_chip_name);
+		ImGui::BeginDisabled(busy());
+		if (ImGui::Button("Compare with Chip"))
+			run(sim, true);
+		ImGui::EndDisabled();
+
+		if (!error.empty())
+			ImGui::TextColored(ImVec4(1.00f, 0.20f, 0.20f, 1), "%s", error.c_str());
+
+		if (compared) {
+			for (auto& d : diffs) {
+				if (d.mismatches == 0) {
+					ImGui::TextColored(ImVec4(0.20f, 1.00f, 0.20f, 1), "%s: matches", d.output.c_str());
+					continue;
+				}
+
+				std::string inputs;
+				for (int i=0; i<table.input_count; ++i)
+					inputs += prints("%s%s=%d", i ? " " : "", table.input_names[i].c_str(), (int)((d.first_combo >> i) & 1));
+				ImGui::TextColored(ImVec4(1.00f, 0.20f, 0.20f, 1), "%s: %llu mismatches, first at %s: expected %d got %d",
+					d.output.c_str(), (unsigned long long)d.mismatches, inputs.c_str(), d.expected, d.got);
+			}
+		}
+
+		ImGui::TreePop();
+	}
+}
+
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include "common.hpp"
+#include "logic_sim.hpp"
+#include "parallel.hpp"
+#include <future>
+
+namespace logic_sim {
+
+inline constexpr int TRUTH_TABLE_MAX_INPUTS = 24;
+
+// Settled outputs of a chip for every combination of its inputs
+// input combination c sets input pin i to bit i of c, the result for c is bit (c % 64) of word (c / 64) of outputs[o]
+// chips with state (latches, oscillators) start every combination from all zero state,
+// combinations that still change after enough ticks to propagate through every gate are counted as unsettled
+struct TruthTable {
+	std::string chip;
+	int input_count = 0;
+	std::vector<std::string> input_names;
+	std::vector<std::string> output_names;
+	std::vector<std::vector<uint64_t>> outputs;
+
+	uint64_t unsettled = 0;
+
+	uint64_t combinations () const { return 1ull << input_count; }
+	size_t words () const { return (size_t)((combinations() + 63) / 64); }
+
+	bool get (int output, uint64_t combo) const {
+		return (outputs[output][combo >> 6] >> (combo & 63)) & 1;
+	}
+};
+
+// everything needed to extract a truth table, prepared on the main thread
+struct TruthTableJob {
+	TruthTable table; // names filled in
+	std::shared_ptr<Netlist const> netlist;
+	std::vector<int32_t> input_sids;
+	std::vector<int32_t> output_sids;
+};
+
+// returns false if the chip has too many inputs
+bool prepare_truth_table (LogicSim& sim, Chip& chip, TruthTableJob& job, std::string* error);
+// evaluates 64 combinations per word with Netlist::simulate_lanes, words are split across threads of pool
+TruthTable extract_truth_table (TruthTableJob const& job, WorkerPool& pool);
+
+// Output of a comparison: number of differing combinations per output and the first one
+struct TruthTableDiff {
+	std::string output;
+	uint64_t    mismatches = 0;
+	uint64_t    first_combo = 0;
+	bool        expected = false, got = false;
+};
+
+// reference given as lines of "output = expression" over the input pin names with ~ ! & | ^ ( ) 0 1, ';' also seperates lines
+// outputs without an expression are not compared, returns false with error if the reference could not be parsed
+bool compare_with_expressions (TruthTable const& table, std::string const& reference, std::vector<TruthTableDiff>& diffs, std::string* error);
+// pins are matched by name if all names match, otherwise by order
+bool compare_truth_tables (TruthTable const& table, TruthTable const& reference, std::vector<TruthTableDiff>& diffs, std::string* error);
+
+// "Truth Table" ui for a saved chip, extraction runs in the background
+struct TruthTableTool {
+	std::string chip_name;
+	std::string other_chip_name;
+	std::string reference;
+
+	TruthTable table;
+	bool has_table = false;
+
+	std::vector<TruthTableDiff> diffs;
+	bool compared = false;
+	std::string error;
+	float last_run_ms = 0;
+
+	bool busy () const {
+		return pending.valid() && pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready;
+	}
+
+	// extract truth table of chip (and of other chip if compare_other) in the background
+	void run (LogicSim& sim, bool compare_other);
+	void imgui (LogicSim& sim);
+
+	~TruthTableTool () {
+		if (pending.valid())
+			pending.wait();
+	}
+private:
+	std::future<std::vector<TruthTable>> pending;
+	bool pending_compare = false;
+	std::chrono::steady_clock::time_point started;
+};
+
+}
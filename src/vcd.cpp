@@ -0,0 +1,252 @@
+#include "common.hpp"
+#include "vcd.hpp"
+#include "parallel.hpp"
+#include <ctime>
+
+namespace logic_sim {
+
+////
+// ring entries: tick markers have the top bit set, changes are signal index << 1 | value
+static constexpr uint64_t VCD_TICK = 1ull << 63;
+
+struct VcdExport::Writer {
+	FILE* file;
+	SpscRing<uint64_t> ring = SpscRing<uint64_t>(1 << 20);
+
+	std::vector<std::string> ids;
+	std::string header;
+
+	std::atomic<bool> stopping = false;
+	std::atomic<bool> failed = false;
+	std::thread thread;
+
+	void run () {
+		bool ok = fwrite(header.data(), 1, header.size(), file) == header.size();
+		header = {};
+
+		std::vector<uint64_t> batch(1 << 14);
+		std::string out;
+
+		for (;;) {
+			// check before popping, so everything pushed before stop() is still written
+			bool stop = stopping.load(std::memory_order_acquire);
+
+			size_t count = ring.pop(batch.data(), batch.size());
+			for (size_t i=0; i<count; ++i) {
+				uint64_t e = batch[i];
+				if (e & VCD_TICK) {
+					out += '#';
+					out += std::to_string(e & ~VCD_TICK);
+				}
+				else {
+					out += (char)('0' + (e & 1));
+					out += ids[e >> 1];
+				}
+				out += '\n';
+			}
+
+			if (out.size() >= (1 << 16) || (count == 0 && !out.empty())) {
+				ok = fwrite(out.data(), 1, out.size(), file) == out.size() && ok;
+				out.clear();
+			}
+
+			if (count == 0) {
+				if (stop)
+					break;
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+		}
+
+		ok = fclose(file) == 0 && ok;
+		failed.store(!ok);
+	}
+};
+
+// short printable identifiers, base 94
+static std::string vcd_id (int idx) {
+	std::string id;
+	do {
+		id += (char)('!' + idx % 94);
+		idx /= 94;
+	} while (idx > 0);
+	return id;
+}
+static std::string vcd_name (std::string_view name) {
+	std::string s(name);
+	for (auto& c : s) {
+		if (c == ' ' || c == '\t') c = '_';
+	}
+	return s.empty() ? "_" : s;
+}
+
+VcdExport::VcdExport () {}
+VcdExport::~VcdExport () {
+	stop();
+}
+
+bool VcdExport::start (LogicSim const& sim) {
+	ZoneScoped;
+	stop();
+
+	auto& signals = this->signals.signals;
+	if (this->signals.chip != sim.viewed_chip.get() || signals.empty())
+		return false;
+	// state indices picked before an edit can be past the end of the state (see TraceSignalList::update)
+	for (auto& s : signals) {
+		if (s.sid < 0 || s.sid >= (int)sim.state[0].size())
+			return false;
+	}
+
+	FILE* file = fopen(filepath.c_str(), "wb");
+	if (!file) {
+		fprintf(stderr, "VcdExport: could not open \"%s\"\n", filepath.c_str());
+		return false;
+	}
+
+	auto w = std::make_unique<Writer>();
+	w->file = file;
+
+	chip = sim.viewed_chip.get();
+	state_count = sim.state[0].size();
+	tick = 0;
+
+	uint8_t const* cur = sim.state[sim.cur_state].data();
+
+	sids.resize(signals.size());
+	last.resize(signals.size());
+	w->ids.resize(signals.size());
+	for (int i=0; i<(int)signals.size(); ++i) {
+		sids[i] = signals[i].sid;
+		last[i] = cur[signals[i].sid];
+		w->ids[i] = vcd_id(i);
+	}
+
+	// header with signals grouped into scopes by name
+	std::string& h = w->header;
+	time_t now = time(nullptr);
+	char date[64];
+	strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", localtime(&now));
+
+	h += prints("$date %s $end\n", date);
+	h += "$version logic_sim $end\n";
+	h += "$comment 1 time unit = 1 simulation tick $end\n";
+	h += "$timescale 1ns $end\n";
+	h += prints("$scope module %s $end\n", vcd_name(chip->name.empty() ? "top" : chip->name).c_str());
+
+	std::vector<int> order(signals.size());
+	for (int i=0; i<(int)order.size(); ++i)
+		order[i] = i;
+	std::stable_sort(order.begin(), order.end(), [&] (int l, int r) { return signals[l].name < signals[r].name; });
+
+	std::vector<std::string_view> scopes;
+	for (int i : order) {
+		std::string_view name = signals[i].name;
+
+		std::vector<std::string_view> path;
+		for (size_t dot; (dot = name.find('.')) != std::string_view::npos; ) {
+			path.push_back(name.substr(0, dot));
+			name = name.substr(dot + 1);
+		}
+
+		size_t common = 0;
+		while (common < scopes.size() && common < path.size() && scopes[common] == path[common])
+			common++;
+		for (size_t j=common; j<scopes.size(); ++j)
+			h += "$upscope $end\n";
+		for (size_t j=common; j<path.size(); ++j)
+			h += prints("$scope module %s $end\n", vcd_name(path[j]).c_str());
+		scopes = std::move(path);
+
+		h += prints("$var wire 1 %s %s $end\n", w->ids[i].c_str(), vcd_name(name).c_str());
+	}
+	for (size_t j=0; j<scopes.size(); ++j)
+		h += "$upscope $end\n";
+
+	h += "$upscope $end\n";
+	h += "$enddefinitions $end\n";
+	h += "#0\n$dumpvars\n";
+	for (int i=0; i<(int)signals.size(); ++i) {
+		h += (char)('0' + last[i]);
+		h += w->ids[i];
+		h += '\n';
+	}
+	h += "$end\n";
+
+	auto* wp = w.get();
+	w->thread = std::thread([wp] () { wp->run(); });
+
+	writer = std::move(w);
+	return true;
+}
+
+void VcdExport::stop () {
+	if (!writer)
+		return;
+
+	writer->stopping.store(true, std::memory_order_release);
+	writer->thread.join();
+	if (writer->failed)
+		fprintf(stderr, "VcdExport: writing \"%s\" failed\n", filepath.c_str());
+
+	writer = nullptr;
+}
+
+void VcdExport::capture (LogicSim const& sim) {
+	if (!writer)
+		return;
+	ZoneScoped;
+
+	if (sim.viewed_chip.get() != chip || sim.state[0].size() != state_count) {
+		stop(); // state indices changed
+		return;
+	}
+
+	tick++;
+	uint8_t const* cur = sim.state[sim.cur_state].data();
+
+	changes.clear();
+	changes.push_back(VCD_TICK | tick);
+
+	for (size_t i=0; i<sids.size(); ++i) {
+		uint8_t val = cur[sids[i]];
+		if (val != last[i]) {
+			last[i] = val;
+			changes.push_back((uint64_t)i << 1 | val);
+		}
+	}
+
+	if (changes.size() == 1)
+		return; // no timestamp needed without changes
+
+	// if the writer falls behind, wait instead of dropping changes
+	size_t pushed = 0;
+	while ((pushed += writer->ring.push(changes.data() + pushed, changes.size() - pushed)) < changes.size())
+		std::this_thread::yield();
+}
+
+void VcdExport::imgui (LogicSim& sim, Editor& editor) {
+	signals.update(sim, running());
+
+	if (ImGui::TreeNodeEx("VCD Export")) {
+		ImGui::InputText("file##vcd", &filepath);
+
+		if (!running()) {
+			ImGui::BeginDisabled(signals.signals.empty());
+			if (ImGui::Button("Start Recording"))
+				start(sim);
+			ImGui::EndDisabled();
+		}
+		else {
+			if (ImGui::Button("Stop Recording"))
+				stop();
+			ImGui::SameLine();
+			ImGui::Text("%llu ticks", (unsigned long long)tick);
+		}
+
+		signals.imgui(sim, editor, !running());
+
+		ImGui::TreePop();
+	}
+}
+
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include "common.hpp"
+#include "logic_sim.hpp"
+#include "trace_signals.hpp"
+
+namespace logic_sim {
+
+// Streams value changes of signals to a VCD file (for GTKWave and other waveform viewers) while the sim runs
+// capture only compares the signals to their last values and queues the changes in a lock-free ring buffer,
+// formatting and file io happen on a writer thread
+// time in the file is ticks since start, so resetting the tick counter does not break the file
+// recording stops automatically if the viewed chip or its state count changes, since that invalidates the state indices
+struct VcdExport {
+	std::string filepath = "waves.vcd";
+
+	TraceSignalList signals;
+
+	VcdExport ();
+	~VcdExport ();
+
+	bool running () const { return (bool)writer; }
+	uint64_t ticks () const { return tick; }
+
+	bool start (LogicSim const& sim);
+	void stop ();
+
+	// call after every sim tick
+	void capture (LogicSim const& sim);
+
+	void imgui (LogicSim& sim, Editor& editor);
+
+private:
+	struct Writer;
+	std::unique_ptr<Writer> writer;
+
+	std::vector<int32_t>  sids;
+	std::vector<uint8_t>  last;
+	std::vector<uint64_t> changes;
+
+	uint64_t tick = 0;
+	Chip*    chip = nullptr;
+	size_t   state_count = 0;
+};
+
+}
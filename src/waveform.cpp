@@ -0,0 +1,362 @@
+#include "common.hpp"
+#include "waveform.hpp"
+
+namespace logic_sim {
+
+////
+static void write_varint (std::vector<uint8_t>& data, uint64_t val) {
+	do {
+		uint8_t byte = val & 0x7f;
+		val >>= 7;
+		data.push_back(byte | (val ? 0x80 : 0));
+	} while (val);
+}
+static uint64_t read_varint (uint8_t const* data, size_t& pos) {
+	uint64_t val = 0;
+	for (int shift=0; ; shift += 7) {
+		uint8_t byte = data[pos++];
+		val |= (uint64_t)(byte & 0x7f) << shift;
+		if (!(byte & 0x80))
+			return val;
+	}
+}
+
+void SignalHistory::begin (uint64_t tick, uint8_t val) {
+	blocks = { Block{ tick, 0, val } };
+	data.clear();
+	last_change = tick;
+	value = val;
+	block_changes = 0;
+}
+
+size_t SignalHistory::add_change (uint64_t tick) {
+	assert(tick > last_change);
+	value ^= 1;
+
+	size_t old_bytes = bytes();
+	if (block_changes >= BLOCK_CHANGES) {
+		blocks.push_back({ tick, (uint32_t)data.size(), value });
+		block_changes = 0;
+	}
+	else {
+		write_varint(data, tick - last_change);
+		block_changes++;
+	}
+
+	last_change = tick;
+	return bytes() - old_bytes;
+}
+
+// last block starting at or before tick
+static size_t find_block (std::vector<SignalHistory::Block> const& blocks, uint64_t tick) {
+	auto it = std::upper_bound(blocks.begin(), blocks.end(), tick,
+		[] (uint64_t t, SignalHistory::Block const& b) { return t < b.tick; });
+	return it == blocks.begin() ? 0 : (size_t)(it - blocks.begin()) - 1;
+}
+
+uint8_t SignalHistory::value_at (uint64_t tick) const {
+	size_t b = find_block(blocks, tick);
+	uint8_t val = blocks[b].value;
+	uint64_t t  = blocks[b].tick;
+
+	size_t end = b+1 < blocks.size() ? blocks[b+1].offset : data.size();
+	for (size_t pos = blocks[b].offset; pos < end; ) {
+		t += read_varint(data.data(), pos);
+		if (t > tick)
+			break;
+		val ^= 1;
+	}
+	return val;
+}
+
+uint64_t SignalHistory::next_change (uint64_t tick) const {
+	if (tick < blocks[0].tick)
+		return blocks[0].tick;
+
+	size_t b = find_block(blocks, tick);
+	uint64_t t = blocks[b].tick;
+
+	size_t end = b+1 < blocks.size() ? blocks[b+1].offset : data.size();
+	for (size_t pos = blocks[b].offset; pos < end; ) {
+		t += read_varint(data.data(), pos);
+		if (t > tick)
+			return t;
+	}
+	return b+1 < blocks.size() ? blocks[b+1].tick : UINT64_MAX;
+}
+
+size_t SignalHistory::trim (uint64_t tick) {
+	size_t b = find_block(blocks, tick);
+	if (b == 0)
+		return 0;
+
+	size_t old_bytes = bytes();
+
+	uint32_t offset = blocks[b].offset;
+	blocks.erase(blocks.begin(), blocks.begin() + b);
+	data.erase(data.begin(), data.begin() + offset);
+	for (auto& block : blocks)
+		block.offset -= offset;
+
+	// erase keeps the allocation, only shrinking actually frees memory
+	blocks.shrink_to_fit();
+	data.shrink_to_fit();
+
+	return old_bytes - bytes();
+}
+
+////
+void WaveCapture::start (LogicSim const& sim) {
+	if (signals.chip != sim.viewed_chip.get() || signals.signals.empty())
+		return;
+	for (auto& s : signals.signals) {
+		if (s.sid < 0 || s.sid >= (int)sim.state[0].size())
+			return; // picked before an edit, see TraceSignalList::update
+	}
+
+	chip = sim.viewed_chip.get();
+	state_count = sim.state[0].size();
+
+	uint8_t const* cur = sim.state[sim.cur_state].data();
+
+	captured = signals.signals;
+	sids.resize(captured.size());
+	history.assign(captured.size(), {});
+	bytes = 0;
+	for (int i=0; i<(int)captured.size(); ++i) {
+		sids[i] = captured[i].sid;
+		history[i].begin(0, cur[sids[i]]);
+		bytes += history[i].bytes();
+	}
+
+	first_tick = 0;
+	tick = 0;
+	cursor = 0;
+	view_start = 0;
+	follow = true;
+	recording = true;
+}
+void WaveCapture::stop () {
+	recording = false;
+}
+
+void WaveCapture::capture (LogicSim const& sim) {
+	if (!recording)
+		return;
+	ZoneScoped;
+
+	if (sim.viewed_chip.get() != chip || sim.state[0].size() != state_count) {
+		stop(); // state indices changed, keep what was captured so far
+		return;
+	}
+
+	tick++;
+	uint8_t const* cur = sim.state[sim.cur_state].data();
+
+	for (size_t i=0; i<sids.size(); ++i) {
+		if (cur[sids[i]] != history[i].value)
+			bytes += history[i].add_change(tick);
+	}
+
+	if (bytes > budget)
+		trim_to_budget();
+}
+
+void WaveCapture::trim_to_budget () {
+	ZoneScoped;
+
+	// drop the oldest quarter of the history until there is some room, so this does not happen every tick
+	while (bytes > budget - budget/4 && first_tick < tick) {
+		uint64_t cutoff = first_tick + (tick - first_tick) / 4 + 1;
+		for (auto& h : history)
+			bytes -= h.trim(cutoff);
+		first_tick = cutoff;
+	}
+}
+
+////
+void WaveCapture::imgui (LogicSim& sim, Editor& editor) {
+	signals.update(sim, recording);
+
+	if (ImGui::TreeNodeEx("Waveform Capture")) {
+		if (!recording) {
+			ImGui::BeginDisabled(signals.signals.empty());
+			if (ImGui::Button("Start Capture"))
+				start(sim);
+			ImGui::EndDisabled();
+		}
+		else {
+			if (ImGui::Button("Stop Capture"))
+				stop();
+		}
+		ImGui::SameLine();
+		ImGui::Checkbox("Show Timeline", &show_window);
+
+		int budget_mb = (int)(budget >> 20);
+		if (ImGui::DragInt("Memory Budget", &budget_mb, 1, 1, 16384, "%d MB"))
+			budget = (size_t)max(budget_mb, 1) << 20;
+
+		if (!history.empty())
+			ImGui::Text("ticks %llu - %llu, %.2f MB", (unsigned long long)first_tick, (unsigned long long)tick, (float)bytes / (1024*1024));
+
+		signals.imgui(sim, editor, true);
+
+		ImGui::TreePop();
+	}
+}
+
+// round up to 1, 2 or 5 * 10^n
+static double nice_step (double min_step) {
+	double step = 1;
+	while (step < min_step) {
+		if      (step * 2 >= min_step) return step * 2;
+		else if (step * 5 >= min_step) return step * 5;
+		step *= 10;
+	}
+	return step;
+}
+
+void WaveCapture::imgui_window () {
+	if (!show_window)
+		return;
+
+	ImGui::SetNextWindowSize(ImVec2(900, 320), ImGuiCond_FirstUseEver);
+	if (!ImGui::Begin("Waveforms", &show_window)) {
+		ImGui::End();
+		return;
+	}
+
+	if (history.empty()) {
+		ImGui::Text("Nothing captured yet, add signals and start a capture in Simulation > Waveform Capture");
+		ImGui::End();
+		return;
+	}
+
+	constexpr float NAME_W = 200;
+	constexpr float ROW_H  = 18;
+	constexpr ImU32 COL_WAVE  = IM_COL32( 80, 230,  80, 255);
+	constexpr ImU32 COL_DENSE = IM_COL32( 80, 160,  80, 160);
+	constexpr ImU32 COL_GRID  = IM_COL32(255, 255, 255,  30);
+	constexpr ImU32 COL_CUR   = IM_COL32(255, 200,  40, 255);
+	constexpr ImU32 COL_TEXT  = IM_COL32(220, 220, 220, 255);
+
+	ImGui::Checkbox("Follow", &follow);
+	ImGui::SameLine();
+	ImGui::SetNextItemWidth(150);
+	ImGui::InputScalar("Cursor", ImGuiDataType_U64, &cursor);
+	ImGui::SameLine();
+	ImGui::Text("ticks %llu - %llu", (unsigned long long)first_tick, (unsigned long long)tick);
+
+	float plot_w = max(ImGui::GetContentRegionAvail().x - NAME_W, 50.0f);
+
+	double max_ticks_per_px = max((double)(tick - first_tick) / plot_w, 1.0);
+	ticks_per_px = std::clamp(ticks_per_px, 1.0 / 64, max_ticks_per_px);
+
+	if (follow)
+		view_start = (double)tick - plot_w * ticks_per_px;
+	view_start = std::clamp(view_start, (double)first_tick, max((double)tick - plot_w * ticks_per_px, (double)first_tick));
+
+	ImGui::BeginChild("timeline", ImVec2(0, 0), false);
+	auto* dl = ImGui::GetWindowDrawList();
+
+	ImVec2 origin = ImGui::GetCursorScreenPos();
+	float x0 = origin.x + NAME_W;
+
+	auto tick2x = [&] (double t) { return x0 + (float)((t - view_start) / ticks_per_px); };
+	auto x2tick = [&] (float x) { return view_start + (double)(x - x0) * ticks_per_px; };
+
+	double view_end = view_start + plot_w * ticks_per_px;
+
+	// zoom around mouse, drag to pan, click to place cursor
+	auto& io = ImGui::GetIO();
+	if (ImGui::IsWindowHovered() && io.MousePos.x >= x0) {
+		if (io.MouseWheel != 0) {
+			double t = x2tick(io.MousePos.x);
+			ticks_per_px = std::clamp(ticks_per_px * pow(0.8, (double)io.MouseWheel), 1.0 / 64, max_ticks_per_px);
+			view_start = t - (double)(io.MousePos.x - x0) * ticks_per_px;
+			follow = false;
+		}
+		if (ImGui::IsMouseDragging(ImGuiMouseButton_Left) && io.MouseDelta.x != 0) {
+			view_start -= (double)io.MouseDelta.x * ticks_per_px;
+			follow = false;
+		}
+		else if (ImGui::IsMouseReleased(ImGuiMouseButton_Left) && ImGui::GetMouseDragDelta(ImGuiMouseButton_Left).x == 0) {
+			cursor = (uint64_t)std::clamp(round(x2tick(io.MousePos.x)), (double)first_tick, (double)tick);
+		}
+	}
+
+	// tick ruler
+	{
+		double step = nice_step(100 * ticks_per_px);
+		for (double t = ceil(view_start / step) * step; t <= view_end; t += step) {
+			float x = tick2x(t);
+			dl->AddLine(ImVec2(x, origin.y), ImVec2(x, origin.y + ROW_H), COL_GRID);
+			dl->AddText(ImVec2(x + 2, origin.y), COL_TEXT, prints("%.0f", t).c_str());
+		}
+		ImGui::Dummy(ImVec2(NAME_W + plot_w, ROW_H));
+	}
+
+	bool cursor_valid = cursor >= first_tick && cursor <= tick;
+
+	ImGuiListClipper clip;
+	clip.Begin((int)history.size(), ROW_H);
+	while (clip.Step()) {
+		for (int i=clip.DisplayStart; i<clip.DisplayEnd; ++i) {
+			auto& h = history[i];
+			ImVec2 p = ImGui::GetCursorScreenPos();
+
+			dl->PushClipRect(p, ImVec2(p.x + NAME_W - 4, p.y + ROW_H), true);
+			std::string label = cursor_valid ?
+				prints("%d %s", h.value_at(cursor), captured[i].name.c_str()) : captured[i].name;
+			dl->AddText(ImVec2(p.x, p.y + 1), COL_TEXT, label.c_str());
+			dl->PopClipRect();
+
+			float y_hi = p.y + 3, y_lo = p.y + ROW_H - 3;
+			auto y = [&] (uint8_t v) { return v ? y_hi : y_lo; };
+
+			dl->PushClipRect(ImVec2(x0, p.y), ImVec2(x0 + plot_w, p.y + ROW_H), true);
+
+			// walk from change to change, changes closer than a pixel are drawn as a filled box
+			// so this takes O(pixels) lookups no matter how many changes are in view
+			uint64_t t   = (uint64_t)max(floor(view_start), (double)first_tick);
+			uint64_t end = (uint64_t)min(ceil(view_end), (double)tick);
+			if (t < end) {
+				uint8_t v = h.value_at(t);
+				while (t < end) {
+					uint64_t nc = min(h.next_change(t), end);
+					dl->AddLine(ImVec2(tick2x((double)t), y(v)), ImVec2(tick2x((double)nc), y(v)), COL_WAVE);
+					if (nc >= end)
+						break;
+
+					uint64_t px_end = (uint64_t)max(ceil(x2tick(floor(tick2x((double)nc)) + 1)), (double)nc + 1);
+					if (h.next_change(nc) < px_end) {
+						uint64_t box_end = min(px_end, end);
+						dl->AddRectFilled(ImVec2(tick2x((double)nc), y_hi), ImVec2(max(tick2x((double)box_end), tick2x((double)nc) + 1), y_lo), COL_DENSE);
+						t = box_end;
+						if (t < end)
+							v = h.value_at(t);
+					}
+					else {
+						dl->AddLine(ImVec2(tick2x((double)nc), y_hi), ImVec2(tick2x((double)nc), y_lo), COL_WAVE);
+						v ^= 1;
+						t = nc;
+					}
+				}
+			}
+
+			dl->PopClipRect();
+			ImGui::Dummy(ImVec2(NAME_W + plot_w, ROW_H));
+		}
+	}
+
+	if (cursor_valid) {
+		float x = tick2x((double)cursor);
+		if (x >= x0 && x <= x0 + plot_w)
+			dl->AddLine(ImVec2(x, origin.y), ImVec2(x, ImGui::GetWindowPos().y + ImGui::GetWindowHeight()), COL_CUR);
+	}
+
+	ImGui::EndChild();
+	ImGui::End();
+}
+
+}
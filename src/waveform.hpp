@@ -0,0 +1,87 @@
+#pragma once
+#include "common.hpp"
+#include "logic_sim.hpp"
+#include "trace_signals.hpp"
+
+namespace logic_sim {
+
+// Change history of one signal, since signals are binary only the ticks where the value flips are stored
+// stored as varint encoded deltas between changes (run lengths), grouped into blocks of up to BLOCK_CHANGES changes
+// blocks store their first tick and value, so a lookup is a binary search over blocks plus decoding one block
+struct SignalHistory {
+	static constexpr int BLOCK_CHANGES = 64;
+
+	struct Block {
+		uint64_t tick;   // tick of first change in block (or start of history)
+		uint32_t offset; // into data of the delta after the first change
+		uint8_t  value;  // value from tick on
+	};
+	std::vector<Block>   blocks;
+	std::vector<uint8_t> data;
+
+	uint64_t last_change = 0;
+	uint8_t  value = 0; // current value
+	int      block_changes = 0;
+
+	void begin (uint64_t tick, uint8_t val);
+	// returns bytes allocated by the change (0 unless a vector had to grow)
+	size_t add_change (uint64_t tick);
+
+	// value at tick (>= first tick of history)
+	uint8_t value_at (uint64_t tick) const;
+	// first change after tick, UINT64_MAX if none
+	uint64_t next_change (uint64_t tick) const;
+
+	// drop whole blocks before tick, returns bytes freed
+	size_t trim (uint64_t tick);
+
+	// allocated, not used bytes, so the memory budget holds for the real usage
+	size_t bytes () const { return blocks.capacity() * sizeof(Block) + data.capacity(); }
+};
+
+// Records the history of signals in memory while the sim runs, within a memory budget (oldest history is dropped)
+// time is ticks since the capture was started
+struct WaveCapture {
+	TraceSignalList signals;
+
+	size_t budget = 64 << 20; // bytes
+
+	bool show_window = false;
+
+	bool running () const { return recording; }
+
+	void start (LogicSim const& sim);
+	void stop ();
+
+	// call after every sim tick
+	void capture (LogicSim const& sim);
+
+	void imgui (LogicSim& sim, Editor& editor);
+	// timeline panel in its own window
+	void imgui_window ();
+
+private:
+	bool recording = false;
+
+	// copy of signals at start, so the list can be edited while looking at a capture
+	std::vector<TraceSignal>   captured;
+	std::vector<int32_t>       sids;
+	std::vector<SignalHistory> history;
+
+	uint64_t first_tick = 0; // oldest tick still in history
+	uint64_t tick = 0;       // last captured tick
+	size_t   bytes = 0;
+
+	Chip*    chip = nullptr;
+	size_t   state_count = 0;
+
+	// timeline view
+	double view_start = 0;
+	double ticks_per_px = 1.0 / 8;
+	bool   follow = true;
+	uint64_t cursor = 0;
+
+	void trim_to_budget ();
+};
+
+}